@@ -0,0 +1,59 @@
+#include "AliasTable.h"
+
+#include <algorithm>
+#include <cmath>
+
+void AliasTable::Build(const std::vector<double>& weights)
+{
+	m_Columns.clear();
+	double total = 0;
+	for (auto weight : weights) {
+		total += std::max(weight, 0.0);
+	}
+	if (weights.empty() || !(total > 0)) {
+		return;
+	}
+
+	// Scaled so the average column is 1, then small columns are topped up from large ones
+	auto n = weights.size();
+	std::vector<double> scaled(n);
+	std::vector<uint32_t> small, large;
+	small.reserve(n);
+	large.reserve(n);
+	for (size_t i = 0; i < n; ++i) {
+		scaled[i] = std::max(weights[i], 0.0) * n / total;
+		(scaled[i] < 1 ? small : large).push_back((uint32_t)i);
+	}
+
+	m_Columns.resize(n);
+	auto toThreshold = [](double probability) {
+		return (uint32_t)std::min(probability * 4294967296.0, 4294967295.0);
+	};
+
+	while (!small.empty() && !large.empty()) {
+		auto less = small.back();
+		small.pop_back();
+		auto more = large.back();
+		large.pop_back();
+
+		m_Columns[less] = { toThreshold(scaled[less]), more };
+		scaled[more] = (scaled[more] + scaled[less]) - 1;
+		(scaled[more] < 1 ? small : large).push_back(more);
+	}
+
+	// What's left is 1 up to rounding errors
+	for (auto i : large) {
+		m_Columns[i] = { UINT32_MAX, i };
+	}
+	for (auto i : small) {
+		m_Columns[i] = { UINT32_MAX, i };
+	}
+}
+
+size_t AliasTable::Draw(uint64_t random) const
+{
+	// Multiply and shift instead of a modulo, which has no bias worth mentioning
+	auto column = (size_t)(((random >> 32) * m_Columns.size()) >> 32);
+	const auto& entry = m_Columns[column];
+	return (uint32_t)random < entry.threshold ? column : entry.alias;
+}
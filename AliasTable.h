@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Draws an index with a probability proportional to its weight, in constant time, with
+// Vose's alias method: every column holds its own index with some probability and one
+// other index (its alias) for the rest, so a draw is one column and one coin.
+// Building is linear in the number of weights.
+class AliasTable {
+public:
+	// Weights <= 0 are never drawn
+	void Build(const std::vector<double>& weights);
+	bool IsEmpty() const { return m_Columns.empty(); }
+	size_t Size() const { return m_Columns.size(); }
+
+	// From 64 random bits: the high half picks the column, the low half tosses the coin
+	size_t Draw(uint64_t random) const;
+
+private:
+	struct Column {
+		uint32_t threshold; // Keep the column when the coin is below this, out of 2^32
+		uint32_t alias;
+	};
+
+	std::vector<Column> m_Columns;
+};
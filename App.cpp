@@ -62,9 +62,22 @@ App* App::instance = nullptr;
 
 App::~App()
 {
+	StopRenderThreads();
+	m_Loader.Stop();
+	m_Tasks.Stop();
+	m_Library.StopScan();
+	if (m_WakeEvent) {
+		CloseHandle(m_WakeEvent);
+		m_WakeEvent = nullptr;
+	}
 	instance = nullptr;
+	m_Library.SaveIndex();
 	for (auto& screenSaver : m_Screensavers) {
 		screenSaver.DiscardDeviceResources();
+		if (screenSaver.m_WakeEvent) {
+			CloseHandle(screenSaver.m_WakeEvent);
+			screenSaver.m_WakeEvent = nullptr;
+		}
 	}
 
 	if (m_MouseHook) {
@@ -103,16 +116,30 @@ HRESULT App::Initialize(HINSTANCE hInstance, const std::wstring& cmd) {
 		return 0;
 	}
 
-	m_Library.SetPaths(settings.IncludePaths, settings.ExcludePaths);
-
+	// The library needs the votes before it finds the photos
+	std::unordered_map<std::wstring, UINT32> loveVotes;
+	std::unordered_set<std::wstring> downVotes;
 	std::wifstream fin(m_VoteFile);
 	std::wstring line;
 	while (std::getline(fin, line)) {
 		if (line.rfind(THUMB_DOWN L" ", 0) == 0 ||
 			line.rfind(DOWN_VOTE L" ", 0) == 0) {
-			m_Downvoted.insert(line.substr(5));
+			downVotes.insert(line.substr(5));
+		}
+		else if (line.rfind(LOVE_VOTE L" ", 0) == 0) {
+			++loveVotes[line.substr(5)];
 		}
 	}
+	m_Library.SetVotes(std::move(loveVotes), std::move(downVotes), settings.LovedEvery);
+
+	m_Library.SetPaths(settings.IncludePaths, settings.ExcludePaths, settings.ScanThreads);
+	// Wake the message loop when a photo or a location is ready
+	m_WakeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	m_Loader.SetOnReady([this] { Wake(); });
+	m_Tasks.SetOnResult([this] { SetEvent(m_WakeEvent); });
+	// Location lookups: few threads, so Nominatim isn't flooded and navigating can't pile up threads
+	m_Tasks.Start(2, 64);
+	m_Loader.Start(settings, m_Tasks, m_StateMutex);
 
 	HRESULT hr = CreateDeviceIndependentResources();
 	if (FAILED(hr)) {
@@ -211,12 +238,18 @@ HRESULT App::Initialize(HINSTANCE hInstance, const std::wstring& cmd) {
 	for (auto& screen : m_Screensavers) {
 		ShowWindow(screen.m_hwnd, SW_SHOWNORMAL);
 		UpdateWindow(screen.m_hwnd);
-		screen.LoadSprite(screen.m_CurrentSprite);
 		screen.Update(0);
 		screen.OnRender();
 
 	}
 
+	if (settings.RenderThreads) {
+		for (auto& screen : m_Screensavers) {
+			screen.StartRenderThread();
+		}
+		m_RenderThreadsRunning = true;
+	}
+
 	//if (!startFullscreen)
 	//{
 	//	SetFullscreen(false);
@@ -234,8 +267,9 @@ void App::SaveVote(const std::wstring& kind, const std::wstring& path) {
 
 // Create resources which are not dependent on the device
 HRESULT App::CreateDeviceIndependentResources() {
+	// Render threads draw on their own windows at the same time
 	HRESULT hr = D2D1CreateFactory(
-		D2D1_FACTORY_TYPE_SINGLE_THREADED,
+		settings.RenderThreads ? D2D1_FACTORY_TYPE_MULTI_THREADED : D2D1_FACTORY_TYPE_SINGLE_THREADED,
 		m_pD2DFactory.GetAddressOf()
 	);
 
@@ -277,7 +311,11 @@ HRESULT App::CreateDeviceIndependentResources() {
 void App::OnRender()
 {
 	for (auto& screen : m_Screensavers) {
+		if (settings.OnDemandRendering && screen.TimeUntilRender() > 0) {
+			continue;
+		}
 		HRESULT hr = screen.OnRender();
+		++m_FrameCount;
 		if (FAILED(hr)) {
 			// Handle error
 		}
@@ -330,20 +368,89 @@ void App::StartSwap(bool animate, int offset)
 	m_DisplayTimer = settings.DisplayDuration;
 }
 
+void App::Invalidate()
+{
+	for (auto& screen : m_Screensavers) {
+		screen.m_NeedsRender = true;
+	}
+}
+
+// Wakes the message loop and the render threads. Any thread can call this.
+void App::Wake()
+{
+	SetEvent(m_WakeEvent);
+	if (m_RenderThreadsRunning) {
+		for (auto& screen : m_Screensavers) {
+			screen.Wake();
+		}
+	}
+}
+
+void App::StopRenderThreads()
+{
+	m_StopRendering = true;
+	for (auto& screen : m_Screensavers) {
+		screen.StopRenderThread();
+	}
+}
+
+float App::TimeUntilChange() const
+{
+	float wait = std::numeric_limits<float>::infinity();
+	if (m_ShowButtons) {
+		auto shown = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_LastMouseMove).count();
+		wait = std::max(0.f, VOTE_BUTTONS_DISPLAY_TIME - shown);
+	}
+	if (!m_IsPaused) {
+		wait = std::min(wait, std::max(0.f, m_DisplayTimer));
+	}
+
+	if (m_RenderThreadsRunning) {
+		// The render threads keep their own time
+		return wait;
+	}
+
+	for (const auto& screen : m_Screensavers) {
+		if (m_IsPaused) {
+			// Nothing moves while paused
+			if (screen.m_NeedsRender) {
+				return 0;
+			}
+			continue;
+		}
+		wait = std::min(wait, screen.TimeUntilRender());
+		if (!screen.m_CurrentSprite->imageInfo) {
+			// Still waiting for the scan to find a first photo
+			wait = std::min(wait, 0.1f);
+		}
+	}
+	return wait;
+}
+
 void App::Update(float deltaTime)
 {
+	if (m_Tasks.DeliverResults() > 0) {
+		// A location may have come in for a caption on screen
+		Invalidate();
+	}
+
 	if (std::chrono::steady_clock::now() - m_LastMouseMove > std::chrono::seconds(VOTE_BUTTONS_DISPLAY_TIME)) {
 		m_ShowButtons = false;
 	}
+	if (m_ShowButtons != m_RenderedButtons) {
+		m_RenderedButtons = m_ShowButtons;
+		Invalidate();
+	}
 
-	if (m_IsPaused)
-	{
-		return;
+	if (!m_IsPaused) {
+		m_DisplayTimer -= deltaTime;
+		if (m_DisplayTimer <= 0.0f) {
+			StartSwap(true, 1);
+		}
 	}
 
-	m_DisplayTimer -= deltaTime;
-	if (m_DisplayTimer <= 0.0f) {
-		StartSwap(true, 1);
+	if (m_RenderThreadsRunning) {
+		return;
 	}
 
 	for (auto& screen : m_Screensavers) {
@@ -365,6 +472,21 @@ static void ShowMyCursor(bool show)
 }
 
 LRESULT CALLBACK App::WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+	auto app = App::instance;
+	if (app && !app->m_StateLock.owns_lock()) {
+		// From a modal loop, or from before the message loop
+		app->m_StateLock.lock();
+		auto result = HandleMessage(hwnd, message, wParam, lParam);
+		if (app->m_StateLock.owns_lock()) {
+			app->m_StateLock.unlock();
+		}
+		return result;
+	}
+	return HandleMessage(hwnd, message, wParam, lParam);
+}
+
+LRESULT App::HandleMessage(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
 	auto app = App::instance;
 	if (message == WM_CREATE) {
@@ -465,16 +587,17 @@ LRESULT CALLBACK App::WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lPa
 			if (app) app->StartSwap(false, 1);
 			break;
 
+		// The captions are redrawn when the windows are invalidated
 		case 'F':
-			if (app) app->settings.ToggleShowFolder();
+			if (app) { app->settings.ToggleShowFolder(); app->Invalidate(); }
 			break;
 
 		case 'D':
-			if (app) app->settings.ToggleShowDate();
+			if (app) { app->settings.ToggleShowDate(); app->Invalidate(); }
 			break;
 
 		case 'L':
-			if (app) app->settings.ToggleShowLocation();
+			if (app) { app->settings.ToggleShowLocation(); app->Invalidate(); }
 			break;
 
 		case 'P':
@@ -482,7 +605,16 @@ LRESULT CALLBACK App::WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lPa
 			break;
 
 		case 'C':
-			if (app) app->settings.Show();
+			if (app) {
+				// The render threads go on while the dialog is open, so it edits a copy,
+				// which is taken over under the lock when it closes
+				auto edited = app->settings;
+				app->m_StateLock.unlock();
+				edited.Show();
+				app->m_StateLock.lock();
+				app->settings = edited;
+				app->Invalidate();
+			}
 			break;
 		}
 	}
@@ -517,13 +649,20 @@ LRESULT CALLBACK App::WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lPa
 		}
 	break;
 
+	case WM_PAINT:
+		// Uncovered: draw it again, DefWindowProc validates
+		if (app) {
+			for (auto& screen : app->m_Screensavers) {
+				if (screen.m_hwnd == hwnd) {
+					screen.m_NeedsRender = true;
+				}
+			}
+		}
+		break;
+
 	//case WM_DISPLAYCHANGE:
 	//	InvalidateRect(hwnd, nullptr, FALSE);
 	//	break;
-	//
-	//case WM_PAINT:
-	//	ValidateRect(hwnd, nullptr);
-	//	break;
 
 	case WM_DESTROY:
 		if (app) { app->m_WantsToQuit = true; }
@@ -561,16 +700,16 @@ LRESULT CALLBACK App::LowLevelMouseProc(int nCode, WPARAM wParam, LPARAM lParam)
 
 					// Hit-test buttons
 					if (PtInRect(&screen.m_LoveButtonRect, cpt)) {
-						App::instance->SaveVote(LOVE_VOTE, screen.m_CurrentSprite->imageInfo->filePath);
+						App::instance->SaveVote(LOVE_VOTE, screen.m_CurrentSprite->imageInfo->GetFilePath());
+						App::instance->m_Library.AddLoveVote(screen.m_CurrentSprite->imageInfo);
 						//wchar_t buf[2048] = {};
 						//wsprintf(buf, L"LOVE!! %s (%d)\n", screen.m_CurrentSprite->imageInfo->filePath.c_str(), screen.m_AdapterIndex);
 						//OutputDebugStringW(buf);
 						return 1; // consume click
 					}
 					else if (PtInRect(&screen.m_DownVoteButtonRect, cpt)) {
-						const auto& path = screen.m_CurrentSprite->imageInfo->filePath;
-						App::instance->SaveVote(DOWN_VOTE, path);
-						App::instance->m_Downvoted.insert(path);
+						App::instance->SaveVote(DOWN_VOTE, screen.m_CurrentSprite->imageInfo->GetFilePath());
+						App::instance->m_Library.Skip(screen.m_CurrentSprite->imageInfo);
 						screen.StartSwap(false, screen.m_AdapterIndex, (int)App::instance->m_Screensavers.size()); // TODO: force reload to a new image
 						return 1; // consume click
 					}
@@ -681,9 +820,13 @@ HRESULT App::LoadBitmapFromFile(
 
 void App::RunMessageLoop()
 {
-	const auto targetFrameTime = std::chrono::milliseconds(1000 / 60);
+	const auto targetFrameTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::duration<float>(1 / ScreenSaverWindow::GetMaxFrameRate()));
+	// Wake up now and then even when nothing should change, in case something was missed
+	const auto maxIdleTime = std::chrono::milliseconds(1000);
 
 	auto frameStart = std::chrono::steady_clock::now();
+	const auto loopStart = frameStart;
 	auto previousFrameStart = frameStart;
 	bool isRunning = true;
 
@@ -693,6 +836,8 @@ void App::RunMessageLoop()
 		// Record the start time of this frame
 		frameStart = std::chrono::steady_clock::now();
 
+		m_StateLock.lock();
+
 		// Process all pending Windows messages
 		while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
 			// Check if we should quit
@@ -713,17 +858,71 @@ void App::RunMessageLoop()
 		auto deltaTime = std::chrono::duration_cast<std::chrono::milliseconds>(frameStart - previousFrameStart).count() / 1000.f;
 		Update(deltaTime);
 
+		if (m_RenderThreadsRunning) {
+			// Input or a timer may have changed what they show
+			for (auto& screen : m_Screensavers) {
+				screen.Wake();
+			}
+			auto idleTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::duration<float>(
+				std::min(TimeUntilChange(), std::chrono::duration<float>(maxIdleTime).count())));
+			m_StateLock.unlock();
+			MsgWaitForMultipleObjectsEx(1, &m_WakeEvent, (DWORD)idleTime.count(), QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+			continue;
+		}
+
 		OnRender();
+		m_StateLock.unlock();
 
 		// Calculate how long this frame took
 		auto frameTime = std::chrono::steady_clock::now() - frameStart;
 
-		// Sleep if we have time remaining to maintain 60 FPS
-		if (frameTime < targetFrameTime) {
+		if (settings.OnDemandRendering) {
+			// Sleep until the next frame would look different, or until there is input or a
+			// photo or location comes in
+			auto idleTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::duration<float>(
+				std::min(TimeUntilChange(), std::chrono::duration<float>(maxIdleTime).count())));
+			auto waitTime = std::max(std::chrono::duration_cast<std::chrono::milliseconds>(targetFrameTime - frameTime), idleTime);
+			if (waitTime.count() > 0) {
+				MsgWaitForMultipleObjectsEx(1, &m_WakeEvent, (DWORD)waitTime.count(), QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+			}
+		}
+		// Sleep if we have time remaining to maintain MaxFPS
+		else if (frameTime < targetFrameTime) {
 			auto sleepTime = targetFrameTime - frameTime;
 			Sleep((DWORD)std::chrono::duration_cast<std::chrono::milliseconds>(sleepTime).count());
 		}
 	}
+
+	if (m_StateLock.owns_lock()) {
+		m_StateLock.unlock();
+	}
+	StopRenderThreads();
+	for (size_t i = 0; i < m_Screensavers.size(); ++i) {
+		const auto& stats = m_Screensavers[i].m_FrameStats;
+		if (m_RenderThreadsRunning) {
+			m_FrameCount += stats.frames;
+		}
+		if (stats.frames > 0) {
+			std::wcout << L"Monitor " << i + 1 << L": " << stats.frames << L" frames, "
+				<< stats.totalSeconds * 1000 / stats.frames << L" ms average, " << stats.worstSeconds * 1000 << L" ms worst, "
+				<< stats.lateFrames << L" late" << std::endl;
+		}
+	}
+
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+		auto toSeconds = [](const FILETIME& time) {
+			return (((ULONGLONG)time.dwHighDateTime << 32) | time.dwLowDateTime) / 1e7;
+		};
+		auto cpuSeconds = toSeconds(kernelTime) + toSeconds(userTime);
+		auto wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loopStart).count();
+		std::wcout << (settings.OnDemandRendering ? L"On-demand" : L"Continuous") << L" rendering: "
+			<< m_FrameCount << L" frames in " << wallSeconds << L" s, " << cpuSeconds << L" s CPU";
+		if (wallSeconds > 0) {
+			std::wcout << L" (" << cpuSeconds * 3600 / wallSeconds << L" s CPU per hour)";
+		}
+		std::wcout << std::endl;
+	}
 }
 
 int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPWSTR lpCmdLine, _In_ int nCmdShow)
@@ -6,11 +6,14 @@
 #include <dwrite.h>
 #include <wincodec.h>
 #include <wrl/client.h>
+#include <atomic>
 #include <fstream>
-#include <unordered_set>
+#include <mutex>
 
 #include "ImageFileNameLibrary.h"
+#include "ImageLoader.h"
 #include "SettingsDialog.h"
+#include "TaskPool.h"
 
 using Microsoft::WRL::ComPtr;
 class ScreenSaverWindow;
@@ -34,14 +37,29 @@ public:
 	int m_CurentScreenIndex = 0;
 
 	ImageFileNameLibrary m_Library;
+	ImageLoader m_Loader;
+	TaskPool m_Tasks;
 
-	std::unordered_set<std::wstring> m_Downvoted;
 	const std::wstring m_VoteFile = L"votes.txt";
 
 	POINT m_LastMouse = {};
 	std::chrono::steady_clock::time_point m_LastMouseMove = std::chrono::steady_clock::now();
 	bool m_ShowButtons = false;
+	bool m_RenderedButtons = false;
 	float m_DisplayTimer = 0;
+	HANDLE m_WakeEvent = nullptr; // Set by the background threads when there is something new to show
+	size_t m_FrameCount = 0;
+
+	// With RenderThreads, every window is drawn on a thread of its own. They only look at
+	// the library, the votes and the photo infos while holding the state lock, which the UI
+	// thread holds while it handles input and updates. The image loader fills in the photo
+	// infos under it too.
+	std::mutex m_StateMutex;
+	// The UI thread's hold on m_StateMutex. It is let go around modal UI, and the messages
+	// that come in through the modal loop take it again one at a time.
+	std::unique_lock<std::mutex> m_StateLock{ m_StateMutex, std::defer_lock };
+	std::atomic<bool> m_RenderThreadsRunning = false;
+	std::atomic<bool> m_StopRendering = false;
 	HHOOK m_MouseHook = nullptr;
 
 	SettingsDialog settings;
@@ -57,8 +75,14 @@ public:
 	HRESULT CreateDeviceIndependentResources();
 	void Update(float deltaTime);
 	void OnRender();
+	void Invalidate();
+	void Wake();
+	void StopRenderThreads();
+	// Seconds until any window looks different, infinity when nothing changes until there is input
+	float TimeUntilChange() const;
 	void SetFullscreen(bool fullscreen);
 	static LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam);
+	static LRESULT HandleMessage(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam);
 	static LRESULT CALLBACK LowLevelMouseProc(int nCode, WPARAM wParam, LPARAM lParam);
 	void StartSwap(bool animate, int offset);
 	void TogglePause() { m_IsPaused = !m_IsPaused; }
@@ -0,0 +1,107 @@
+#include "CaptionCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+HRESULT CaptionCache::Draw(ID2D1RenderTarget* pTarget, IDWriteFactory* pDWriteFactory, IDWriteTextFormat* pFormat,
+	const std::wstring& text, const CaptionStyle& style, float alpha, float x, float y, float w, float h)
+{
+	auto it = std::find_if(m_Entries.begin(), m_Entries.end(), [&](const Entry& entry) {
+		return entry.text == text && entry.style == style && entry.width == w && entry.height == h;
+	});
+
+	if (it != m_Entries.end()) {
+		m_Entries.splice(m_Entries.begin(), m_Entries, it);
+	}
+	else {
+		Entry entry{ text, style, w, h };
+		HRESULT hr = Rasterize(pTarget, pDWriteFactory, pFormat, entry);
+		if (FAILED(hr)) {
+			return hr;
+		}
+
+		m_Entries.push_front(std::move(entry));
+		if (m_Entries.size() > MaxEntries) {
+			m_Entries.pop_back();
+		}
+	}
+
+	const auto& entry = m_Entries.front();
+	auto size = entry.bitmap->GetSize();
+	auto left = x + entry.offset.x;
+	auto top = y + entry.offset.y;
+	pTarget->DrawBitmap(entry.bitmap.Get(), D2D1::RectF(left, top, left + size.width, top + size.height),
+		alpha, D2D1_BITMAP_INTERPOLATION_MODE_LINEAR);
+	return S_OK;
+}
+
+HRESULT CaptionCache::Rasterize(ID2D1RenderTarget* pTarget, IDWriteFactory* pDWriteFactory, IDWriteTextFormat* pFormat, Entry& entry)
+{
+	ComPtr<IDWriteTextLayout> pLayout;
+	HRESULT hr = pDWriteFactory->CreateTextLayout(
+		entry.text.c_str(),
+		(UINT32)entry.text.length(),
+		pFormat,
+		entry.width, entry.height,
+		pLayout.GetAddressOf()
+	);
+	if (FAILED(hr)) return hr;
+
+	// Only the ink, and the outline around it, instead of the whole layout box
+	DWRITE_OVERHANG_METRICS overhang;
+	hr = pLayout->GetOverhangMetrics(&overhang);
+	if (FAILED(hr)) return hr;
+
+	float margin = std::ceil(std::max(entry.style.outlineWidth, 0.f)) + 1;
+	float left = std::floor(-overhang.left) - margin;
+	float top = std::floor(-overhang.top) - margin;
+	float right = std::ceil(entry.width + overhang.right) + margin;
+	float bottom = std::ceil(entry.height + overhang.bottom) + margin;
+	if (right <= left || bottom <= top) {
+		return E_INVALIDARG;
+	}
+
+	ComPtr<ID2D1BitmapRenderTarget> pBitmapTarget;
+	hr = pTarget->CreateCompatibleRenderTarget(D2D1::SizeF(right - left, bottom - top), pBitmapTarget.GetAddressOf());
+	if (FAILED(hr)) return hr;
+
+	ComPtr<ID2D1SolidColorBrush> pOutlineBrush;
+	ComPtr<ID2D1SolidColorBrush> pFillBrush;
+	hr = pBitmapTarget->CreateSolidColorBrush(D2D1::ColorF(entry.style.outlineColor), pOutlineBrush.GetAddressOf());
+	if (FAILED(hr)) return hr;
+	hr = pBitmapTarget->CreateSolidColorBrush(D2D1::ColorF(entry.style.textColor), pFillBrush.GetAddressOf());
+	if (FAILED(hr)) return hr;
+
+	// ClearType needs an opaque background
+	pBitmapTarget->SetTextAntialiasMode(D2D1_TEXT_ANTIALIAS_MODE_GRAYSCALE);
+	pBitmapTarget->BeginDraw();
+	pBitmapTarget->Clear(D2D1::ColorF(0, 0.f));
+
+	// Outline: the text moved around rings of the outline width, 2 pixels apart and
+	// a pixel between neighbours, so wide outlines don't show gaps
+	auto origin = D2D1::Point2F(-left, -top);
+	for (float radius = entry.style.outlineWidth; radius > 0; radius -= 2) {
+		int steps = std::max(8, (int)std::ceil(2 * std::numbers::pi_v<float> * radius));
+		for (int i = 0; i < steps; ++i) {
+			float angle = 2 * std::numbers::pi_v<float> * i / steps;
+			pBitmapTarget->DrawTextLayout(
+				D2D1::Point2F(origin.x + radius * std::cos(angle), origin.y + radius * std::sin(angle)),
+				pLayout.Get(),
+				pOutlineBrush.Get(),
+				D2D1_DRAW_TEXT_OPTIONS_NO_SNAP
+			);
+		}
+	}
+
+	pBitmapTarget->DrawTextLayout(origin, pLayout.Get(), pFillBrush.Get(), D2D1_DRAW_TEXT_OPTIONS_NO_SNAP);
+
+	hr = pBitmapTarget->EndDraw();
+	if (FAILED(hr)) return hr;
+
+	hr = pBitmapTarget->GetBitmap(entry.bitmap.GetAddressOf());
+	if (FAILED(hr)) return hr;
+
+	entry.offset = D2D1::Point2F(left, top);
+	return S_OK;
+}
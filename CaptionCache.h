@@ -0,0 +1,48 @@
+#pragma once
+
+#include "framework.h"
+#include <d2d1.h>
+#include <dwrite.h>
+#include <list>
+#include <wrl/client.h>
+
+using Microsoft::WRL::ComPtr;
+
+// How a caption looks. Colors are 0xRRGGBB.
+struct CaptionStyle {
+	std::wstring fontName;
+	float fontSize = 0;
+	UINT32 textColor = 0;
+	UINT32 outlineColor = 0;
+	float outlineWidth = 0;
+
+	bool operator==(const CaptionStyle& other) const = default;
+};
+
+// Outlined text, drawn once into a bitmap the size of its ink and then blitted every
+// frame with the fade's alpha, instead of laying out and drawing the text (and its
+// outline) again each frame. Bitmaps belong to the render target they were made for:
+// Clear when it is discarded.
+class CaptionCache {
+public:
+	// Draws `text` laid out by `format` in the box at (x, y) of w by h
+	HRESULT Draw(ID2D1RenderTarget* pTarget, IDWriteFactory* pDWriteFactory, IDWriteTextFormat* pFormat,
+		const std::wstring& text, const CaptionStyle& style, float alpha, float x, float y, float w, float h);
+	void Clear() { m_Entries.clear(); }
+
+private:
+	static constexpr size_t MaxEntries = 8;
+
+	struct Entry {
+		std::wstring text;
+		CaptionStyle style;
+		float width = 0;
+		float height = 0;
+		ComPtr<ID2D1Bitmap> bitmap;
+		D2D1_POINT_2F offset = {}; // Of the bitmap, from the top left of the layout box
+	};
+
+	static HRESULT Rasterize(ID2D1RenderTarget* pTarget, IDWriteFactory* pDWriteFactory, IDWriteTextFormat* pFormat, Entry& entry);
+
+	std::list<Entry> m_Entries; // Most recently drawn first
+};
@@ -0,0 +1,330 @@
+#include "DateParser.h"
+
+#include <limits>
+
+namespace {
+	// In order of preference, like the cascade of regular expressions this replaces
+	enum Pattern { IPhone, Dsc, WhatsApp, Screenshot, Iso, Embedded, UnixTimestamp, Canon, NumPatterns };
+
+	struct Fields {
+		int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+		long long timestamp = 0;
+	};
+
+	template <typename Char>
+	inline bool IsDigit(Char c) { return c >= '0' && c <= '9'; }
+
+	// Reads exactly `count` digits at s[i], or returns -1
+	template <typename Char>
+	int ReadNumber(std::basic_string_view<Char> s, size_t i, size_t count)
+	{
+		if (i + count > s.size()) {
+			return -1;
+		}
+
+		int value = 0;
+		for (size_t k = 0; k < count; ++k) {
+			Char c = s[i + k];
+			if (!IsDigit(c)) {
+				return -1;
+			}
+			value = value * 10 + (c - '0');
+		}
+		return value;
+	}
+
+	template <typename Char>
+	inline bool CharAt(std::basic_string_view<Char> s, size_t i, char c) { return i < s.size() && s[i] == (Char)c; }
+
+	inline bool EndOfNumber(std::wstring_view s, size_t i) { return i >= s.size() || !IsDigit(s[i]); }
+
+	// Matches lowercase ASCII `text` case-insensitively and moves i past it
+	bool MatchText(std::wstring_view s, size_t& i, const char* text)
+	{
+		size_t j = i;
+		for (; *text; ++text, ++j) {
+			if (j >= s.size()) {
+				return false;
+			}
+			wchar_t c = s[j];
+			if (c >= L'A' && c <= L'Z') {
+				c += L'a' - L'A';
+			}
+			if (c != (wchar_t)*text) {
+				return false;
+			}
+		}
+		i = j;
+		return true;
+	}
+
+	// YYYYMMDD
+	bool MatchDate(std::wstring_view s, size_t i, Fields& f)
+	{
+		f.year = ReadNumber(s, i, 4);
+		f.month = ReadNumber(s, i + 4, 2);
+		f.day = ReadNumber(s, i + 6, 2);
+		return f.year >= 0 && f.month >= 0 && f.day >= 0;
+	}
+
+	// YYYYMMDD<separator>HHMMSS, not followed by another digit
+	bool MatchDateTime(std::wstring_view s, size_t i, char separator, Fields& f)
+	{
+		if (!MatchDate(s, i, f) || !CharAt(s, i + 8, separator)) {
+			return false;
+		}
+		f.hour = ReadNumber(s, i + 9, 2);
+		f.minute = ReadNumber(s, i + 11, 2);
+		f.second = ReadNumber(s, i + 13, 2);
+		return f.hour >= 0 && f.minute >= 0 && f.second >= 0 && EndOfNumber(s, i + 15);
+	}
+
+	// Tries one pattern at s[i], which is not preceded by a digit. A pattern can match
+	// and still be rejected by its validation; `valid` tells which.
+	bool MatchAt(Pattern pattern, std::wstring_view s, size_t i, size_t digits, Fields& f, bool& valid)
+	{
+		valid = true;
+		switch (pattern) {
+		case IPhone:
+			return MatchText(s, i, "img_") && MatchDateTime(s, i, '_', f);
+
+		case Dsc:
+			return MatchText(s, i, "dsc_") && MatchDateTime(s, i, '_', f);
+
+		case WhatsApp:
+			// IMG-YYYYMMDD-WA followed by a number
+			if (!MatchText(s, i, "img-") || !MatchDate(s, i, f) || !CharAt(s, i + 8, '-')) {
+				return false;
+			}
+			i += 9;
+			return MatchText(s, i, "wa") && i < s.size() && IsDigit(s[i]);
+
+		case Screenshot:
+			return MatchText(s, i, "screenshot_") && MatchDateTime(s, i, '-', f);
+
+		case Iso:
+			// YYYY-MM-DD_HH-MM-SS
+			if (digits != 4 || !CharAt(s, i + 4, '-') || !CharAt(s, i + 7, '-') || !CharAt(s, i + 10, '_') ||
+				!CharAt(s, i + 13, '-') || !CharAt(s, i + 16, '-')) {
+				return false;
+			}
+			f.year = ReadNumber(s, i, 4);
+			f.month = ReadNumber(s, i + 5, 2);
+			f.day = ReadNumber(s, i + 8, 2);
+			f.hour = ReadNumber(s, i + 11, 2);
+			f.minute = ReadNumber(s, i + 14, 2);
+			f.second = ReadNumber(s, i + 17, 2);
+			return f.month >= 0 && f.day >= 0 && f.hour >= 0 && f.minute >= 0 && f.second >= 0 && EndOfNumber(s, i + 19);
+
+		case Embedded:
+			if (digits != 8) {
+				return false;
+			}
+			MatchDate(s, i, f);
+			valid = f.year >= 1990 && f.year <= 2030 &&
+				f.month >= 1 && f.month <= 12 &&
+				f.day >= 1 && f.day <= 31;
+			return true;
+
+		case UnixTimestamp:
+			if (digits < 10 || digits > 13) {
+				return false;
+			}
+			f.timestamp = 0;
+			for (size_t k = 0; k < digits; ++k) {
+				f.timestamp = f.timestamp * 10 + (s[i + k] - L'0');
+			}
+			// Between 1990 and 2050, and it has to fit a long, like std::stol demanded
+			valid = f.timestamp > 631152000 && f.timestamp < 2524608000 &&
+				f.timestamp <= std::numeric_limits<long>::max();
+			return true;
+
+		case Canon:
+			return MatchText(s, i, "img_") && ReadNumber(s, i, 4) >= 0 && EndOfNumber(s, i + 4);
+
+		default:
+			return false;
+		}
+	}
+}
+
+DateResult ExtractDateFromFilename(std::wstring_view name)
+{
+	// Ignore file extension
+	auto dotIdx = name.find_last_of(L'.');
+	if (dotIdx != std::wstring_view::npos) {
+		name = name.substr(0, dotIdx);
+	}
+
+	// Only the first occurrence of a pattern counts, even when its validation rejects it.
+	// Scanning stops as soon as nothing better than what was found can follow.
+	bool tried[NumPatterns] = {};
+	int best = NumPatterns;
+	Fields found;
+
+	for (size_t i = 0; i < name.size() && best > 0; ++i) {
+		if (i > 0 && IsDigit(name[i - 1])) {
+			continue;
+		}
+
+		size_t digits = 0;
+		while (i + digits < name.size() && IsDigit(name[i + digits])) {
+			++digits;
+		}
+
+		for (int k = 0; k < best; ++k) {
+			Fields f;
+			bool valid;
+			if (tried[k] || !MatchAt((Pattern)k, name, i, digits, f, valid)) {
+				continue;
+			}
+
+			tried[k] = true;
+			if (valid) {
+				best = k;
+				found = f;
+			}
+		}
+	}
+
+	DateResult result;
+	auto createTime = [&result](const Fields& f, bool withTime) {
+		result.success = true;
+		result.date.tm_year = f.year - 1900;
+		result.date.tm_mon = f.month - 1;
+		result.date.tm_mday = f.day;
+		if (withTime) {
+			result.date.tm_hour = f.hour;
+			result.date.tm_min = f.minute;
+			result.date.tm_sec = f.second;
+		}
+	};
+
+	switch (best) {
+	case IPhone:
+		createTime(found, true);
+		result.confidence = 0.9;
+		result.pattern = "iPhone";
+		result.explanation = "Matched iPhone pattern";
+		break;
+
+	case Dsc:
+		createTime(found, true);
+		result.confidence = 0.9;
+		result.pattern = "Digital Camera (DSC)";
+		result.explanation = "Matched Digital Camera (DSC) pattern";
+		break;
+
+	case WhatsApp:
+		createTime(found, false);
+		result.confidence = 0.85;
+		result.pattern = "WhatsApp";
+		result.explanation = "Matched WhatsApp pattern";
+		break;
+
+	case Screenshot:
+		createTime(found, true);
+		result.confidence = 0.9;
+		result.pattern = "Android Screenshot";
+		result.explanation = "Matched Android Screenshot pattern";
+		break;
+
+	case Iso:
+		createTime(found, true);
+		result.confidence = 0.95;
+		result.pattern = "ISO Format";
+		result.explanation = "Matched ISO Format pattern";
+		break;
+
+	case Embedded:
+		createTime(found, false);
+		result.confidence = 0.7;
+		result.pattern = "Embedded Date";
+		result.explanation = "Matched Embedded Date pattern";
+		break;
+
+	case UnixTimestamp: {
+		std::time_t time = static_cast<std::time_t>(found.timestamp);
+		result.date = *std::gmtime(&time);
+		result.success = true;
+		result.confidence = 0.6;
+		result.pattern = "UNIX Timestamp";
+		result.explanation = "Matched UNIX Timestamp pattern";
+		break;
+	}
+
+	case Canon:
+		// No date information available in this format
+		result.pattern = "Canon Sequential";
+		result.explanation = "Matched Canon Sequential pattern, but no date information available";
+		break;
+
+	default:
+		result.explanation = "No recognizable date pattern found in filename";
+		break;
+	}
+	return result;
+}
+
+bool ParseExifDate(std::string_view value, std::tm& date)
+{
+	std::tm parsed = {};
+	int year = ReadNumber(value, 0, 4);
+	if (year < 0) {
+		return false;
+	}
+
+	int month, day;
+	size_t i = 10;
+	if (CharAt(value, 4, '/')) {
+		// YYYY/MM/DD
+		month = ReadNumber(value, 5, 2);
+		day = ReadNumber(value, 8, 2);
+		if (!CharAt(value, 7, '/') || value.size() != 10) {
+			return false;
+		}
+	}
+	else {
+		// YYYY:MM:DD, with an optional time
+		auto isSeparator = [&value](size_t k) { return CharAt(value, k, ':') || CharAt(value, k, '-'); };
+		month = ReadNumber(value, 5, 2);
+		day = ReadNumber(value, 8, 2);
+		if (!isSeparator(4) || !isSeparator(7)) {
+			return false;
+		}
+
+		if (value.size() > i) {
+			if (CharAt(value, i, ' ') || CharAt(value, i, 'T')) {
+				++i;
+			}
+			parsed.tm_hour = ReadNumber(value, i, 2);
+			parsed.tm_min = ReadNumber(value, i + 3, 2);
+			if (parsed.tm_hour < 0 || !CharAt(value, i + 2, ':') || parsed.tm_min < 0) {
+				return false;
+			}
+
+			i += 5;
+			if (value.size() > i) {
+				parsed.tm_sec = ReadNumber(value, i + 1, 2);
+				if (!CharAt(value, i, ':') || parsed.tm_sec < 0) {
+					return false;
+				}
+				i += 3;
+			}
+		}
+
+		if (value.size() != i) {
+			return false;
+		}
+	}
+
+	if (month < 0 || day < 0) {
+		return false;
+	}
+
+	parsed.tm_year = year - 1900;
+	parsed.tm_mon = month - 1;
+	parsed.tm_mday = day;
+	date = parsed;
+	return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <ctime>
+#include <string_view>
+
+// Date parsing that doesn't depend on Windows, so it can be built and measured anywhere.
+// Both parsers scan their input once and allocate nothing.
+
+struct DateResult {
+	bool success = false;
+	std::tm date = {};
+	double confidence = 0;
+	const char* pattern = "";
+	const char* explanation = "";
+};
+
+// Finds a date in a file name (without folder), in order of preference:
+// iPhone (IMG_YYYYMMDD_HHMMSS), DSC_YYYYMMDD_HHMMSS, WhatsApp (IMG-YYYYMMDD-WA0001),
+// Screenshot_YYYYMMDD-HHMMSS, ISO (YYYY-MM-DD_HH-MM-SS), an embedded YYYYMMDD,
+// a UNIX timestamp and Canon's IMG_NNNN (which has no date, so never succeeds).
+// The first occurrence of each pattern counts and the extension is ignored.
+DateResult ExtractDateFromFilename(std::wstring_view name);
+
+// Parses an EXIF date: "YYYY:MM:DD HH:MM:SS", without seconds, without time, or "YYYY/MM/DD".
+// ':' and '-' are both accepted in the date, the separator before the time is ' ', 'T' or nothing.
+bool ParseExifDate(std::string_view value, std::tm& date);
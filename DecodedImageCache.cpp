@@ -0,0 +1,11 @@
+#include "DecodedImageCache.h"
+
+size_t DecodedImageKeyHash::operator()(const DecodedImageKey& key) const
+{
+	size_t h = std::hash<std::wstring>()(key.filePath);
+	auto combine = [&h](uint64_t value) { h ^= std::hash<uint64_t>()(value) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2); };
+	combine(key.lastWriteTime);
+	combine(((uint64_t)key.targetWidth << 32) | key.targetHeight);
+	combine((uint64_t)key.rotation);
+	return h;
+}
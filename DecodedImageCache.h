@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Identifies one decoded version of a photo. A changed file, a different
+// screen size or a new rotation needs a new decode.
+struct DecodedImageKey {
+	std::wstring filePath;
+	uint64_t lastWriteTime = 0;
+	uint32_t targetWidth = 0;
+	uint32_t targetHeight = 0;
+	int rotation = 0;
+
+	bool operator==(const DecodedImageKey& other) const = default;
+};
+
+struct DecodedImageKeyHash {
+	size_t operator()(const DecodedImageKey& key) const;
+};
+
+// Recently decoded photos, shared by all monitors, so going back to a photo that was
+// just on screen doesn't decode it again. The least recently used photos are dropped
+// when their sizes, as given to Insert, no longer fit in the byte budget.
+template<typename Image>
+class DecodedImageCache {
+public:
+	struct Stats {
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t evictions = 0;
+		size_t entries = 0;
+		size_t bytes = 0;
+	};
+
+	void SetBudget(size_t bytes);
+
+	// The cached image, or null. Counts as a hit, or as a miss when `countMiss` is set.
+	std::shared_ptr<Image> Find(const DecodedImageKey& key, bool countMiss = true);
+	void Insert(const DecodedImageKey& key, const std::shared_ptr<Image>& image, size_t bytes);
+	Stats GetStats();
+
+private:
+	struct Entry {
+		DecodedImageKey key;
+		std::shared_ptr<Image> image;
+		size_t bytes = 0;
+	};
+
+	void EvictToBudget();
+
+	std::mutex m_Mutex;
+	std::list<Entry> m_Entries; // Most recently used first
+	std::unordered_map<DecodedImageKey, typename std::list<Entry>::iterator, DecodedImageKeyHash> m_Index;
+	size_t m_Budget = 0;
+	Stats m_Stats;
+};
+
+template<typename Image>
+void DecodedImageCache<Image>::SetBudget(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Budget = bytes;
+	EvictToBudget();
+}
+
+template<typename Image>
+std::shared_ptr<Image> DecodedImageCache<Image>::Find(const DecodedImageKey& key, bool countMiss)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto it = m_Index.find(key);
+	if (it == m_Index.end()) {
+		if (countMiss) {
+			++m_Stats.misses;
+		}
+		return nullptr;
+	}
+
+	++m_Stats.hits;
+	m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+	return it->second->image;
+}
+
+template<typename Image>
+void DecodedImageCache<Image>::Insert(const DecodedImageKey& key, const std::shared_ptr<Image>& image, size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (bytes > m_Budget) {
+		return;
+	}
+
+	auto it = m_Index.find(key);
+	if (it != m_Index.end()) {
+		m_Stats.bytes -= it->second->bytes;
+		m_Entries.erase(it->second);
+		m_Index.erase(it);
+	}
+
+	m_Entries.push_front({ key, image, bytes });
+	m_Index[key] = m_Entries.begin();
+	m_Stats.bytes += bytes;
+	EvictToBudget();
+}
+
+template<typename Image>
+typename DecodedImageCache<Image>::Stats DecodedImageCache<Image>::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	Stats stats = m_Stats;
+	stats.entries = m_Entries.size();
+	return stats;
+}
+
+template<typename Image>
+void DecodedImageCache<Image>::EvictToBudget()
+{
+	while (m_Stats.bytes > m_Budget && !m_Entries.empty()) {
+		auto& oldest = m_Entries.back();
+		m_Stats.bytes -= oldest.bytes;
+		m_Index.erase(oldest.key);
+		m_Entries.pop_back();
+		++m_Stats.evictions;
+	}
+}
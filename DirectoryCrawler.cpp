@@ -0,0 +1,111 @@
+#include "DirectoryCrawler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace {
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<std::wstring> directories;
+	};
+}
+
+void DirectoryCrawler::Crawl(const std::vector<std::wstring>& roots, int numThreads, const Visitor& visit)
+{
+	numThreads = std::max(1, numThreads);
+	std::vector<WorkQueue> queues((size_t)numThreads);
+
+	// Directories that were queued but not visited yet, and those of them still in a queue
+	std::atomic<size_t> pending = roots.size();
+	std::atomic<size_t> queued = roots.size();
+	for (size_t i = 0; i < roots.size(); ++i) {
+		queues[i % queues.size()].directories.push_back(roots[i]);
+	}
+
+	// Idle workers wait here. Whoever queues directories or finishes the last one only
+	// takes the lock when someone is waiting: the waiter counts itself before it checks
+	// `queued` and `pending`, and the others change those before they check `idle`.
+	std::mutex idleMutex;
+	std::condition_variable wakeUp;
+	std::atomic<int> idle = 0;
+	auto wakeIdle = [&]() {
+		if (idle.load() > 0) {
+			{
+				std::lock_guard<std::mutex> lock(idleMutex);
+			}
+			wakeUp.notify_all();
+		}
+	};
+
+	auto popOwn = [&](int self, std::wstring& directory) {
+		auto& queue = queues[(size_t)self];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.directories.empty()) {
+			return false;
+		}
+		directory = std::move(queue.directories.back());
+		queue.directories.pop_back();
+		--queued;
+		return true;
+	};
+
+	auto steal = [&](int self, std::wstring& directory) {
+		for (int i = 1; i < numThreads; ++i) {
+			auto& queue = queues[(size_t)((self + i) % numThreads)];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (!queue.directories.empty()) {
+				directory = std::move(queue.directories.front());
+				queue.directories.pop_front();
+				--queued;
+				return true;
+			}
+		}
+		return false;
+	};
+
+	auto work = [&](int self) {
+		std::wstring directory;
+		std::vector<std::wstring> subdirectories;
+		while (pending.load() > 0) {
+			if (!popOwn(self, directory) && !steal(self, directory)) {
+				// Everything left is being listed by other workers, wait for them to find more
+				std::unique_lock<std::mutex> lock(idleMutex);
+				++idle;
+				wakeUp.wait(lock, [&] { return queued.load() > 0 || pending.load() == 0; });
+				--idle;
+				continue;
+			}
+
+			subdirectories.clear();
+			visit(directory, self, subdirectories);
+
+			// Count the children before finishing the parent, so pending never drops to zero early
+			if (!subdirectories.empty()) {
+				pending += subdirectories.size();
+				auto& queue = queues[(size_t)self];
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				for (auto& subdirectory : subdirectories) {
+					queue.directories.push_back(std::move(subdirectory));
+				}
+				queued += subdirectories.size();
+			}
+			if (--pending == 0 || !subdirectories.empty()) {
+				wakeIdle();
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < numThreads; ++i) {
+		threads.emplace_back(work, i);
+	}
+	work(0);
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
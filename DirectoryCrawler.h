@@ -0,0 +1,20 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Walks directory trees on a pool of threads. Every worker has its own queue of
+// directories to visit; it works depth-first from the back of its own queue and, when
+// that runs dry, steals the oldest (shallowest, so largest) directories from the front
+// of another worker's queue. On network shares, where every directory listing is a
+// round-trip, this keeps all threads busy until the whole tree is done. A worker that
+// finds nothing to do sleeps until another one queues more or the crawl is over.
+class DirectoryCrawler {
+public:
+	// Lists one directory on worker thread `worker` and fills in the subdirectories to visit next.
+	using Visitor = std::function<void(const std::wstring& directory, int worker, std::vector<std::wstring>& subdirectories)>;
+
+	// Visits every root and everything the visitor finds below it, and returns when all are done.
+	static void Crawl(const std::vector<std::wstring>& roots, int numThreads, const Visitor& visit);
+};
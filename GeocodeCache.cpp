@@ -0,0 +1,116 @@
+#include "GeocodeCache.h"
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+// One "latitude cell<TAB>longitude cell<TAB>location" per line
+bool GeocodeCache::Load(const std::filesystem::path& file)
+{
+	std::ifstream fin(file, std::ios::binary);
+	if (!fin) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	std::string line;
+	while (std::getline(fin, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+
+		auto tab1 = line.find('\t');
+		auto tab2 = tab1 == std::string::npos ? std::string::npos : line.find('\t', tab1 + 1);
+		if (tab2 == std::string::npos) {
+			continue;
+		}
+
+		try {
+			auto latCell = (int32_t)std::stol(line.substr(0, tab1));
+			auto lonCell = (int32_t)std::stol(line.substr(tab1 + 1, tab2 - tab1 - 1));
+			m_Locations[((uint64_t)(uint32_t)latCell << 32) | (uint32_t)lonCell] = line.substr(tab2 + 1);
+		}
+		catch (const std::exception&) {
+			// Skip damaged lines
+		}
+	}
+	m_Changed = false;
+	return true;
+}
+
+bool GeocodeCache::Save(const std::filesystem::path& file)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	std::cout << "Geocode cache: " << m_Hits << " hits, " << m_Waits << " shared requests, "
+		<< m_Fetches << " requests, " << m_Locations.size() << " cells" << std::endl;
+	if (!m_Changed) {
+		return true;
+	}
+
+	std::ofstream fout(file, std::ios::binary | std::ios::trunc);
+	if (!fout) {
+		return false;
+	}
+
+	for (const auto& [cell, location] : m_Locations) {
+		fout << (int32_t)(cell >> 32) << '\t' << (int32_t)(uint32_t)cell << '\t' << location << '\n';
+	}
+	m_Changed = !fout;
+	return (bool)fout;
+}
+
+std::string GeocodeCache::Lookup(double latitude, double longitude, const Fetch& fetch)
+{
+	auto cell = CellOf(latitude, longitude);
+	std::promise<std::string> promise;
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		auto found = m_Locations.find(cell);
+		if (found != m_Locations.end()) {
+			++m_Hits;
+			return found->second;
+		}
+
+		auto inFlight = m_InFlight.find(cell);
+		if (inFlight != m_InFlight.end()) {
+			++m_Waits;
+			auto result = inFlight->second;
+			lock.unlock();
+			return result.get();
+		}
+
+		++m_Fetches;
+		m_InFlight[cell] = promise.get_future().share();
+	}
+
+	std::string location;
+	try {
+		location = fetch(latitude, longitude);
+	}
+	catch (const std::exception& e) {
+		std::cerr << "Geocoding failed: " << e.what() << std::endl;
+	}
+
+	// Newlines would break the file
+	if (location.find_first_of("\r\n") != std::string::npos) {
+		location.clear();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!location.empty()) {
+			m_Locations[cell] = location;
+			m_Changed = true;
+		}
+		m_InFlight.erase(cell);
+	}
+	promise.set_value(location);
+	return location;
+}
+
+uint64_t GeocodeCache::CellOf(double latitude, double longitude)
+{
+	auto latCell = (int32_t)std::floor(latitude / CellSize);
+	auto lonCell = (int32_t)std::floor(longitude / CellSize);
+	return ((uint64_t)(uint32_t)latCell << 32) | (uint32_t)lonCell;
+}
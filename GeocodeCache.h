@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Remembers online reverse geocoding results per cell of CellSize degrees (about 500 m),
+// across sessions, so the photos of one holiday spot cost one request instead of one each.
+// Lookups of a cell that is already being fetched wait for that request instead of sending
+// their own. Failed lookups (an empty result) are not remembered.
+// Locations are UTF-8.
+class GeocodeCache {
+public:
+	static constexpr double CellSize = 0.005;
+
+	using Fetch = std::function<std::string(double latitude, double longitude)>;
+
+	bool Load(const std::filesystem::path& file);
+	// Only writes when something was added since Load.
+	bool Save(const std::filesystem::path& file);
+
+	// The location of the cell the coordinate is in, from the cache or from `fetch`.
+	std::string Lookup(double latitude, double longitude, const Fetch& fetch);
+
+private:
+	static uint64_t CellOf(double latitude, double longitude);
+
+	std::mutex m_Mutex;
+	std::unordered_map<uint64_t, std::string> m_Locations;
+	std::unordered_map<uint64_t, std::shared_future<std::string>> m_InFlight;
+	bool m_Changed = false;
+	size_t m_Hits = 0;
+	size_t m_Waits = 0;
+	size_t m_Fetches = 0;
+};
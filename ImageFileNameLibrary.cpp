@@ -1,13 +1,23 @@
 ﻿
 #include "ImageFileNameLibrary.h"
+#include "DateParser.h"
+#include "DirectoryCrawler.h"
+#include "GeocodeCache.h"
+#include "PathFilter.h"
+#include "PhotoIndex.h"
+#include "ReverseGeocoder.h"
 #include "SettingsDialog.h"
+#include "TaskPool.h"
 
 #define WIN32_LEAN_AND_MEAN
 #include "nlohmann/json.hpp"
 
 #include <exiv2.hpp>
 #include <cwctype>
+#include <memory>
+#include <mutex>
 #include <random>
+#include <unordered_set>
 //#include <exiv2/exiv2.hpp>
 //#include <iostream>
 //#include <iomanip>
@@ -23,41 +33,261 @@
 //#pragma comment(lib, "libcurl.lib") 
 //#pragma comment(lib, "wldap32.lib") 
 
-struct DateResult {
-	bool success = false;
-	std::tm date = {};
-	double confidence = 0;
-	std::string pattern;
-	std::string explanation;
-};
+std::string DescribeLocation(const std::wstring& serviceUrl, double lat, double lon);
+static const ReverseGeocoder& GetOfflineGeocoder(const std::wstring& placesFile);
+static GeocodeCache& GetGeocodeCache();
+static std::wstring NormalizePath(const std::filesystem::path& path);
 
-DateResult ExtractDateFromFilename(std::wstring filename);
-std::wstring DescribeLocation(const std::wstring& filePath);
+std::wstring Utf8ToWString(const std::string& str);
 
-std::wstring FormatDate(std::tm tm, const std::wstring& format = L"dd-mm-yyyy") {
-	std::time_t time = std::mktime(&tm);
-	struct std::tm* timeInfo = std::localtime(&time);
-	std::wstringstream ss;
+std::wstring ImageInfo::GetLocation() const
+{
+	return Utf8ToWString(Catalog().GetLocation(location));
+}
+
+void ImageFileNameLibrary::SetPaths(const std::vector<std::wstring>& include, const std::vector<std::wstring>& exclude, int numThreads)
+{
+	StopScan();
+
+	m_ScanStart = std::chrono::steady_clock::now();
+	m_StopScan = false;
+	m_Scanning = true;
+	m_Scanner = std::thread([this, include, exclude, numThreads]() {
+		ScanPaths(include, exclude, numThreads);
+		m_Scanning = false;
+	});
+}
+
+void ImageFileNameLibrary::StopScan()
+{
+	m_StopScan = true;
+	if (m_Scanner.joinable()) {
+		m_Scanner.join();
+	}
+}
+
+void ImageFileNameLibrary::ScanPaths(const std::vector<std::wstring>& include, const std::vector<std::wstring>& exclude, int numThreads)
+{
+	// Reconcile the index of the previous session against the file system
+	ImageFolderMap cache;
+	PlaylistState playlist;
+	m_IndexFile = GetAppDataFilePath(L"index.bin", true);
+	if (m_IndexFile.empty() || !PhotoIndex::Load(m_IndexFile, cache, playlist)) {
+		playlist.seed = ((UINT64)m_Random() << 32) | m_Random();
+	}
+
+	{
+		// The photos of the index keep their numbers, so the order is the same as last time.
+		// Until their folders are scanned, they are holes that GotoImage skips.
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Order.SetSeed(playlist.seed);
+		m_ImageList.assign(playlist.count, nullptr);
+		m_Skipped.assign(playlist.count, false);
+		m_Start = playlist.position;
+		m_Shown = -1;
+		m_IndexCount = playlist.count;
+	}
+
+	// Plain absolute folders are made canonical, so "C:\\Photos\\..\\Receipts\\" excludes C:\\Receipts
+	std::vector<std::wstring> patterns;
+	for (const auto& path : exclude) {
+		bool isPlainPath = PathFilter::IsAbsolute(path) && !PathFilter::HasWildcards(path);
+		patterns.push_back(isPlainPath ? NormalizePath(path) : path);
+	}
+	PathFilter filter;
+	filter.SetPatterns(patterns);
+
+	// Every crawler thread collects into its own result, merged when the crawl is done
+	numThreads = std::max(1, numThreads);
+	std::vector<ImageFolderMap> results((size_t)numThreads);
+
+	std::mutex visitedMutex;
+	std::unordered_set<std::wstring> visited;
+
+	DirectoryCrawler::Crawl(include, numThreads, [&](const std::wstring& directory, int worker, std::vector<std::wstring>& subdirectories) {
+		if (m_StopScan) {
+			return;
+		}
+
+		{
+			// Include paths can overlap
+			std::lock_guard<std::mutex> lock(visitedMutex);
+			if (!visited.insert(directory).second) {
+				return;
+			}
+		}
+
+		// Publish every directory right away, so the slideshow can start before the scan is done
+		ImageFolder folder;
+		std::vector<ImageInfo*> images;
+		if (ScanDirectory(directory, filter, cache, folder, images, subdirectories)) {
+			results[(size_t)worker].emplace(directory, std::move(folder));
+			AddImages(images);
+		}
+	});
+
+	for (auto& result : results) {
+		m_Folders.merge(result);
+	}
+
+	if (m_StopScan) {
+		// Keep what the index knew about the directories we did not get to
+		m_Folders.merge(cache);
+		return;
+	}
+
+	// Whatever is left in the cache has been deleted or excluded
+	for (auto& [path, folder] : cache) {
+		for (auto* info : folder.images) {
+			ImageInfo::Destroy(info);
+		}
+	}
+	m_ScanComplete = true;
+
+	auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_ScanStart).count();
+	std::wcout << L"Scanned " << m_Folders.size() << L" folders in " << ms << L" ms" << std::endl;
+}
+
+void ImageFileNameLibrary::AddImages(const std::vector<ImageInfo*>& images)
+{
+	if (images.empty()) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (m_NumImages == 0) {
+		auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_ScanStart).count();
+		std::wcout << L"First photos found after " << ms << L" ms" << std::endl;
+	}
+
+	for (auto* info : images) {
+		// Back in its place from the index, or a new number at the end
+		if (info->idx < 0 || info->idx >= (int)m_ImageList.size() || m_ImageList[(size_t)info->idx]) {
+			info->idx = (int)m_ImageList.size();
+			m_ImageList.push_back(nullptr);
+			m_Skipped.push_back(false);
+		}
+		m_ImageList[(size_t)info->idx] = info;
+		m_Skipped[(size_t)info->idx] = info->IsUndecodable();
+		++m_NumImages;
+
+		if (m_LoveVotes.empty() && m_DownVotes.empty()) {
+			continue;
+		}
+
+		auto path = info->GetFilePath();
+		if (m_DownVotes.erase(path)) {
+			m_Skipped[(size_t)info->idx] = true;
+		}
+
+		auto loved = m_LoveVotes.find(path);
+		if (loved != m_LoveVotes.end()) {
+			m_Loved.push_back(info);
+			m_LoveWeights.push_back(loved->second);
+			m_LoveVotes.erase(loved);
+			m_LovedChanged = true;
+		}
+	}
+}
+
+void ImageFileNameLibrary::SetVotes(std::unordered_map<std::wstring, UINT32> loveVotes, std::unordered_set<std::wstring> downVotes, int lovedEvery)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_LoveVotes = std::move(loveVotes);
+	m_DownVotes = std::move(downVotes);
+	// With 1 there would be nothing but loved photos, and nothing at all without them
+	m_LovedEvery = lovedEvery <= 0 ? 0 : std::max(2, lovedEvery);
+}
+
+void ImageFileNameLibrary::AddLoveVote(ImageInfo* info)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto it = std::find(m_Loved.begin(), m_Loved.end(), info);
+	if (it != m_Loved.end()) {
+		m_LoveWeights[(size_t)(it - m_Loved.begin())] += 1;
+	}
+	else {
+		m_Loved.push_back(info);
+		m_LoveWeights.push_back(1);
+	}
+	m_LovedChanged = true;
+}
 
-	if (format == L"dd-mm-yyyy") {
-		ss << std::setw(2) << std::setfill(L'0') << timeInfo->tm_mday << L"-"
-			<< std::setw(2) << std::setfill(L'0') << (timeInfo->tm_mon + 1) << L"-"
-			<< (timeInfo->tm_year + 1900);
+void ImageFileNameLibrary::Skip(ImageInfo* info)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (info->idx >= 0 && info->idx < (int)m_Skipped.size() && m_ImageList[(size_t)info->idx] == info) {
+		m_Skipped[(size_t)info->idx] = true;
 	}
-	return ss.str();
 }
 
-void ImageFileNameLibrary::SetPaths(const std::vector<std::wstring>& include, const std::vector<std::wstring>& exclude)
+bool ImageFileNameLibrary::IsLovedSlot(INT64 slot) const
+{
+	// The last of every LovedEvery slots
+	return m_LovedEvery > 0 && ((slot % m_LovedEvery) + m_LovedEvery) % m_LovedEvery == m_LovedEvery - 1;
+}
+
+INT64 ImageFileNameLibrary::ToPosition(INT64 slot) const
+{
+	if (m_LovedEvery <= 0) {
+		return m_Start + slot;
+	}
+
+	// Loved slots don't use up a playlist position
+	auto lovedBefore = slot >= 0 ? slot / m_LovedEvery : -((m_LovedEvery - 1 - slot) / m_LovedEvery);
+	return m_Start + slot - lovedBefore;
+}
+
+ImageInfo* ImageFileNameLibrary::DrawLoved(INT64 slot)
 {
-	for (const auto& dir : include) {
-		LoadImages(dir, exclude);
+	if (m_Loved.empty()) {
+		return nullptr;
+	}
+
+	// After a vote or a newly found loved photo. Linear in the number of loved photos only.
+	if (m_LovedChanged) {
+		m_LovedTable.Build(m_LoveWeights);
+		m_LovedChanged = false;
+	}
+
+	// The same slot draws the same photo, so going back shows what was there
+	auto* info = m_Loved[m_LovedTable.Draw(m_Order.Random(m_Start + slot))];
+	return m_Skipped[(size_t)info->idx] ? nullptr : info;
+}
+
+void ImageFileNameLibrary::MarkShown(int imageIndex, int monitorIndex, int numMonitors)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Shown = std::max(m_Shown, (INT64)imageIndex * numMonitors + monitorIndex);
+}
+
+void ImageFileNameLibrary::SaveIndex() const
+{
+	if (!m_IndexFile.empty()) {
+		// Continue after the furthest photo any monitor got to
+		PlaylistState playlist;
+		playlist.seed = m_Order.GetSeed();
+		playlist.count = m_IndexCount;
+		if (!m_ImageList.empty()) {
+			auto n = (INT64)m_ImageList.size();
+			playlist.position = (UINT32)((ToPosition(m_Shown + 1) % n + n) % n);
+		}
+		PhotoIndex::Save(m_IndexFile, m_Folders, playlist, m_ScanComplete);
+	}
+
+	auto geocodeFile = GetAppDataFilePath(L"locations.txt", true);
+	if (!geocodeFile.empty()) {
+		GetGeocodeCache().Save(geocodeFile);
 	}
-	ShuffleImages();
 }
 
 static std::wstring NormalizePath(const std::filesystem::path& path) {
 	// Convert to weakly_canonical absolute path
-	std::wstring canonical = std::filesystem::weakly_canonical(path).wstring();
+	std::error_code ec;
+	std::wstring canonical = std::filesystem::weakly_canonical(path, ec).wstring();
+	if (ec) {
+		canonical = path.wstring();
+	}
 
 	// Convert to lowercase for case-insensitive comparison
 	std::transform(canonical.begin(), canonical.end(), canonical.begin(),
@@ -82,73 +312,100 @@ std::wstring Utf8ToWString(const std::string& str) {
 	return wstr;
 }
 
-int GetExifRotation(const std::wstring& imagePath) {
+static bool ReadGpsCoordinate(const Exiv2::ExifData& exifData, const char* key, const char* refKey, double& decimal) {
+	auto degrees = exifData.findKey(Exiv2::ExifKey(key));
+	auto ref = exifData.findKey(Exiv2::ExifKey(refKey));
+	if (degrees == exifData.end() || ref == exifData.end() || degrees->count() != 3) return false;
+
+	double parts[3];
+	for (size_t i = 0; i < 3; ++i) {
+		auto r = degrees->toRational(i);
+		if (r.second == 0) return false;
+		parts[i] = static_cast<double>(r.first) / r.second;
+	}
+	decimal = parts[0] + parts[1] / 60.0 + parts[2] / 3600.0;
+
+	std::string direction = ref->toString();
+	if (direction == "S" || direction == "W")
+		decimal *= -1;
+
+	return true;
+}
+
+ImageMetadata ReadImageMetadata(const std::wstring& imagePath) {
+	ImageMetadata metadata;
+	metadata.isRead = true;
 	try {
 		auto image = Exiv2::ImageFactory::open(WStringToUtf8(imagePath));
-		if (!image) return 0;
+		if (!image) return metadata;
 
+		// Only Exif is needed, so JPEGs stop reading after the Exif segment and the frame header
+		image->setReadFilter(Exiv2::mdExif);
 		image->readMetadata();
-		auto& exifData = image->exifData();
+		metadata.width = image->pixelWidth();
+		metadata.height = image->pixelHeight();
+
+		const Exiv2::ExifData& exifData = image->exifData();
+		if (exifData.empty()) {
+			std::wcerr << L"No EXIF data found" << std::endl;
+			return metadata;
+		}
+
 		auto it = exifData.findKey(Exiv2::ExifKey("Exif.Image.Orientation"));
-		if (it == exifData.end()) return 0;
-
-		int orientation = it->toUint32();
-		switch (orientation) {
-		case 3: return 180;
-		case 6: return 90;
-		case 8: return 270;
-		default: return 0;
+		if (it != exifData.end()) {
+			metadata.orientation = (UINT16)it->toUint32();
 		}
+
+		std::tm date = {};
+		it = exifData.findKey(Exiv2::ExifKey("Exif.Photo.DateTimeOriginal"));
+		if (it != exifData.end() && ParseExifDate(it->value().toString(), date)) {
+			metadata.hasDate = true;
+			metadata.year = (UINT16)(date.tm_year + 1900);
+			metadata.month = (UINT8)(date.tm_mon + 1);
+			metadata.day = (UINT8)date.tm_mday;
+			metadata.hour = (UINT8)date.tm_hour;
+			metadata.minute = (UINT8)date.tm_min;
+			metadata.second = (UINT8)date.tm_sec;
+		}
+
+		metadata.hasLocation =
+			ReadGpsCoordinate(exifData, "Exif.GPSInfo.GPSLatitude", "Exif.GPSInfo.GPSLatitudeRef", metadata.latitude) &&
+			ReadGpsCoordinate(exifData, "Exif.GPSInfo.GPSLongitude", "Exif.GPSInfo.GPSLongitudeRef", metadata.longitude);
 	}
 	catch (const Exiv2::Error& e) {
-		std::wcerr << L"Error reading EXIF rotation for \"" << imagePath << "\": " << e.what() << std::endl;
-		return 0;
+		std::wcerr << L"Error reading EXIF data for \"" << imagePath << "\": " << e.what() << std::endl;
 	}
+	return metadata;
 }
 
-
-DateResult ExtractDateTaken(const std::wstring& imagePath) {
-	DateResult result;
+std::vector<BYTE> ReadEmbeddedPreview(const std::wstring& imagePath, UINT minWidth, UINT minHeight) {
 	try {
-		auto fn = WStringToUtf8(imagePath);
-		auto image = Exiv2::ImageFactory::open(fn);
-		image->readMetadata();
+		auto image = Exiv2::ImageFactory::open(WStringToUtf8(imagePath));
+		if (!image) return {};
 
-		Exiv2::ExifData& exifData = image->exifData();
-		if (exifData.empty()) {
-			std::wcerr << L"No EXIF data found" << std::endl;
-			return result;
-		}
+		// Camera JPEGs keep their previews in the Exif data, raw formats list them natively
+		image->setReadFilter(Exiv2::mdExif);
+		image->readMetadata();
+		double aspect = image->pixelHeight() > 0 ? (double)image->pixelWidth() / image->pixelHeight() : 0;
+		if (aspect <= 0) return {};
 
-		auto dateTimeTag = exifData.findKey(Exiv2::ExifKey("Exif.Photo.DateTimeOriginal"));
-		if (dateTimeTag == exifData.end()) return {};
+		// Sorted from small to large
+		Exiv2::PreviewManager previews(*image);
+		for (const auto& properties : previews.getPreviewProperties()) {
+			if (properties.width_ < minWidth || properties.height_ < minHeight) continue;
 
-		auto value = Utf8ToWString(dateTimeTag->value().toString());
-		std::wsmatch m;
-		std::wregex patterns[] = {
-			std::wregex(L"(\\d{4})[:-](\\d{2})[:-](\\d{2})[ T]?(\\d{2}):(\\d{2}):(\\d{2})"),
-			std::wregex(L"(\\d{4})[:-](\\d{2})[:-](\\d{2})[ T]?(\\d{2}):(\\d{2})"),
-			std::wregex(L"(\\d{4})[:-](\\d{2})[:-](\\d{2})"),
-			std::wregex(L"(\\d{4})/(\\d{2})/(\\d{2})")
-		};
+			// Letterboxed or cropped previews would jump when the photo replaces them
+			double previewAspect = (double)properties.width_ / properties.height_;
+			if (std::abs(previewAspect / aspect - 1) > 0.01) continue;
 
-		for (auto& re : patterns) {
-			if (std::regex_match(value, m, re)) {
-				result.success = true;
-				result.date.tm_year = std::stoi(m[1]) - 1900;
-				result.date.tm_mon = std::stoi(m[2]) - 1;
-				result.date.tm_mday = std::stoi(m[3]);
-				if (m.size() > 4) result.date.tm_hour = std::stoi(m[4]);
-				if (m.size() > 5) result.date.tm_min = std::stoi(m[5]);
-				if (m.size() > 6) result.date.tm_sec = std::stoi(m[6]);
-				break;
-			}
+			auto preview = previews.getPreviewImage(properties);
+			return std::vector<BYTE>(preview.pData(), preview.pData() + preview.size());
 		}
 	}
 	catch (const Exiv2::Error& e) {
-		std::wcerr << L"Error reading EXIF data for \"" << imagePath << "\": " << e.what() << std::endl;
+		std::wcerr << L"Error reading the embedded preview of \"" << imagePath << "\": " << e.what() << std::endl;
 	}
-	return result;
+	return {};
 }
 
 DateResult GetFileCreationDate(const std::wstring& filePath) {
@@ -186,313 +443,331 @@ DateResult GetFileCreationDate(const std::wstring& filePath) {
 	return result;
 }
 
-void ImageInfo::CacheInfo(SettingsDialog& sets)
+void ImageInfo::CacheInfo(SettingsDialog& sets, TaskPool& tasks, std::mutex& infoMutex)
 {
-	if (sets.ShowDate && dateTaken.empty()) {
-		// Extract date taken from EXIF, or use filename or file creation date
-		auto dateInfo = ExtractDateTaken(filePath);
+	// The file is read without holding infoMutex, the fields are only looked at and written
+	// while holding it
+	std::error_code sizeError, timeError;
+	auto filePath = GetFilePath();
+	auto size = (UINT64)std::filesystem::file_size(filePath, sizeError);
+	auto time = (UINT64)std::filesystem::last_write_time(filePath, timeError).time_since_epoch().count();
+
+	bool wantsLocation, wantsDate, wantsRotation, wantsSize;
+	ImageMetadata known;
+	{
+		std::lock_guard<std::mutex> lock(infoMutex);
+		if (!sizeError && !timeError) {
+			ValidateCachedInfo(size, time);
+		}
+		wantsLocation = sets.ShowLocation && location == PhotoCatalog::UnknownLocation && !isCaching;
+		wantsDate = sets.ShowDate && date == UnknownDate;
+		wantsRotation = rotation < 0;
+		wantsSize = width == 0 || height == 0;
+		known = metadata;
+	}
+
+	bool isRead = false;
+	if (!known.isRead && (wantsDate || wantsRotation || wantsLocation)) {
+		// Open the file once for everything below
+		known = ReadImageMetadata(filePath);
+		isRead = true;
+	}
+
+	UINT32 foundDate = UnknownDate;
+	if (wantsDate) {
+		// Take the date from EXIF, or use filename or file creation date
+		DateResult dateInfo;
+		dateInfo.success = known.GetDate(dateInfo.date);
 		if (!dateInfo.success) {
 			// If no DateTaken in EXIF, use the date from the filename or file creation date
-			std::filesystem::path fileName = std::filesystem::path(filePath).filename();
-			// You could parse the filename for date if the file follows a date-based naming convention
-			dateInfo = ExtractDateFromFilename(fileName.stem().wstring());
+			auto fileName = Catalog().GetName(name);
+			dateInfo = ExtractDateFromFilename(std::wstring_view(fileName).substr(0, fileName.find_last_of(L'.')));
 			if (!dateInfo.success) {
 				dateInfo = GetFileCreationDate(filePath);
 			}
 		}
-		if (dateInfo.success) {
-			dateTaken = FormatDate(dateInfo.date);
-		}
-		else
-		{
-			dateTaken = L" ";
-		}
+		foundDate = dateInfo.success ? PackDate(dateInfo.date) : NoDate;
 	}
 
-	if (rotation < 0)
+	UINT32 foundLocation = PhotoCatalog::UnknownLocation;
+	bool wantsLookup = false;
+	if (wantsLocation && !known.hasLocation)
+	{
+		// Nothing to look up
+		foundLocation = PhotoCatalog::NoLocation;
+	}
+	else if (wantsLocation && !GetOfflineGeocoder(sets.PlacesFile).IsEmpty())
+	{
+		// Answers in about a microsecond, no need for a thread
+		foundLocation = Catalog().AddLocation(GetOfflineGeocoder(sets.PlacesFile).Describe(known.latitude, known.longitude));
+	}
+	else if (wantsLocation)
 	{
-		rotation = GetExifRotation(filePath);
+		wantsLookup = true;
+	}
+
+	std::lock_guard<std::mutex> lock(infoMutex);
+	// RotateImage90 may have been here in the meantime, what it wrote stays
+	if (isRead && !metadata.isRead) {
+		metadata = known;
+	}
+	if (wantsDate && date == UnknownDate) {
+		date = foundDate;
+	}
+	if (wantsRotation && rotation < 0) {
+		rotation = known.GetRotation();
+	}
+	if (wantsSize && (width == 0 || height == 0)) {
+		width = known.width;
+		height = known.height;
+	}
+	if (foundLocation != PhotoCatalog::UnknownLocation && location == PhotoCatalog::UnknownLocation) {
+		location = foundLocation;
 	}
 
-	if (sets.ShowLocation && location.empty() && !isCaching)
+	if (wantsLookup && !isCaching)
 	{
 		isCaching = true;
-		std::thread httpThread([this]()
+		double lat = known.latitude;
+		double lon = known.longitude;
+		std::wstring serviceUrl = sets.GeocodeUrl;
+		tasks.Submit(this, TaskPool::Background,
+			[this, lat, lon, serviceUrl]() -> TaskPool::Result
 			{
-				location = DescribeLocation(filePath);
-				if (location.empty())
-				{
-					location = L" ";
-				}
+				// Nearby photos share one request
+				auto place = GetGeocodeCache().Lookup(lat, lon, [&serviceUrl](double cellLat, double cellLon) {
+					return DescribeLocation(serviceUrl, cellLat, cellLon);
+				});
+				// A failed lookup stays unknown, so it is tried again, also next session.
+				// NoLocation is only for photos without coordinates.
+				auto found = place.empty() ? PhotoCatalog::UnknownLocation : Catalog().AddLocation(place);
+				return [this, found]()
+					{
+						location = found;
+						isCaching = false;
+					};
+			},
+			[this]()
+			{
+				// Looked up again when the photo comes by next time
 				isCaching = false;
 			});
-		httpThread.detach();
 	}
 }
 
 std::wstring ImageInfo::GetCaption(SettingsDialog& sets)
 {
 	std::wstring caption;
-	if (sets.ShowFolder && folderName.length() > 1)
+	auto folderName = sets.ShowFolder ? GetFolderName() : std::wstring();
+	if (folderName.length() > 1)
 	{
 		if (!caption.empty()) { caption += L" "; }
 		caption += L" " + folderName;
 	}
-	if (sets.ShowDate && dateTaken.length() > 1)
+	auto dateTaken = sets.ShowDate ? GetDate() : std::wstring();
+	if (!dateTaken.empty())
 	{
 		if (!caption.empty()) { caption += L" "; }
 		caption += L" " + dateTaken;
 	}
-	if (sets.ShowLocation && !isCaching && location.length() > 1)
+	auto locationName = sets.ShowLocation && !isCaching ? GetLocation() : std::wstring();
+	if (!locationName.empty())
 	{
 		if (!caption.empty()) { caption += L"\n"; }
-		caption += L" " + location;
+		caption += L" " + locationName;
 	}
 	return caption;
 }
 
-void ImageFileNameLibrary::LoadImages(const std::wstring& directory, const std::vector<std::wstring>& exclude) {
-	for (const auto& entry : std::filesystem::directory_iterator(directory)) {
-		std::wstring path = entry.path().wstring();
+static bool IsImageFile(const std::filesystem::path& path) {
+	auto ext = path.extension().wstring();
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::towlower);
 
-		// Skip if path is in exclude list
-		if (std::find(exclude.begin(), exclude.end(), path) != exclude.end()) {
-			continue;
-		}
+	// Check for supported image formats
+	return ext == L".jpg" || ext == L".jpeg" || ext == L".png" || ext == L".heic";
+}
 
-		if (entry.is_regular_file()) {
-			auto ext = entry.path().extension().wstring();
-			std::transform(ext.begin(), ext.end(), ext.begin(), ::towlower);
+bool ImageFileNameLibrary::ScanDirectory(const std::wstring& directory, const PathFilter& exclude, ImageFolderMap& cache, ImageFolder& folder, std::vector<ImageInfo*>& images, std::vector<std::wstring>& subdirectoriesToVisit) {
+	// Only an include path can be excluded here, below it excluded folders are never visited
+	auto position = exclude.Walk(directory);
+	if (position.excluded) {
+		return false;
+	}
+
+	std::error_code ec;
+	auto lastWriteTime = (UINT64)std::filesystem::last_write_time(directory, ec).time_since_epoch().count();
+	if (ec) {
+		std::wcerr << L"Error reading directory \"" << directory << L"\": " << ec.message().c_str() << std::endl;
+		return false;
+	}
+
+	auto isExcluded = [&exclude, &position](std::wstring_view path) {
+		return exclude.IsExcluded(position, path.substr(path.find_last_of(L"\\/") + 1));
+	};
 
-			// Check for supported image formats
-			if (ext == L".jpg" || ext == L".jpeg" || ext == L".png" || ext == L".heic") {
-				ImageInfo* info = new ImageInfo();
+	folder.lastWriteTime = lastWriteTime;
+	auto& catalog = ImageInfo::Catalog();
 
-				// Get the folder name
-				info->filePath = path;
-				info->folderName = entry.path().parent_path().filename().wstring();
+	// Every directory is scanned by one thread only, so taking its entry is safe
+	ImageFolder previous;
+	auto cached = cache.find(directory);
+	if (cached != cache.end()) {
+		previous = std::move(cached->second);
+		cached->second.images.clear();
+	}
 
-				// Add to image list
-				m_ImageList.push_back(info);
+	auto keepPrevious = [&] {
+		for (auto* info : previous.images) {
+			if (!exclude.IsEmpty() && isExcluded(catalog.GetName(info->name))) {
+				ImageInfo::Destroy(info);
+				continue;
 			}
+			folder.images.push_back(info);
+			images.push_back(info);
 		}
-		else if (entry.is_directory())
-		{
-			LoadImages(entry.path(), exclude);
+
+		folder.subdirectories = std::move(previous.subdirectories);
+		for (const auto& subdir : folder.subdirectories) {
+			if (!isExcluded(subdir)) {
+				subdirectoriesToVisit.push_back(subdir);
+			}
 		}
+	};
+
+	if (previous.lastWriteTime == lastWriteTime) {
+		// No entries were added, removed or renamed since the index was written, so
+		// skip the enumeration. Changed file contents are caught by ValidateCachedInfo.
+		keepPrevious();
+		return true;
 	}
-}
 
-void ImageFileNameLibrary::ShuffleImages() {
-	std::random_device rd;
-	std::mt19937 g(rd());
-	std::shuffle(m_ImageList.begin(), m_ImageList.end(), g);
-	for (int i = 0; i < (int)m_ImageList.size(); i++)
-	{
-		m_ImageList[i]->idx = i;
+	std::error_code listError;
+	std::filesystem::directory_iterator entries(directory, listError);
+	if (listError) {
+		// Often a network share that is briefly away: keep what the index knew, and list it
+		// again next time instead of remembering it as empty
+		std::wcerr << L"Error listing directory \"" << directory << L"\": " << listError.message().c_str() << std::endl;
+		keepPrevious();
+		folder.lastWriteTime = 0;
+		return true;
 	}
-}
 
-ImageInfo* ImageFileNameLibrary::GotoImage(int imageIndex, int monitorIndex, int numMonitors) {
-	if (m_ImageList.empty())
-	{
-		return NULL;
+	// By file name, the folder is the same
+	std::unordered_map<std::wstring, ImageInfo*> known;
+	for (auto* info : previous.images) {
+		known[catalog.GetName(info->name)] = info;
 	}
+	auto folderId = catalog.AddFolder(directory);
 
-	auto n = (int)m_ImageList.size();
-	auto offset = (monitorIndex * n) / numMonitors;
-	imageIndex = (offset + imageIndex + n) % n;
-	auto img = m_ImageList[(size_t)imageIndex];
-	return img;
-}
+	try {
+		std::error_code entryError;
+		for (const auto& entry : entries) {
+			std::wstring path = entry.path().wstring();
 
-DateResult ExtractDateFromFilename(std::wstring nameOnly)
-{
-	// Ignore file extension
-	auto dotIdx = nameOnly.find_last_of('.');
-	if (dotIdx != std::string::npos) {
-		nameOnly = nameOnly.substr(0, dotIdx);
-	}
+			if (entry.is_directory(entryError)) {
+				// Remember excluded directories too, so removing an exclusion is noticed
+				folder.subdirectories.push_back(path);
+			}
 
-	DateResult result;
+			// Skip if path is in exclude list
+			if (isExcluded(path)) {
+				continue;
+			}
 
-	// Helper function to create a time_t from components
-	auto createTime = [&result](int year, int month, int day, int hour = 0, int min = 0, int sec = 0) -> void {
-		result.success = true;
-		result.date.tm_year = year - 1900;
-		result.date.tm_mon = month - 1;
-		result.date.tm_mday = day;
-		result.date.tm_hour = hour;
-		result.date.tm_min = min;
-		result.date.tm_sec = sec;
-		};
-
-	// iPhone format: IMG_YYYYMMDD_HHMMSS
-	std::wregex iPhoneRegex(L"(?:^|[^\\d])IMG_(\\d{4})(\\d{2})(\\d{2})_(\\d{2})(\\d{2})(\\d{2})(?:[^\\d]|$)", std::regex_constants::icase);
-	std::wsmatch iPhoneMatches;
-	if (std::regex_search(nameOnly, iPhoneMatches, iPhoneRegex)) {
-		int year = std::stoi(iPhoneMatches[1]);
-		int month = std::stoi(iPhoneMatches[2]);
-		int day = std::stoi(iPhoneMatches[3]);
-		int hour = std::stoi(iPhoneMatches[4]);
-		int minute = std::stoi(iPhoneMatches[5]);
-		int second = std::stoi(iPhoneMatches[6]);
-
-		createTime(year, month, day, hour, minute, second);
-		result.confidence = 0.9;
-		result.pattern = "iPhone";
-		result.explanation = "Matched iPhone pattern";
-		return result;
-	}
-
-	// Digital camera format: DSC_YYYYMMDD_HHMMSS
-	std::wregex dscRegex(L"(?:^|[^\\d])DSC_(\\d{4})(\\d{2})(\\d{2})_(\\d{2})(\\d{2})(\\d{2})(?:[^\\d]|$)", std::regex_constants::icase);
-	std::wsmatch dscMatches;
-	if (std::regex_search(nameOnly, dscMatches, dscRegex)) {
-		int year = std::stoi(dscMatches[1]);
-		int month = std::stoi(dscMatches[2]);
-		int day = std::stoi(dscMatches[3]);
-		int hour = std::stoi(dscMatches[4]);
-		int minute = std::stoi(dscMatches[5]);
-		int second = std::stoi(dscMatches[6]);
-
-		createTime(year, month, day, hour, minute, second);
-		result.confidence = 0.9;
-		result.pattern = "Digital Camera (DSC)";
-		result.explanation = "Matched Digital Camera (DSC) pattern";
-		return result;
-	}
-
-	// WhatsApp format: IMG-YYYYMMDD-WANHHMSS
-	std::wregex whatsappRegex(L"(?:^|[^\\d])IMG-(\\d{4})(\\d{2})(\\d{2})-WA\\d+(?:[^\\d]|$)", std::regex_constants::icase);
-	std::wsmatch whatsappMatches;
-	if (std::regex_search(nameOnly, whatsappMatches, whatsappRegex)) {
-		int year = std::stoi(whatsappMatches[1]);
-		int month = std::stoi(whatsappMatches[2]);
-		int day = std::stoi(whatsappMatches[3]);
-
-		createTime(year, month, day);
-		result.confidence = 0.85;
-		result.pattern = "WhatsApp";
-		result.explanation = "Matched WhatsApp pattern";
-		return result;
-	}
-
-	// Screenshot format: Screenshot_YYYYMMDD-HHMMSS
-	std::wregex screenshotRegex(L"(?:^|[^\\d])Screenshot_(\\d{4})(\\d{2})(\\d{2})-(\\d{2})(\\d{2})(\\d{2})(?:[^\\d]|$)", std::regex_constants::icase);
-	std::wsmatch screenshotMatches;
-	if (std::regex_search(nameOnly, screenshotMatches, screenshotRegex)) {
-		int year = std::stoi(screenshotMatches[1]);
-		int month = std::stoi(screenshotMatches[2]);
-		int day = std::stoi(screenshotMatches[3]);
-		int hour = std::stoi(screenshotMatches[4]);
-		int minute = std::stoi(screenshotMatches[5]);
-		int second = std::stoi(screenshotMatches[6]);
-
-		createTime(year, month, day, hour, minute, second);
-		result.confidence = 0.9;
-		result.pattern = "Android Screenshot";
-		result.explanation = "Matched Android Screenshot pattern";
-		return result;
-	}
-
-	// ISO format: YYYY-MM-DD_HH-MM-SS
-	std::wregex isoRegex(L"(?:^|[^\\d])(\\d{4})-(\\d{2})-(\\d{2})_(\\d{2})-(\\d{2})-(\\d{2})(?:[^\\d]|$)");
-	std::wsmatch isoMatches;
-	if (std::regex_search(nameOnly, isoMatches, isoRegex)) {
-		int year = std::stoi(isoMatches[1]);
-		int month = std::stoi(isoMatches[2]);
-		int day = std::stoi(isoMatches[3]);
-		int hour = std::stoi(isoMatches[4]);
-		int minute = std::stoi(isoMatches[5]);
-		int second = std::stoi(isoMatches[6]);
-
-		createTime(year, month, day, hour, minute, second);
-		result.confidence = 0.95;
-		result.pattern = "ISO Format";
-		result.explanation = "Matched ISO Format pattern";
-		return result;
-	}
-
-	// Date format YYYYMMDD embedded in filename
-	std::wregex embeddedDateRegex(L"(?:^|[^\\d])(\\d{4})(\\d{2})(\\d{2})(?:[^\\d]|$)");
-	std::wsmatch embeddedMatches;
-	if (std::regex_search(nameOnly, embeddedMatches, embeddedDateRegex)) {
-		int year = std::stoi(embeddedMatches[1]);
-		int month = std::stoi(embeddedMatches[2]);
-		int day = std::stoi(embeddedMatches[3]);
-
-		// Validate date parts
-		if (year >= 1990 && year <= 2030 &&
-			month >= 1 && month <= 12 &&
-			day >= 1 && day <= 31) {
-			createTime(year, month, day);
-			result.confidence = 0.7;
-			result.pattern = "Embedded Date";
-			result.explanation = "Matched Embedded Date pattern";
-			return result;
+			if (entry.is_regular_file(entryError)) {
+				if (IsImageFile(entry.path())) {
+					std::error_code sizeError, timeError;
+					auto fileSize = (UINT64)entry.file_size(sizeError);
+					auto fileTime = (UINT64)entry.last_write_time(timeError).time_since_epoch().count();
+
+					// Reuse what we knew about the file if it did not change
+					auto fileName = entry.path().filename().wstring();
+					ImageInfo* info = nullptr;
+					auto it = known.find(fileName);
+					if (it != known.end()) {
+						info = it->second;
+						known.erase(it);
+						if (sizeError || timeError) {
+							// Unknown for now, so what was cached is kept; ValidateCachedInfo checks again
+							fileSize = info->fileSize;
+							fileTime = info->lastWriteTime;
+						}
+						else if (info->fileSize != fileSize || info->lastWriteTime != fileTime) {
+							info->ForgetCachedInfo();
+						}
+					}
+					else {
+						info = ImageInfo::Create();
+						info->folder = folderId;
+						info->name = catalog.AddName(fileName);
+						if (sizeError || timeError) {
+							fileSize = fileTime = 0;
+						}
+					}
+
+					info->fileSize = fileSize;
+					info->lastWriteTime = fileTime;
+
+					// Add to image list
+					folder.images.push_back(info);
+					images.push_back(info);
+				}
+			}
+			else if (entry.is_directory(entryError))
+			{
+				subdirectoriesToVisit.push_back(path);
+			}
 		}
 	}
-
-	// UNIX timestamp in filename
-	std::wregex unixTimestampRegex(L"(?:^|[^\\d])(\\d{10,13})(?:[^\\d]|$)");
-	std::wsmatch timestampMatches;
-	if (std::regex_search(nameOnly, timestampMatches, unixTimestampRegex)) {
-		try {
-			long timestamp = std::stol(timestampMatches[1]);
-			// Validate timestamp (between 1990 and 2050)
-			if (timestamp > 631152000 && timestamp < 2524608000) {
-				long timestamp = std::stol(timestampMatches[1]);
-				std::time_t time = static_cast<std::time_t>(timestamp);
-				result.date = *std::gmtime(&time); // Make a copy if you don't want a pointer
-				result.success = true;
-				result.confidence = 0.6;
-				result.pattern = "UNIX Timestamp";
-				result.explanation = "Matched UNIX Timestamp pattern";
-				return result;
+	catch (const std::filesystem::filesystem_error& e) {
+		// Keep what was listed so far and what wasn't reached yet, and list it again next time
+		std::wcerr << L"Error listing directory \"" << directory << L"\": " << e.what() << std::endl;
+		folder.lastWriteTime = 0;
+		for (auto& [fileName, info] : known) {
+			if (!isExcluded(fileName)) {
+				folder.images.push_back(info);
+				images.push_back(info);
+			}
+			else {
+				ImageInfo::Destroy(info);
 			}
 		}
-		catch (const std::out_of_range&) {} // timestamp was te groot
-		catch (const std::invalid_argument&) {} // geen geldig getal
+		known.clear();
 	}
 
-	// Canon camera format: IMG_NNNN
-	std::wregex canonRegex(L"(?:^|[^\\d])IMG_(\\d{4})(?:[^\\d]|$)", std::regex_constants::icase);
-	std::wsmatch canonMatches;
-	if (std::regex_search(nameOnly, canonMatches, canonRegex)) {
-		// No date information available in this format
-		result.success = false;
-		result.confidence = 0.0;
-		result.pattern = "Canon Sequential";
-		result.explanation = "Matched Canon Sequential pattern, but no date information available";
-		return result;
+	for (auto& [fileName, info] : known) {
+		ImageInfo::Destroy(info);
 	}
-
-	// If no patterns matched
-	result.explanation = "No recognizable date pattern found in filename";
-	return result;
+	return true;
 }
 
-double convertToDecimal(const Exiv2::Exifdatum& degreesDatum, const Exiv2::Exifdatum& refDatum) {
-	const Exiv2::Value& degrees = degreesDatum.value();
-	const Exiv2::Value& ref = refDatum.value();
-
-	if (degrees.count() != 3) return 0.0;
-
-	auto toDouble = [](const Exiv2::Rational& r) {
-		return static_cast<double>(r.first) / r.second;
-		};
-
-	double d = toDouble(degrees.toRational(0));
-	double m = toDouble(degrees.toRational(1));
-	double s = toDouble(degrees.toRational(2));
-	double decimal = d + m / 60.0 + s / 3600.0;
+ImageInfo* ImageFileNameLibrary::GotoImage(int& imageIndex, int step, int monitorIndex, int numMonitors) {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (m_NumImages == 0)
+	{
+		return NULL;
+	}
 
-	std::string direction = ref.toString();
-	if (direction == "S" || direction == "W")
-		decimal *= -1;
+	// Monitors take turns through the playlist, so their offsets don't depend on its size.
+	// Holes are photos of the index that haven't been scanned yet, or have been removed.
+	// Skipped photos are passed over the same way.
+	auto n = (INT64)m_ImageList.size();
+	for (INT64 tries = 0; tries < n * 2; ++tries, imageIndex += step) {
+		auto slot = (INT64)imageIndex * numMonitors + monitorIndex;
+		if (IsLovedSlot(slot)) {
+			if (auto img = DrawLoved(slot)) {
+				return img;
+			}
+			continue;
+		}
 
-	return decimal;
+		auto position = (ToPosition(slot) % n + n) % n;
+		auto number = m_Order.At((UINT32)position, (UINT32)n);
+		if (m_ImageList[number] && !m_Skipped[number]) {
+			return m_ImageList[number];
+		}
+	}
+	return nullptr;
 }
 
 size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* out) {
@@ -504,7 +779,8 @@ std::string MakeHttpRequest(const std::wstring& url)
 {
 	HINTERNET hInternet, hConnect;
 	DWORD bytesRead;
-	char buffer[4096] = {};
+	char buffer[4096];
+	std::string response;
 
 	// Initialize WinINet
 	hInternet = InternetOpen(L"HTTPS Example", INTERNET_OPEN_TYPE_DIRECT, NULL, NULL, 0);
@@ -522,55 +798,63 @@ std::string MakeHttpRequest(const std::wstring& url)
 	}
 
 	// Read the data from the connection
-	while (InternetReadFile(hConnect, buffer, sizeof(buffer) - 1, &bytesRead) && bytesRead > 0) {
-		buffer[bytesRead] = '\0';  // Null-terminate the data
-		std::cout << buffer;
+	while (InternetReadFile(hConnect, buffer, sizeof(buffer), &bytesRead) && bytesRead > 0) {
+		response.append(buffer, bytesRead);
 	}
 
 	// Clean up
 	InternetCloseHandle(hConnect);
 	InternetCloseHandle(hInternet);
 
-	return buffer;
+	return response;
 }
 
-std::wstring DescribeLocation(const std::wstring& filePath)
+// The offline place list, loaded on first use. Empty when there is none, then locations come from Nominatim.
+static const ReverseGeocoder& GetOfflineGeocoder(const std::wstring& placesFile)
 {
-	std::string location;
-
-	double lat, lon;
-	try {
-		std::unique_ptr<Exiv2::Image> image = Exiv2::ImageFactory::open(WStringToUtf8(filePath));
-		if (!image) {
-			std::cerr << "Failed to open image.\n";
-			return L"";
+	static ReverseGeocoder geocoder;
+	static std::once_flag loaded;
+	std::call_once(loaded, [&placesFile] {
+		auto path = placesFile.empty() ? GetAppDataFilePath(L"cities1000.txt", false) : placesFile;
+		std::error_code ec;
+		if (path.empty() || !std::filesystem::exists(path, ec)) {
+			return;
 		}
 
-		image->readMetadata();
-		Exiv2::ExifData& exif = image->exifData();
-
-		lat = convertToDecimal(
-			exif["Exif.GPSInfo.GPSLatitude"],
-			exif["Exif.GPSInfo.GPSLatitudeRef"]
-		);
-		lon = convertToDecimal(
-			exif["Exif.GPSInfo.GPSLongitude"],
-			exif["Exif.GPSInfo.GPSLongitudeRef"]
-		);
-
-		std::cout << std::fixed << std::setprecision(7)
-			<< "Latitude: " << lat << "\n"
-			<< "Longitude: " << lon << "\n";
+		auto start = std::chrono::steady_clock::now();
+		if (geocoder.Load(path)) {
+			auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+			std::wcout << L"Loaded " << geocoder.Size() << L" places from \"" << path << L"\" in " << ms << L" ms, "
+				<< geocoder.MemoryUsage() / 1024 << L" KB" << std::endl;
+		}
+		else {
+			std::wcerr << L"Could not read places from \"" << path << L"\"" << std::endl;
+		}
+	});
+	return geocoder;
+}
 
-	}
-	catch (const Exiv2::Error& e) {
-		std::cerr << "EXIF error: " << e.what() << "\n";
-		return L"";
-	}
+// Online lookups, remembered in %APPDATA%\PhotoCycle\locations.txt
+static GeocodeCache& GetGeocodeCache()
+{
+	static GeocodeCache cache;
+	static std::once_flag loaded;
+	std::call_once(loaded, [] {
+		auto path = GetAppDataFilePath(L"locations.txt", false);
+		if (!path.empty()) {
+			cache.Load(path);
+		}
+	});
+	return cache;
+}
 
+// The location in UTF-8, or empty when the service could not be reached
+std::string DescribeLocation(const std::wstring& serviceUrl, double lat, double lon)
+{
+	std::string location;
 
 	std::ostringstream url;
-	url << "https://nominatim.openstreetmap.org/reverse?format=json"
+	url << WStringToUtf8(serviceUrl) << "?format=json"
 		<< "&lat=" << std::fixed << std::setprecision(7) << lat
 		<< "&lon=" << std::fixed << std::setprecision(7) << lon
 		<< "&accept-language=nl";
@@ -595,7 +879,13 @@ std::wstring DescribeLocation(const std::wstring& filePath)
 	auto response = MakeHttpRequest(Utf8ToWString(url.str()));
 
 
-	nlohmann::json j = nlohmann::json::parse(response);
+	nlohmann::json j = nlohmann::json::parse(response, nullptr, false);
+	if (j.is_discarded() || !j.contains("address")) {
+		if (!response.empty()) {
+			std::wcerr << L"No address in the geocoding response for " << lat << L", " << lon << std::endl;
+		}
+		return "";
+	}
 
 	const auto& addr = j["address"];
 
@@ -632,12 +922,13 @@ std::wstring DescribeLocation(const std::wstring& filePath)
 		location += addr["country"].get<std::string>();
 	}
 
-	return Utf8ToWString(location);
+	return location;
 }
 
 bool ImageInfo::RotateImage90()
 {
 	try {
+		auto filePath = GetFilePath();
 		auto img = Exiv2::ImageFactory::open(WStringToUtf8(filePath));
 		if (!img) return false;
 
@@ -673,6 +964,12 @@ bool ImageInfo::RotateImage90()
 		img->setExifData(exifData);
 		img->writeMetadata();
 
+		// Keep the cached info, it is up to date with the new file contents
+		std::error_code ec;
+		fileSize = (UINT64)std::filesystem::file_size(filePath, ec);
+		lastWriteTime = (UINT64)std::filesystem::last_write_time(filePath, ec).time_since_epoch().count();
+
+		metadata.orientation = (UINT16)newOrientation;
 		switch (newOrientation) {
 		case 1: rotation = 0; break;
 		case 6: rotation = 90; break;
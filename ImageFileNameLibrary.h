@@ -1,35 +1,91 @@
 #pragma once
 
 #include "framework.h"
-class SettingsDialog;
+#include "ImageInfo.h"
+#include "AliasTable.h"
+#include "PlaylistOrder.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+class PathFilter;
 
-class ImageInfo {
-public:
-	int idx = -1;
-	bool isCaching = false;
-	std::wstring dateTaken;
-	int rotation = -1;
-	std::wstring filePath;
-	std::wstring folderName;
-	std::wstring location;
-	ImageInfo() = default;
-	ImageInfo(const ImageInfo&) = default;
-	ImageInfo& operator=(const ImageInfo&) = default;
-	ImageInfo(ImageInfo&&) = default;
-
-	void CacheInfo(SettingsDialog& sets);
-	std::wstring GetCaption(SettingsDialog& sets);
-	bool RotateImage90();
-};
+// The smallest preview embedded in a photo (a camera's EXIF thumbnail or its 1-2 MP preview JPEG)
+// that is at least minWidth x minHeight and has the shape of the photo itself, so it can stand in
+// for it. Sizes are as stored, before EXIF rotation. Empty when there is no such preview.
+std::vector<BYTE> ReadEmbeddedPreview(const std::wstring& imagePath, UINT minWidth, UINT minHeight);
 
+// The shuffled playlist. Scanning happens in the background and images are shown as soon
+// as the first directories are listed. Every photo has a number, its place in m_ImageList,
+// which the photo index remembers; the playlist is a PlaylistOrder over those numbers, so
+// the next session continues with the same order from where this one stopped. New photos get
+// the next numbers and take over a few positions here and there, the rest stays in place.
+// Numbers are never moved: those of removed photos are holes, which the photos that are new
+// in this session fill when the index is saved.
+// Every LovedEvery-th slot shows a loved photo instead, drawn by its number of LOVE votes.
+// Downvoted photos and those that can't be decoded are marked in a bitset by number and
+// skipped like missing ones, so they cost nothing when they come by.
 class ImageFileNameLibrary {
 public:
-	void SetPaths(const std::vector<std::wstring>& include, const std::vector<std::wstring>& exclude);
-	ImageInfo* GotoImage(int imageIndex, int monitorIndex, int numMonitors);
+	~ImageFileNameLibrary() { StopScan(); }
+
+	// Starts scanning in the background and returns immediately.
+	void SetPaths(const std::vector<std::wstring>& include, const std::vector<std::wstring>& exclude, int numThreads);
+	void StopScan();
+	bool IsScanning() const { return m_Scanning; }
+
+	// Votes by path, from the vote file: LOVE counted, DOWN once is enough. Call before SetPaths.
+	void SetVotes(std::unordered_map<std::wstring, UINT32> loveVotes, std::unordered_set<std::wstring> downVotes, int lovedEvery);
+	void AddLoveVote(ImageInfo* info);
+	// Never shown again: downvoted, or it could not be decoded
+	void Skip(ImageInfo* info);
+
+	// The photo at imageIndex for this monitor. Positions without a photo are skipped in the
+	// direction of `step`, imageIndex is moved along.
+	ImageInfo* GotoImage(int& imageIndex, int step, int monitorIndex, int numMonitors);
+	// Where the next session continues
+	void MarkShown(int imageIndex, int monitorIndex, int numMonitors);
+
+	// Only call when the scan is stopped or done.
+	void SaveIndex() const;
 
 private:
-	void ShuffleImages();
-	void LoadImages(const std::wstring& directory, const std::vector<std::wstring>& exclude);
+	void ScanPaths(const std::vector<std::wstring>& include, const std::vector<std::wstring>& exclude, int numThreads);
+	void AddImages(const std::vector<ImageInfo*>& images);
+	bool IsLovedSlot(INT64 slot) const;
+	// The playlist position of a slot that isn't a loved one
+	INT64 ToPosition(INT64 slot) const;
+	ImageInfo* DrawLoved(INT64 slot);
+	static bool ScanDirectory(const std::wstring& directory, const PathFilter& exclude, ImageFolderMap& cache,
+		ImageFolder& folder, std::vector<ImageInfo*>& images, std::vector<std::wstring>& subdirectoriesToVisit);
+
+	std::mutex m_Mutex;
+	std::vector<ImageInfo*> m_ImageList; // By number, nullptr where a photo is missing
+	std::vector<bool> m_Skipped; // By number
+	std::unordered_set<std::wstring> m_DownVotes; // Of photos that haven't been found yet
+	size_t m_NumImages = 0;
+	PlaylistOrder m_Order;
+	INT64 m_Start = 0; // Playlist position of image index 0 on monitor 0
+	INT64 m_Shown = -1; // Furthest slot shown so far: imageIndex * numMonitors + monitorIndex
+	UINT32 m_IndexCount = 0; // Numbers the index had, photos from here on are new
+	bool m_ScanComplete = false; // So the holes are photos that are gone, not ones not found yet
+	std::mt19937 m_Random{ std::random_device{}() };
+
+	std::unordered_map<std::wstring, UINT32> m_LoveVotes; // Of photos that haven't been found yet
+	std::vector<ImageInfo*> m_Loved;
+	std::vector<double> m_LoveWeights; // Votes of m_Loved
+	AliasTable m_LovedTable; // Over m_LoveWeights, built again on the next draw after a change
+	bool m_LovedChanged = false;
+	int m_LovedEvery = 0;
+
+	std::thread m_Scanner;
+	std::atomic<bool> m_Scanning = false;
+	std::atomic<bool> m_StopScan = false;
+	std::chrono::steady_clock::time_point m_ScanStart;
 
-	std::vector<ImageInfo*> m_ImageList;
+	ImageFolderMap m_Folders;
+	std::wstring m_IndexFile;
 };
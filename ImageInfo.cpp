@@ -0,0 +1,126 @@
+#include "ImageInfo.h"
+
+#include <cwchar>
+#include <deque>
+#include <iterator>
+#include <memory>
+
+PhotoCatalog& ImageInfo::Catalog()
+{
+	static PhotoCatalog catalog;
+	return catalog;
+}
+
+namespace {
+	// Infos are handed out by address and never move. Destroyed ones are reused.
+	struct ImageInfoPool {
+		std::mutex mutex;
+		std::deque<ImageInfo> infos;
+		std::vector<ImageInfo*> unused;
+	};
+
+	ImageInfoPool& GetImageInfoPool()
+	{
+		static ImageInfoPool pool;
+		return pool;
+	}
+}
+
+ImageInfo* ImageInfo::Create()
+{
+	auto& pool = GetImageInfoPool();
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	if (pool.unused.empty()) {
+		return &pool.infos.emplace_back();
+	}
+
+	auto* info = pool.unused.back();
+	pool.unused.pop_back();
+	std::construct_at(info);
+	return info;
+}
+
+void ImageInfo::Destroy(ImageInfo* info)
+{
+	auto& pool = GetImageInfoPool();
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	std::destroy_at(info);
+	pool.unused.push_back(info);
+}
+
+uint32_t ImageInfo::PackDate(std::tm date)
+{
+	std::time_t time = std::mktime(&date);
+	struct std::tm* timeInfo = std::localtime(&time);
+	if (!timeInfo) {
+		return NoDate;
+	}
+	return (uint32_t)(timeInfo->tm_year + 1900) << 16 | (uint32_t)(timeInfo->tm_mon + 1) << 8 | (uint32_t)timeInfo->tm_mday;
+}
+
+std::wstring ImageInfo::GetFilePath() const
+{
+	return Catalog().GetPath(folder, name);
+}
+
+std::wstring ImageInfo::GetFolderName() const
+{
+	return Catalog().GetFolderName(folder);
+}
+
+std::wstring ImageInfo::GetDate() const
+{
+	if (date == UnknownDate || date == NoDate) {
+		return {};
+	}
+
+	wchar_t text[16];
+	swprintf(text, std::size(text), L"%02u-%02u-%04u", date & 0xFF, (date >> 8) & 0xFF, date >> 16);
+	return text;
+}
+
+int ImageMetadata::GetRotation() const {
+	switch (orientation) {
+	case 3: return 180;
+	case 6: return 90;
+	case 8: return 270;
+	default: return 0;
+	}
+}
+
+bool ImageMetadata::GetDate(std::tm& date) const {
+	if (!hasDate) return false;
+
+	date = {};
+	date.tm_year = year - 1900;
+	date.tm_mon = month - 1;
+	date.tm_mday = day;
+	date.tm_hour = hour;
+	date.tm_min = minute;
+	date.tm_sec = second;
+	return true;
+}
+
+void ImageInfo::ValidateCachedInfo(uint64_t size, uint64_t time)
+{
+	if (isCaching) {
+		return;
+	}
+
+	if (size != fileSize || time != lastWriteTime) {
+		// The file was edited since its metadata was cached
+		ForgetCachedInfo();
+		fileSize = size;
+		lastWriteTime = time;
+	}
+}
+
+void ImageInfo::ForgetCachedInfo()
+{
+	date = UnknownDate;
+	location = PhotoCatalog::UnknownLocation;
+	rotation = -1;
+	width = height = 0;
+	metadata = ImageMetadata();
+	decodeError = 0;
+}
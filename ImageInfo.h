@@ -0,0 +1,96 @@
+#pragma once
+
+#include "PhotoCatalog.h"
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class SettingsDialog;
+class TaskPool;
+
+// Everything CacheInfo needs from the EXIF data of a file, read in a single pass.
+struct ImageMetadata {
+	bool isRead = false;
+	bool hasDate = false;
+	bool hasLocation = false;
+	uint8_t month = 0, day = 0, hour = 0, minute = 0, second = 0;
+	uint16_t year = 0;
+	uint16_t orientation = 1; // EXIF orientation, 1 is upright
+	uint32_t width = 0;
+	uint32_t height = 0;
+	double latitude = 0;
+	double longitude = 0;
+
+	int GetRotation() const;
+	bool GetDate(std::tm& date) const;
+};
+
+// One photo of the library. Its strings live in the shared catalog; the infos themselves
+// come from a pool, so a million of them aren't a million separate allocations.
+// CacheInfo, GetCaption, GetLocation and RotateImage90 read and write the file with Exiv2 and
+// Windows, and live in ImageFileNameLibrary.cpp; the rest is plain data the photo index keeps.
+class ImageInfo {
+public:
+	static constexpr uint32_t UnknownDate = 0; // Not looked up yet
+	static constexpr uint32_t NoDate = 1; // Looked up, nothing found
+
+	int idx = -1;
+	std::atomic<bool> isCaching = false; // A location lookup is queued or running
+	int rotation = -1;
+	uint32_t folder = PhotoCatalog::NoFolder;
+	uint32_t name = 0; // File name in the catalog
+	uint32_t date = UnknownDate; // Or PackDate
+	uint32_t location = PhotoCatalog::UnknownLocation;
+	uint64_t fileSize = 0;
+	uint64_t lastWriteTime = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	ImageMetadata metadata;
+	int32_t decodeError = 0; // The HRESULT of WIC failing to decode the file as it is now, remembered in the photo index
+	ImageInfo() = default;
+
+	static PhotoCatalog& Catalog();
+	static ImageInfo* Create();
+	static void Destroy(ImageInfo* info);
+	// yyyy << 16 | mm << 8 | dd, after normalizing the date like mktime does
+	static uint32_t PackDate(std::tm date);
+
+	std::wstring GetFilePath() const;
+	std::wstring GetFolderName() const;
+	// "dd-mm-yyyy", empty when not known
+	std::wstring GetDate() const;
+	// Empty when not known
+	std::wstring GetLocation() const;
+
+	// Online location lookups go to `tasks`, their result is applied on the UI thread.
+	// The other threads only touch the info while holding `infoMutex`, so the fields are
+	// read and written under it; the slow part, reading the file, happens without it.
+	void CacheInfo(SettingsDialog& sets, TaskPool& tasks, std::mutex& infoMutex);
+	std::wstring GetCaption(SettingsDialog& sets);
+	bool RotateImage90();
+	// Forgets what was cached when the file now has another size or time
+	void ValidateCachedInfo(uint64_t size, uint64_t time);
+	void ForgetCachedInfo();
+	// WIC failed on the file as it is now, so the playlist skips it until it changes
+	bool IsUndecodable() const { return decodeError < 0; }
+};
+
+// A scanned directory, as remembered in the photo index.
+struct ImageFolder {
+	uint64_t lastWriteTime = 0;
+	std::vector<std::wstring> subdirectories;
+	std::vector<ImageInfo*> images;
+};
+
+using ImageFolderMap = std::unordered_map<std::wstring, ImageFolder>;
+
+// Where the slideshow was, as remembered in the photo index
+struct PlaylistState {
+	uint64_t seed = 0;
+	uint32_t position = 0; // The next one to show
+	uint32_t count = 0; // Photos in the index, numbered 0 to count - 1
+};
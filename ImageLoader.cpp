@@ -0,0 +1,536 @@
+#ifndef UNICODE
+#define UNICODE
+#endif
+
+#include "ImageLoader.h"
+#include "ImageFileNameLibrary.h"
+#include "PixelOps.h"
+#include "SettingsDialog.h"
+
+#include <cmath>
+#include <wrl/client.h>
+
+#pragma comment(lib, "windowscodecs.lib")
+
+using Microsoft::WRL::ComPtr;
+
+template<typename Jobs>
+static auto FindJob(Jobs& jobs, ImageInfo* info)
+{
+	return std::find_if(jobs.begin(), jobs.end(), [info](const DecodeJob& job) { return job.info == info; });
+}
+
+static bool HasAlphaChannel(IWICImagingFactory* pFactory, IWICBitmapFrameDecode* pFrame)
+{
+	WICPixelFormatGUID format;
+	ComPtr<IWICComponentInfo> pInfo;
+	ComPtr<IWICPixelFormatInfo2> pFormatInfo;
+	BOOL supportsTransparency = TRUE;
+
+	// When in doubt, flatten
+	if (SUCCEEDED(pFrame->GetPixelFormat(&format)) &&
+		SUCCEEDED(pFactory->CreateComponentInfo(format, &pInfo)) &&
+		SUCCEEDED(pInfo.As(&pFormatInfo))) {
+		pFormatInfo->SupportsTransparency(&supportsTransparency);
+	}
+	return supportsTransparency != FALSE;
+}
+
+void ImageLoader::Start(SettingsDialog& settings, TaskPool& tasks, std::mutex& infoMutex)
+{
+	m_Settings = &settings;
+	m_Tasks = &tasks;
+	m_InfoMutex = &infoMutex;
+	m_Stopping = false;
+	m_Cache.SetBudget((size_t)std::max(settings.DecodeCacheMB, 0) * 1024 * 1024);
+	m_Worker = std::thread(&ImageLoader::WorkerMain, this);
+}
+
+void ImageLoader::Stop()
+{
+	if (!m_Worker.joinable()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stopping = true;
+	}
+	m_WakeUp.notify_all();
+	m_Worker.join();
+
+	auto stats = m_Cache.GetStats();
+	std::wcout << L"Decode cache: " << stats.hits << L" hits, " << stats.misses << L" misses, " << stats.evictions
+		<< L" evictions, " << stats.entries << L" images in " << stats.bytes / (1024 * 1024) << L" MB" << std::endl;
+}
+
+void ImageLoader::Request(const DecodeJob& job)
+{
+	// A photo that was on screen recently is ready right away, without waiting
+	// for the worker to finish what it is decoding. The rotation is only known
+	// once the photo has been looked at; if it hasn't, the worker looks it up.
+	std::shared_ptr<DecodedImage> cached;
+	if (job.rotation >= 0) {
+		cached = m_Cache.Find(MakeKey(job), false);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (FindJob(m_Requested, job.info) == m_Requested.end()) {
+			m_Requested.push_back(job);
+		}
+		if (cached && !m_Ready.contains(job.info)) {
+			m_ReadyBytes += cached->pixels.size();
+			m_Ready[job.info] = cached;
+		}
+	}
+	m_WakeUp.notify_all();
+	if (cached && m_OnReady) {
+		m_OnReady();
+	}
+}
+
+void ImageLoader::Cancel(ImageInfo* info)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto it = FindJob(m_Requested, info);
+	if (it != m_Requested.end()) {
+		m_Requested.erase(it);
+		Purge();
+	}
+}
+
+void ImageLoader::Prefetch(int monitorIndex, const std::vector<DecodeJob>& upcoming)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (monitorIndex >= (int)m_Upcoming.size()) {
+			m_Upcoming.resize((size_t)monitorIndex + 1);
+		}
+		m_Upcoming[(size_t)monitorIndex] = upcoming;
+		Purge();
+	}
+	m_WakeUp.notify_all();
+}
+
+std::shared_ptr<DecodedImage> ImageLoader::Take(ImageInfo* info)
+{
+	std::shared_ptr<DecodedImage> image;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto it = m_Ready.find(info);
+		if (it == m_Ready.end()) {
+			return nullptr;
+		}
+
+		image = it->second;
+		m_ReadyBytes -= image->pixels.size();
+		m_Ready.erase(it);
+		m_Previews.erase(info);
+
+		auto req = FindJob(m_Requested, info);
+		if (req != m_Requested.end()) {
+			m_Requested.erase(req);
+		}
+	}
+
+	// Memory was freed up for prefetching
+	m_WakeUp.notify_all();
+	return image;
+}
+
+std::shared_ptr<DecodedImage> ImageLoader::TakePreview(ImageInfo* info)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto it = m_Previews.find(info);
+	if (it == m_Previews.end()) {
+		return nullptr;
+	}
+
+	auto preview = it->second;
+	m_Previews.erase(it);
+	return preview;
+}
+
+bool ImageLoader::IsWanted(ImageInfo* info) const
+{
+	if (FindJob(m_Requested, info) != m_Requested.end()) {
+		return true;
+	}
+
+	for (const auto& upcoming : m_Upcoming) {
+		if (FindJob(upcoming, info) != upcoming.end()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void ImageLoader::Purge()
+{
+	// Forget images that nobody is going to show anymore
+	for (auto it = m_Ready.begin(); it != m_Ready.end();) {
+		if (IsWanted(it->first)) {
+			++it;
+		}
+		else {
+			m_ReadyBytes -= it->second->pixels.size();
+			it = m_Ready.erase(it);
+		}
+	}
+
+	// Previews are only for windows that are waiting
+	std::erase_if(m_Previews, [this](const auto& preview) { return FindJob(m_Requested, preview.first) == m_Requested.end(); });
+}
+
+bool ImageLoader::NextJob(DecodeJob& job)
+{
+	for (const auto& requested : m_Requested) {
+		if (!m_Ready.contains(requested.info)) {
+			job = requested;
+			return true;
+		}
+	}
+
+	// Back-pressure: only decode ahead while the decoded images fit in memory
+	size_t budget = (size_t)std::max(m_Settings->PrefetchMemoryMB, 0) * 1024 * 1024;
+	if (m_ReadyBytes >= budget) {
+		return false;
+	}
+
+	// Take turns between monitors, so every monitor has its next image first
+	size_t depth = 0;
+	for (const auto& upcoming : m_Upcoming) {
+		depth = std::max(depth, upcoming.size());
+	}
+
+	for (size_t i = 0; i < depth; ++i) {
+		for (const auto& upcoming : m_Upcoming) {
+			if (i < upcoming.size() && !m_Ready.contains(upcoming[i].info)) {
+				job = upcoming[i];
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void ImageLoader::WorkerMain()
+{
+	HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	if (FAILED(hr)) {
+		std::cout << "Error (" << hr << ") initializing COM for the image loader" << std::endl;
+		return;
+	}
+
+	{
+		ComPtr<IWICImagingFactory> pFactory;
+		hr = CoCreateInstance(
+			CLSID_WICImagingFactory,
+			nullptr,
+			CLSCTX_INPROC_SERVER,
+			IID_PPV_ARGS(pFactory.GetAddressOf())
+		);
+
+		while (SUCCEEDED(hr)) {
+			DecodeJob job;
+			bool isRequested;
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_WakeUp.wait(lock, [&] { return m_Stopping || NextJob(job); });
+				if (m_Stopping) {
+					break;
+				}
+				m_InFlight = job.info;
+				isRequested = FindJob(m_Requested, job.info) != m_Requested.end();
+			}
+
+			auto info = job.info;
+			info->CacheInfo(*m_Settings, *m_Tasks, *m_InfoMutex);
+			DecodedImageKey key;
+			HRESULT decodeError;
+			{
+				// The rotation may have been looked up just now, or changed since the job was made
+				std::lock_guard<std::mutex> lock(*m_InfoMutex);
+				job.rotation = std::max(info->rotation, 0);
+				key = MakeKey(job);
+				decodeError = info->decodeError;
+			}
+			auto image = m_Cache.Find(key);
+			if (!image && FAILED(decodeError)) {
+				// Known to be broken since it last changed: don't even open it
+				image = std::make_shared<DecodedImage>();
+				image->info = info;
+				image->hr = decodeError;
+			}
+			else if (!image) {
+				// A window is waiting for this one: give it the embedded preview first
+				if (isRequested && m_Settings->PreviewMinFraction > 0) {
+					auto preview = std::make_shared<DecodedImage>();
+					preview->info = info;
+					preview->hr = DecodePreview(pFactory.Get(), job, m_Settings->PreviewMinFraction, m_Settings->BackgroundColor, *preview);
+					if (SUCCEEDED(preview->hr)) {
+						{
+							std::lock_guard<std::mutex> lock(m_Mutex);
+							if (FindJob(m_Requested, info) != m_Requested.end()) {
+								m_Previews[info] = preview;
+							}
+						}
+						if (m_OnReady) {
+							m_OnReady();
+						}
+					}
+				}
+
+				image = std::make_shared<DecodedImage>();
+				image->info = info;
+				image->hr = Decode(pFactory.Get(), job, m_Settings->BackgroundColor, *image);
+				if (SUCCEEDED(image->hr)) {
+					m_Cache.Insert(key, image, image->pixels.size());
+
+					// Remember the dimensions in the photo index
+					std::lock_guard<std::mutex> lock(*m_InfoMutex);
+					info->width = image->frameWidth;
+					info->height = image->frameHeight;
+				}
+				else if (HRESULT_FACILITY(image->hr) == FACILITY_WINCODEC_ERR) {
+					// The file itself is bad, not the disk or the memory; remember that until it changes
+					std::wcerr << L"Can't decode \"" << info->GetFilePath() << L"\" (" << std::hex << image->hr << std::dec << L")" << std::endl;
+					std::lock_guard<std::mutex> lock(*m_InfoMutex);
+					info->decodeError = image->hr;
+				}
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_InFlight = nullptr;
+				if (IsWanted(info)) {
+					// Request may have put a cache hit there while this one was decoding
+					auto& ready = m_Ready[info];
+					if (ready) {
+						m_ReadyBytes -= ready->pixels.size();
+					}
+					m_ReadyBytes += image->pixels.size();
+					ready = image;
+				}
+			}
+			if (m_OnReady) {
+				m_OnReady();
+			}
+		}
+	}
+
+	CoUninitialize();
+}
+
+DecodedImageKey ImageLoader::MakeKey(const DecodeJob& job)
+{
+	return { job.info->GetFilePath(), job.info->lastWriteTime, job.targetWidth, job.targetHeight, job.rotation };
+}
+
+HRESULT ImageLoader::Decode(IWICImagingFactory* pFactory, const DecodeJob& job, UINT32 backgroundColor, DecodedImage& image)
+{
+	ComPtr<IWICBitmapDecoder> pDecoder;
+	ComPtr<IWICBitmapFrameDecode> pFrame;
+
+	// Create decoder
+	auto filePath = image.info->GetFilePath();
+	HRESULT hr = pFactory->CreateDecoderFromFilename(
+		filePath.c_str(),
+		nullptr,
+		GENERIC_READ,
+		WICDecodeMetadataCacheOnDemand,
+		&pDecoder);
+	if (FAILED(hr)) return hr;
+
+	// Get frame
+	hr = pDecoder->GetFrame(0, &pFrame);
+	if (FAILED(hr)) return hr;
+
+	UINT frameWidth, frameHeight;
+	hr = pFrame->GetSize(&frameWidth, &frameHeight);
+	if (FAILED(hr)) return hr;
+	image.frameWidth = frameWidth;
+	image.frameHeight = frameHeight;
+
+	return DecodeFrame(pFactory, pFrame.Get(), job, backgroundColor, image);
+}
+
+HRESULT ImageLoader::DecodePreview(IWICImagingFactory* pFactory, const DecodeJob& job, float minFraction, UINT32 backgroundColor, DecodedImage& image)
+{
+	ComPtr<IWICStream> pStream;
+	ComPtr<IWICBitmapDecoder> pDecoder;
+	ComPtr<IWICBitmapFrameDecode> pFrame;
+
+	// The decode size is on screen, the preview is stored like the photo: before rotation
+	bool isSideways = job.rotation == 90 || job.rotation == 270;
+	auto minWidth = (UINT)((isSideways ? job.targetHeight : job.targetWidth) * minFraction);
+	auto minHeight = (UINT)((isSideways ? job.targetWidth : job.targetHeight) * minFraction);
+	auto data = ReadEmbeddedPreview(image.info->GetFilePath(), minWidth, minHeight);
+	if (data.empty()) return E_FAIL;
+
+	HRESULT hr = pFactory->CreateStream(&pStream);
+	if (FAILED(hr)) return hr;
+
+	hr = pStream->InitializeFromMemory(data.data(), (DWORD)data.size());
+	if (FAILED(hr)) return hr;
+
+	hr = pFactory->CreateDecoderFromStream(pStream.Get(), nullptr, WICDecodeMetadataCacheOnDemand, &pDecoder);
+	if (FAILED(hr)) return hr;
+
+	hr = pDecoder->GetFrame(0, &pFrame);
+	if (FAILED(hr)) return hr;
+
+	return DecodeFrame(pFactory, pFrame.Get(), job, backgroundColor, image);
+}
+
+HRESULT ImageLoader::DecodeFrame(IWICImagingFactory* pFactory, IWICBitmapFrameDecode* pFrame, const DecodeJob& job, UINT32 backgroundColor, DecodedImage& image)
+{
+	ComPtr<IWICBitmapScaler> pScaler;
+	ComPtr<IWICFormatConverter> pConverter;
+	ComPtr<IWICBitmapFlipRotator> pRotator;
+
+	UINT frameWidth, frameHeight;
+	HRESULT hr = pFrame->GetSize(&frameWidth, &frameHeight);
+	if (FAILED(hr)) return hr;
+
+	bool isSideways = job.rotation == 90 || job.rotation == 270;
+	UINT displayWidth = isSideways ? frameHeight : frameWidth;
+	UINT displayHeight = isSideways ? frameWidth : frameHeight;
+
+	// The sprite always covers the screen, so the scale follows from the larger ratio
+	float scale = 1;
+	if (job.targetWidth > 0 && job.targetHeight > 0) {
+		scale = std::min(1.0f, std::max(
+			job.targetWidth / (float)displayWidth,
+			job.targetHeight / (float)displayHeight));
+	}
+
+	ComPtr<IWICBitmapSource> pScaled = pFrame;
+	if (scale < 1) {
+		// Scaling the frame directly lets the JPEG decoder skip DCT coefficients,
+		// so the full resolution image never exists in memory
+		hr = pFactory->CreateBitmapScaler(&pScaler);
+		if (FAILED(hr)) return hr;
+
+		hr = pScaler->Initialize(
+			pFrame,
+			std::max(1u, (UINT)std::ceil(frameWidth * scale)),
+			std::max(1u, (UINT)std::ceil(frameHeight * scale)),
+			WICBitmapInterpolationModeFant);
+		if (FAILED(hr)) return hr;
+
+		pScaled = pScaler;
+	}
+
+	// Convert to 32bppPBGRA
+	hr = pFactory->CreateFormatConverter(&pConverter);
+	if (FAILED(hr)) return hr;
+
+	hr = pConverter->Initialize(
+		pScaled.Get(),
+		GUID_WICPixelFormat32bppPBGRA,
+		WICBitmapDitherTypeNone,
+		nullptr,
+		0.0f,
+		WICBitmapPaletteTypeCustom);
+	if (FAILED(hr)) return hr;
+
+	// Apply rotation
+	WICBitmapTransformOptions transform = WICBitmapTransformRotate0;
+	switch (job.rotation) {
+	case 90:  transform = WICBitmapTransformRotate90; break;
+	case 180: transform = WICBitmapTransformRotate180; break;
+	case 270: transform = WICBitmapTransformRotate270; break;
+	default: transform = WICBitmapTransformRotate0; break;
+	}
+
+	ComPtr<IWICBitmapSource> pSource = pConverter;
+
+	if (transform != WICBitmapTransformRotate0) {
+		hr = pFactory->CreateBitmapFlipRotator(&pRotator);
+		if (FAILED(hr)) return hr;
+
+		hr = pRotator->Initialize(pConverter.Get(), transform);
+		if (FAILED(hr)) return hr;
+
+		pSource = pRotator;
+	}
+
+	// Get final size
+	hr = pSource->GetSize(&image.width, &image.height);
+	if (FAILED(hr)) return hr;
+
+	// Get the pixel data from the rotated source
+	image.stride = image.width * 4; // 4 bytes per pixel (BGRA)
+	PlanMipLevels(job, image);
+
+	// JPEGs and other formats without an alpha channel come out of the converter opaque already
+	return CopyPixelsInStrips(pSource.Get(), pRotator != nullptr, HasAlphaChannel(pFactory, pFrame), backgroundColor, image);
+}
+
+// Sizes the pixel buffer for the full image and the smaller levels the window needs.
+// Level sizes are rounded up, like Downsample2x does.
+void ImageLoader::PlanMipLevels(const DecodeJob& job, DecodedImage& image)
+{
+	size_t size = (size_t)image.stride * image.height;
+	image.mipLevels.clear();
+
+	if (job.viewWidth > 0 && job.viewHeight > 0) {
+		// The size the photo covers the window with at zoom 1; no level may be smaller
+		float fit = std::max(job.viewWidth / (float)image.width, job.viewHeight / (float)image.height);
+		float drawnWidth = image.width * fit;
+		float drawnHeight = image.height * fit;
+
+		UINT width = image.width;
+		UINT height = image.height;
+		while (image.mipLevels.size() < MaxMipLevels) {
+			width = (width + 1) / 2;
+			height = (height + 1) / 2;
+			if (width < drawnWidth || height < drawnHeight) {
+				break;
+			}
+			image.mipLevels.push_back({ width, height, width * 4, size });
+			size += (size_t)width * 4 * height;
+		}
+	}
+
+	image.pixels.resize(size);
+}
+
+// Copies the pixels out of the decoder a strip of rows at a time, and blends each strip
+// with the background color and scales it into the smaller levels while it is still in
+// the cache. The flip rotator needs all of its input for any row it gives out, so a
+// rotated photo is copied in one go and only blended and scaled in strips.
+HRESULT ImageLoader::CopyPixelsInStrips(IWICBitmapSource* pSource, bool isRotated, bool flatten, UINT32 backgroundColor, DecodedImage& image)
+{
+	const UINT stripRows = 64;
+
+	if (isRotated) {
+		HRESULT hr = pSource->CopyPixels(nullptr, image.stride, image.stride * image.height, image.pixels.data());
+		if (FAILED(hr)) return hr;
+	}
+
+	std::vector<PixelPlane> planes;
+	planes.push_back({ image.pixels.data(), image.stride, image.width, image.height });
+	for (const auto& level : image.mipLevels) {
+		planes.push_back({ image.pixels.data() + level.offset, level.stride, level.width, level.height });
+	}
+	std::vector<uint32_t> doneRows(planes.size(), 0);
+
+	for (UINT row = 0; row < image.height; row += stripRows) {
+		UINT rows = std::min(stripRows, image.height - row);
+		auto strip = image.pixels.data() + (size_t)row * image.stride;
+		if (!isRotated) {
+			WICRect rect = { 0, (INT)row, (INT)image.width, (INT)rows };
+			HRESULT hr = pSource->CopyPixels(&rect, image.stride, image.stride * rows, strip);
+			if (FAILED(hr)) return hr;
+		}
+		if (flatten) {
+			FlattenToBackground(strip, (size_t)image.width * rows, backgroundColor);
+		}
+		doneRows[0] = row + rows;
+		BuildMipLevels(planes.data(), planes.size(), doneRows.data());
+	}
+	return S_OK;
+}
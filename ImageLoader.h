@@ -0,0 +1,119 @@
+#pragma once
+
+#include "framework.h"
+#include "DecodedImageCache.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <wincodec.h>
+
+class ImageInfo;
+class SettingsDialog;
+class TaskPool;
+
+// A smaller copy of a decoded photo, in the same pixel buffer after the full size one
+struct MipLevel {
+	UINT width = 0;
+	UINT height = 0;
+	UINT stride = 0;
+	size_t offset = 0;
+};
+
+// CPU-side pixels of a decoded photo, flattened onto the background color and
+// ready to be uploaded into an ID2D1Bitmap by the render thread.
+// When the window is (much) smaller than the decode size, mipLevels holds versions of half
+// the size of the one before, down to the size the photo is drawn at.
+struct DecodedImage {
+	ImageInfo* info = nullptr;
+	HRESULT hr = E_FAIL;
+	UINT width = 0;
+	UINT height = 0;
+	UINT frameWidth = 0; // Of the file, before rotation
+	UINT frameHeight = 0;
+	UINT stride = 0;
+	std::vector<BYTE> pixels;
+	std::vector<MipLevel> mipLevels;
+};
+
+// An image to decode, at (at least) the size it covers on screen at its largest zoom.
+// The view is the window it is drawn in now, which can be smaller than the screen.
+// The rotation is that of the info when the job was made, so the decode doesn't read
+// the info while the UI thread may be rotating it.
+struct DecodeJob {
+	ImageInfo* info = nullptr;
+	int rotation = -1; // -1 when not known yet
+	UINT targetWidth = 0;
+	UINT targetHeight = 0;
+	UINT viewWidth = 0;
+	UINT viewHeight = 0;
+};
+
+// Decodes photos on a worker thread, ahead of the display timer.
+// Images a window is waiting for are decoded first, then the images each monitor will
+// show next (PrefetchDepth of them), as long as the finished but not yet displayed
+// images fit in PrefetchMemoryMB.
+// Photos are decoded straight to the size they are displayed at, never at full
+// sensor resolution when the screen is smaller. Decoded images are kept in an LRU
+// cache of DecodeCacheMB, so a photo that was shown recently is not decoded again.
+// While a window waits for a photo, its embedded camera preview is decoded first, if
+// that covers at least PreviewMinFraction of the decode size, so there is something to
+// show before the (slow) full decode is done.
+// The photo infos are shared with the windows, which only touch them while holding
+// infoMutex; the worker holds it too when it reads or fills them in, never while decoding.
+class ImageLoader {
+public:
+	~ImageLoader() { Stop(); }
+
+	void Start(SettingsDialog& settings, TaskPool& tasks, std::mutex& infoMutex);
+	void Stop();
+	// Called, on any thread, when an image or preview is ready to be taken. Set before Start.
+	void SetOnReady(std::function<void()> onReady) { m_OnReady = std::move(onReady); }
+
+	// Ask for an image that is needed now.
+	void Request(const DecodeJob& job);
+	// Drop a request that is no longer needed.
+	void Cancel(ImageInfo* info);
+	// Replace the list of images a monitor shows next.
+	void Prefetch(int monitorIndex, const std::vector<DecodeJob>& upcoming);
+	// The decoded image, or null if it is not finished yet.
+	std::shared_ptr<DecodedImage> Take(ImageInfo* info);
+	// The decoded embedded preview of a requested image, or null. The request stays,
+	// so Take delivers the full image later.
+	std::shared_ptr<DecodedImage> TakePreview(ImageInfo* info);
+
+private:
+	// Down to a sixteenth, enough for the little preview in the screen saver settings
+	static constexpr size_t MaxMipLevels = 4;
+
+	void WorkerMain();
+	bool NextJob(DecodeJob& job);
+	bool IsWanted(ImageInfo* info) const;
+	void Purge();
+	static DecodedImageKey MakeKey(const DecodeJob& job);
+	static HRESULT Decode(IWICImagingFactory* pFactory, const DecodeJob& job, UINT32 backgroundColor, DecodedImage& image);
+	static HRESULT DecodePreview(IWICImagingFactory* pFactory, const DecodeJob& job, float minFraction, UINT32 backgroundColor, DecodedImage& image);
+	static HRESULT DecodeFrame(IWICImagingFactory* pFactory, IWICBitmapFrameDecode* pFrame, const DecodeJob& job, UINT32 backgroundColor, DecodedImage& image);
+	static void PlanMipLevels(const DecodeJob& job, DecodedImage& image);
+	static HRESULT CopyPixelsInStrips(IWICBitmapSource* pSource, bool isRotated, bool flatten, UINT32 backgroundColor, DecodedImage& image);
+
+	SettingsDialog* m_Settings = nullptr;
+	TaskPool* m_Tasks = nullptr;
+	std::mutex* m_InfoMutex = nullptr;
+	std::function<void()> m_OnReady;
+	std::thread m_Worker;
+	std::mutex m_Mutex;
+	std::condition_variable m_WakeUp;
+	bool m_Stopping = false;
+
+	std::deque<DecodeJob> m_Requested;
+	std::vector<std::vector<DecodeJob>> m_Upcoming;
+	std::unordered_map<ImageInfo*, std::shared_ptr<DecodedImage>> m_Ready;
+	std::unordered_map<ImageInfo*, std::shared_ptr<DecodedImage>> m_Previews;
+	ImageInfo* m_InFlight = nullptr;
+	size_t m_ReadyBytes = 0;
+	DecodedImageCache<DecodedImage> m_Cache;
+};
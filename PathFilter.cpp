@@ -0,0 +1,275 @@
+#include "PathFilter.h"
+
+#include <algorithm>
+#include <cwctype>
+
+namespace {
+	// towlower goes through the locale, most names are ASCII
+	wchar_t Lower(wchar_t c)
+	{
+		if (c < 0x80) {
+			return c >= L'A' && c <= L'Z' ? (wchar_t)(c + (L'a' - L'A')) : c;
+		}
+		return (wchar_t)std::towlower(c);
+	}
+
+	// Calls `visit` for every component of `path`. A trailing slash doesn't make another
+	// component, leading ones (\\server\share) do.
+	template<typename Visit>
+	void ForEachComponent(std::wstring_view path, Visit visit)
+	{
+		size_t start = 0;
+		while (start <= path.size()) {
+			auto end = path.find_first_of(L"\\/", start);
+			if (end == std::wstring_view::npos) {
+				end = path.size();
+			}
+
+			auto part = path.substr(start, end - start);
+			if (part.empty() && end == path.size() && start > 0) {
+				break;
+			}
+			visit(part);
+			start = end + 1;
+		}
+	}
+}
+
+PathFilter::PathFilter()
+{
+	AddNode();
+}
+
+void PathFilter::SetPatterns(const std::vector<std::wstring>& patterns)
+{
+	m_Nodes.clear();
+	AddNode();
+	m_IsEmpty = true;
+	for (const auto& pattern : patterns) {
+		if (!pattern.empty()) {
+			AddPattern(pattern);
+			m_IsEmpty = false;
+		}
+	}
+}
+
+PathFilter::Position PathFilter::Walk(std::wstring_view path) const
+{
+	Position position;
+	position.nodes.push_back(0);
+	Close(position);
+	ForEachComponent(path, [&](std::wstring_view part) {
+		if (!position.excluded) {
+			position = Enter(position, part);
+		}
+	});
+	return position;
+}
+
+PathFilter::Position PathFilter::Enter(const Position& directory, std::wstring_view name) const
+{
+	Position position;
+	position.excluded = directory.excluded;
+	if (position.excluded) {
+		return position;
+	}
+
+	wchar_t buffer[256];
+	std::wstring fallback;
+	auto lower = ToLower(name, buffer, fallback);
+	for (auto index : directory.nodes) {
+		Step(index, lower, [&position](uint32_t next) { position.nodes.push_back(next); });
+	}
+
+	Close(position);
+	std::sort(position.nodes.begin(), position.nodes.end());
+	position.nodes.erase(std::unique(position.nodes.begin(), position.nodes.end()), position.nodes.end());
+	position.excluded = std::any_of(position.nodes.begin(), position.nodes.end(), [this](uint32_t index) {
+		return m_Nodes[index].isEnd;
+	});
+	return position;
+}
+
+bool PathFilter::IsExcluded(const Position& directory, std::wstring_view name) const
+{
+	if (m_IsEmpty || directory.excluded) {
+		return directory.excluded;
+	}
+
+	wchar_t buffer[256];
+	std::wstring fallback;
+	auto lower = ToLower(name, buffer, fallback);
+	bool excluded = false;
+	for (auto index : directory.nodes) {
+		Step(index, lower, [this, &excluded](uint32_t next) {
+			// A "**" that ends a pattern matches zero components too
+			auto anyDepth = m_Nodes[next].anyDepth;
+			excluded = excluded || m_Nodes[next].isEnd || (anyDepth != None && m_Nodes[anyDepth].isEnd);
+		});
+	}
+	return excluded;
+}
+
+bool PathFilter::IsAbsolute(std::wstring_view pattern)
+{
+	return (pattern.size() >= 2 && pattern[1] == L':') ||
+		(pattern.size() >= 2 && (pattern[0] == L'\\' || pattern[0] == L'/') && (pattern[1] == L'\\' || pattern[1] == L'/'));
+}
+
+bool PathFilter::HasWildcards(std::wstring_view pattern)
+{
+	return pattern.find_first_of(L"*?") != std::wstring_view::npos;
+}
+
+uint32_t PathFilter::AddNode()
+{
+	m_Nodes.emplace_back();
+	return (uint32_t)(m_Nodes.size() - 1);
+}
+
+void PathFilter::AddPattern(std::wstring_view pattern)
+{
+	uint32_t node = 0;
+	auto addAnyDepth = [this, &node]() {
+		if (m_Nodes[node].isAnyDepth) {
+			return;
+		}
+		if (m_Nodes[node].anyDepth == None) {
+			auto child = AddNode();
+			m_Nodes[child].isAnyDepth = true;
+			m_Nodes[node].anyDepth = child;
+		}
+		node = m_Nodes[node].anyDepth;
+	};
+
+	if (!IsAbsolute(pattern)) {
+		addAnyDepth();
+	}
+
+	ForEachComponent(pattern, [&](std::wstring_view part) {
+		if (part == L"**") {
+			addAnyDepth();
+			return;
+		}
+
+		auto lower = ToLower(part);
+		if (HasWildcards(lower)) {
+			auto& globs = lower[0] == L'*' || lower[0] == L'?' ? m_Nodes[node].wildGlobs : m_Nodes[node].globs;
+			auto it = std::lower_bound(globs.begin(), globs.end(), lower, [](const auto& glob, const std::wstring& value) {
+				return glob.first < value;
+			});
+			if (it != globs.end() && it->first == lower) {
+				node = it->second;
+			}
+			else {
+				// AddNode can move the nodes, and `globs` with them
+				auto at = it - globs.begin();
+				bool isWild = &globs == &m_Nodes[node].wildGlobs;
+				auto child = AddNode();
+				auto& sorted = isWild ? m_Nodes[node].wildGlobs : m_Nodes[node].globs;
+				sorted.emplace(sorted.begin() + at, std::move(lower), child);
+				node = child;
+			}
+			return;
+		}
+
+		auto it = m_Nodes[node].children.find(lower);
+		if (it != m_Nodes[node].children.end()) {
+			node = it->second;
+		}
+		else {
+			auto child = AddNode();
+			m_Nodes[node].children.emplace(std::move(lower), child);
+			node = child;
+		}
+	});
+
+	m_Nodes[node].isEnd = true;
+}
+
+template<typename Visit>
+void PathFilter::Step(uint32_t index, std::wstring_view lower, Visit visit) const
+{
+	const auto& node = m_Nodes[index];
+	if (node.isAnyDepth) {
+		// Takes the component and stays
+		visit(index);
+	}
+
+	auto child = node.children.find(lower);
+	if (child != node.children.end()) {
+		visit(child->second);
+	}
+
+	if (!lower.empty()) {
+		auto first = std::lower_bound(node.globs.begin(), node.globs.end(), lower[0], [](const auto& glob, wchar_t c) {
+			return glob.first[0] < c;
+		});
+		for (auto it = first; it != node.globs.end() && it->first[0] == lower[0]; ++it) {
+			if (MatchGlob(it->first, lower)) {
+				visit(it->second);
+			}
+		}
+	}
+
+	for (const auto& [glob, next] : node.wildGlobs) {
+		if (MatchGlob(glob, lower)) {
+			visit(next);
+		}
+	}
+}
+
+void PathFilter::Close(Position& position) const
+{
+	for (size_t i = 0; i < position.nodes.size(); ++i) {
+		auto anyDepth = m_Nodes[position.nodes[i]].anyDepth;
+		if (anyDepth != None && std::find(position.nodes.begin(), position.nodes.end(), anyDepth) == position.nodes.end()) {
+			position.nodes.push_back(anyDepth);
+		}
+	}
+}
+
+bool PathFilter::MatchGlob(std::wstring_view glob, std::wstring_view name)
+{
+	// Backtracks to the last '*' only, which is enough for a single component
+	size_t g = 0, n = 0, star = std::wstring_view::npos, resume = 0;
+	while (n < name.size()) {
+		if (g < glob.size() && (glob[g] == L'?' || glob[g] == name[n])) {
+			++g;
+			++n;
+		}
+		else if (g < glob.size() && glob[g] == L'*') {
+			star = g++;
+			resume = n;
+		}
+		else if (star != std::wstring_view::npos) {
+			g = star + 1;
+			n = ++resume;
+		}
+		else {
+			return false;
+		}
+	}
+	while (g < glob.size() && glob[g] == L'*') {
+		++g;
+	}
+	return g == glob.size();
+}
+
+std::wstring PathFilter::ToLower(std::wstring_view str)
+{
+	std::wstring lower(str);
+	std::transform(lower.begin(), lower.end(), lower.begin(), Lower);
+	return lower;
+}
+
+std::wstring_view PathFilter::ToLower(std::wstring_view str, wchar_t (&buffer)[256], std::wstring& fallback)
+{
+	if (str.size() > std::size(buffer)) {
+		fallback = ToLower(str);
+		return fallback;
+	}
+
+	std::transform(str.begin(), str.end(), buffer, Lower);
+	return std::wstring_view(buffer, str.size());
+}
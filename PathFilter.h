@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// The exclude list, as a trie of lower case path components, so a path is checked in one
+// walk down the tree whatever the number of patterns. A path is excluded when it, or any
+// folder above it, matches a pattern.
+// Patterns are case-insensitive, '/' and '\' are the same and trailing slashes don't matter.
+// A component can hold the wildcards '*' and '?', and "**" stands for any number of
+// components. Patterns without a drive or a leading "\\" match at any depth, so
+// "*\Screenshots" and "Screenshots" both exclude every folder called Screenshots.
+// The crawl keeps the Position of each directory, so its entries are checked with a
+// single step instead of the whole path.
+// After SetPatterns it is read-only, so checks from several threads are safe.
+class PathFilter {
+public:
+	// Where a path ends up in the trie
+	struct Position {
+		std::vector<uint32_t> nodes;
+		bool excluded = false;
+	};
+
+	PathFilter();
+	void SetPatterns(const std::vector<std::wstring>& patterns);
+	bool IsEmpty() const { return m_IsEmpty; }
+
+	Position Walk(std::wstring_view path) const;
+	Position Enter(const Position& directory, std::wstring_view name) const;
+	bool IsExcluded(std::wstring_view path) const { return !m_IsEmpty && Walk(path).excluded; }
+	// Same as Enter(directory, name).excluded, without building the Position
+	bool IsExcluded(const Position& directory, std::wstring_view name) const;
+
+	static bool IsAbsolute(std::wstring_view pattern);
+	static bool HasWildcards(std::wstring_view pattern);
+
+private:
+	static constexpr uint32_t None = UINT32_MAX;
+
+	// Looks up a std::wstring_view without making a std::wstring of it
+	struct Hash {
+		using is_transparent = void;
+		size_t operator()(std::wstring_view str) const { return std::hash<std::wstring_view>()(str); }
+	};
+
+	struct Node {
+		std::unordered_map<std::wstring, uint32_t, Hash, std::equal_to<>> children; // Components without wildcards
+		// Sorted, so only those with the same first letter as the name are tried. Those
+		// starting with a wildcard are tried for every name.
+		std::vector<std::pair<std::wstring, uint32_t>> globs;
+		std::vector<std::pair<std::wstring, uint32_t>> wildGlobs;
+		uint32_t anyDepth = None; // The "**" child
+		bool isAnyDepth = false;
+		bool isEnd = false; // A pattern ends here
+	};
+
+	uint32_t AddNode();
+	void AddPattern(std::wstring_view pattern);
+	// Adds the "**" children, which also match zero components
+	void Close(Position& position) const;
+	// Calls `visit` with every node `name` leads to from `index`, before Close
+	template<typename Visit>
+	void Step(uint32_t index, std::wstring_view lower, Visit visit) const;
+	static bool MatchGlob(std::wstring_view glob, std::wstring_view name);
+	static std::wstring ToLower(std::wstring_view str);
+	// Into `buffer` when it fits, which it does for any NTFS name
+	static std::wstring_view ToLower(std::wstring_view str, wchar_t (&buffer)[256], std::wstring& fallback);
+
+	std::vector<Node> m_Nodes; // 0 is the root
+	bool m_IsEmpty = true;
+};
@@ -0,0 +1,182 @@
+#include "PhotoCatalog.h"
+
+#include <algorithm>
+
+PhotoCatalog::PhotoCatalog()
+{
+	// Ids 0 and 1 are UnknownLocation and NoLocation
+	m_Locations.resize(2);
+}
+
+uint32_t PhotoCatalog::AddFolder(std::wstring_view path)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	uint32_t folder = NoFolder;
+	size_t start = 0;
+	while (start <= path.size()) {
+		auto end = path.find_first_of(L"\\/", start);
+		if (end == std::wstring_view::npos) {
+			end = path.size();
+		}
+
+		// A trailing slash doesn't make another level, leading ones (\\server\share) do
+		auto part = path.substr(start, end - start);
+		if (part.empty() && end == path.size() && start > 0) {
+			break;
+		}
+
+		auto hash = HashChild(folder, part);
+		auto [first, last] = m_FolderLookup.equal_range(hash);
+		auto found = std::find_if(first, last, [&](const auto& entry) {
+			const auto& candidate = m_Folders[entry.second];
+			return candidate.parent == folder && GetString(candidate.name) == part;
+		});
+
+		if (found != last) {
+			folder = found->second;
+		}
+		else {
+			auto id = (uint32_t)m_Folders.size();
+			m_Folders.push_back({ folder, AddString(part) });
+			m_FolderLookup.emplace(hash, id);
+			folder = id;
+		}
+		start = end + 1;
+	}
+	return folder;
+}
+
+uint32_t PhotoCatalog::AddName(std::wstring_view name)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return AddString(name);
+}
+
+uint32_t PhotoCatalog::AddLocation(std::string_view location)
+{
+	if (location.empty()) {
+		return NoLocation;
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto it = m_LocationLookup.find(location);
+	if (it != m_LocationLookup.end()) {
+		return it->second;
+	}
+
+	auto id = (uint32_t)m_Locations.size();
+	m_Locations.emplace_back(location);
+	m_LocationLookup.emplace(m_Locations.back(), id);
+	return id;
+}
+
+std::wstring PhotoCatalog::GetFolderPath(uint32_t folder) const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	std::wstring path;
+	AppendFolderPath(folder, path);
+	return path;
+}
+
+std::wstring PhotoCatalog::GetFolderName(uint32_t folder) const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (folder >= m_Folders.size()) {
+		return {};
+	}
+	return std::wstring(GetString(m_Folders[folder].name));
+}
+
+std::wstring PhotoCatalog::GetName(uint32_t name) const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return std::wstring(GetString(name));
+}
+
+std::wstring PhotoCatalog::GetPath(uint32_t folder, uint32_t name) const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	std::wstring path;
+	AppendFolderPath(folder, path);
+	if (!path.empty() && path.back() != L'\\') {
+		path += L'\\';
+	}
+	path += GetString(name);
+	return path;
+}
+
+std::string PhotoCatalog::GetLocation(uint32_t location) const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (location >= m_Locations.size()) {
+		return {};
+	}
+	return m_Locations[location];
+}
+
+size_t PhotoCatalog::FolderCount() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Folders.size();
+}
+
+size_t PhotoCatalog::LocationCount() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Locations.size();
+}
+
+size_t PhotoCatalog::MemoryUsage() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	size_t bytes = m_Chars.capacity() * sizeof(wchar_t) + m_Folders.capacity() * sizeof(Folder);
+	// A node and a bucket per entry, roughly
+	bytes += m_FolderLookup.size() * (sizeof(void*) * 2 + sizeof(size_t) + sizeof(uint32_t));
+	bytes += m_FolderLookup.bucket_count() * sizeof(void*);
+	for (const auto& location : m_Locations) {
+		bytes += sizeof(std::string) + location.capacity();
+	}
+	bytes += m_LocationLookup.size() * (sizeof(void*) * 2 + sizeof(std::string_view) + sizeof(uint32_t));
+	bytes += m_LocationLookup.bucket_count() * sizeof(void*);
+	return bytes;
+}
+
+uint32_t PhotoCatalog::AddString(std::wstring_view str)
+{
+	auto offset = (uint32_t)m_Chars.size();
+	m_Chars.insert(m_Chars.end(), str.begin(), str.end());
+	m_Chars.push_back(L'\0');
+	return offset;
+}
+
+std::wstring_view PhotoCatalog::GetString(uint32_t offset) const
+{
+	if (offset >= m_Chars.size()) {
+		return {};
+	}
+	return std::wstring_view(m_Chars.data() + offset);
+}
+
+void PhotoCatalog::AppendFolderPath(uint32_t folder, std::wstring& path) const
+{
+	if (folder >= m_Folders.size()) {
+		return;
+	}
+
+	// Root first
+	std::vector<uint32_t> chain;
+	for (auto f = folder; f != NoFolder; f = m_Folders[f].parent) {
+		chain.push_back(f);
+	}
+	for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+		if (it != chain.rbegin()) {
+			path += L'\\';
+		}
+		path += GetString(m_Folders[*it].name);
+	}
+}
+
+size_t PhotoCatalog::HashChild(uint32_t parent, std::wstring_view name)
+{
+	return std::hash<std::wstring_view>()(name) ^ ((size_t)parent * 0x9E3779B97F4A7C15ull);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// The strings of the photo library, each kept once. Directories are a tree of nodes that
+// name their parent, so a path prefix shared by thousands of photos is stored one time;
+// file names sit NUL-terminated in one arena of characters, and locations, which many
+// photos share, in a table. ImageInfo holds 32-bit ids into all of these, and the wide
+// strings are only put together when they are needed: for the file that is opened and
+// the caption on screen.
+// Nothing is ever removed; the names of deleted files stay until the process exits.
+// Every call locks, so the scan threads can add while other threads read.
+class PhotoCatalog {
+public:
+	static constexpr uint32_t NoFolder = UINT32_MAX;
+	static constexpr uint32_t UnknownLocation = 0; // Not looked up yet
+	static constexpr uint32_t NoLocation = 1; // Looked up, nothing found
+
+	PhotoCatalog();
+
+	// Splits on both kinds of slash; the path is put back together with backslashes
+	uint32_t AddFolder(std::wstring_view path);
+	uint32_t AddName(std::wstring_view name);
+	// UTF-8. Empty gives NoLocation.
+	uint32_t AddLocation(std::string_view location);
+
+	std::wstring GetFolderPath(uint32_t folder) const;
+	std::wstring GetFolderName(uint32_t folder) const;
+	std::wstring GetName(uint32_t name) const;
+	std::wstring GetPath(uint32_t folder, uint32_t name) const;
+	// Empty for UnknownLocation and NoLocation
+	std::string GetLocation(uint32_t location) const;
+
+	size_t FolderCount() const;
+	size_t LocationCount() const;
+	// Bytes used by the folders, names and locations
+	size_t MemoryUsage() const;
+
+private:
+	struct Folder {
+		uint32_t parent;
+		uint32_t name; // Offset in m_Chars
+	};
+
+	uint32_t AddString(std::wstring_view str);
+	std::wstring_view GetString(uint32_t offset) const;
+	void AppendFolderPath(uint32_t folder, std::wstring& path) const;
+	static size_t HashChild(uint32_t parent, std::wstring_view name);
+
+	mutable std::mutex m_Mutex;
+	std::vector<wchar_t> m_Chars;
+	std::vector<Folder> m_Folders;
+	std::unordered_multimap<size_t, uint32_t> m_FolderLookup; // HashChild to folder
+	std::deque<std::string> m_Locations; // A deque, so the views in m_LocationLookup stay valid
+	std::unordered_map<std::string_view, uint32_t> m_LocationLookup;
+};
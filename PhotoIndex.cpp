@@ -0,0 +1,276 @@
+#include "PhotoIndex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace {
+	class IndexWriter {
+	public:
+		std::string buffer;
+
+		template<typename T>
+		void Write(T value) {
+			buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		void Write(const std::wstring& str) {
+			Write((uint32_t)str.size());
+			buffer.append(reinterpret_cast<const char*>(str.data()), str.size() * sizeof(wchar_t));
+		}
+
+		void Write(const std::string& str) {
+			Write((uint32_t)str.size());
+			buffer.append(str);
+		}
+	};
+
+	class IndexReader {
+	public:
+		const std::vector<char>& data;
+		size_t pos = 0;
+		bool ok = true;
+
+		explicit IndexReader(const std::vector<char>& d) : data(d) {}
+
+		template<typename T>
+		T Read() {
+			T value = {};
+			if (!ok || data.size() - pos < sizeof(T)) {
+				ok = false;
+				return value;
+			}
+			memcpy(&value, data.data() + pos, sizeof(T));
+			pos += sizeof(T);
+			return value;
+		}
+
+		std::wstring ReadString() {
+			auto len = Read<uint32_t>();
+			if (!ok || (data.size() - pos) / sizeof(wchar_t) < len) {
+				ok = false;
+				return {};
+			}
+			std::wstring str(len, L'\0');
+			memcpy(str.data(), data.data() + pos, len * sizeof(wchar_t));
+			pos += len * sizeof(wchar_t);
+			return str;
+		}
+
+		std::string ReadUtf8() {
+			auto len = Read<uint32_t>();
+			if (!ok || data.size() - pos < len) {
+				ok = false;
+				return {};
+			}
+			std::string str(data.data() + pos, len);
+			pos += len;
+			return str;
+		}
+	};
+}
+
+bool PhotoIndex::Load(const std::wstring& indexFile, ImageFolderMap& folders, PlaylistState& playlist)
+{
+	std::ifstream fin(std::filesystem::path(indexFile), std::ios::binary | std::ios::ate);
+	if (!fin) {
+		return false;
+	}
+
+	std::vector<char> data((size_t)fin.tellg());
+	fin.seekg(0);
+	if (!fin.read(data.data(), data.size())) {
+		return false;
+	}
+
+	IndexReader in(data);
+	if (in.Read<uint32_t>() != Magic || in.Read<uint32_t>() != Version) {
+		std::wcerr << L"Ignoring photo index \"" << indexFile << L"\" with unknown version" << std::endl;
+		return false;
+	}
+
+	PlaylistState state;
+	state.seed = in.Read<uint64_t>();
+	state.position = in.Read<uint32_t>();
+	state.count = in.Read<uint32_t>();
+
+	// Ids in the file to ids in the catalog
+	auto& catalog = ImageInfo::Catalog();
+	std::vector<uint32_t> locations;
+	auto numLocations = in.Read<uint32_t>();
+	for (uint32_t i = 0; i < numLocations && in.ok; ++i) {
+		// The first two are UnknownLocation and NoLocation, written as empty strings
+		auto location = in.ReadUtf8();
+		locations.push_back(i < 2 ? i : catalog.AddLocation(location));
+	}
+
+	ImageFolderMap loaded;
+	auto numFolders = in.Read<uint32_t>();
+	for (uint32_t f = 0; f < numFolders && in.ok; ++f) {
+		auto path = in.ReadString();
+		auto& folder = loaded[path];
+		auto folderId = catalog.AddFolder(path);
+
+		folder.lastWriteTime = in.Read<uint64_t>();
+		auto numSubdirs = in.Read<uint32_t>();
+		for (uint32_t i = 0; i < numSubdirs && in.ok; ++i) {
+			folder.subdirectories.push_back(in.ReadString());
+		}
+
+		auto numImages = in.Read<uint32_t>();
+		for (uint32_t i = 0; i < numImages && in.ok; ++i) {
+			ImageInfo* info = ImageInfo::Create();
+			auto number = in.Read<uint32_t>();
+			info->idx = number < state.count ? (int)number : -1;
+			info->folder = folderId;
+			info->name = catalog.AddName(in.ReadString());
+			info->fileSize = in.Read<uint64_t>();
+			info->lastWriteTime = in.Read<uint64_t>();
+			info->date = in.Read<uint32_t>();
+			info->rotation = in.Read<int32_t>();
+			auto location = in.Read<uint32_t>();
+			info->location = location < locations.size() ? locations[location] : PhotoCatalog::UnknownLocation;
+			info->width = in.Read<uint32_t>();
+			info->height = in.Read<uint32_t>();
+			info->decodeError = in.Read<int32_t>();
+			folder.images.push_back(info);
+		}
+	}
+
+	if (!in.ok) {
+		std::wcerr << L"Photo index \"" << indexFile << L"\" is truncated" << std::endl;
+		for (auto& [path, folder] : loaded) {
+			for (auto* info : folder.images) {
+				ImageInfo::Destroy(info);
+			}
+		}
+		return false;
+	}
+
+	folders = std::move(loaded);
+	playlist = state;
+	return true;
+}
+
+bool PhotoIndex::Save(const std::wstring& indexFile, const ImageFolderMap& folders, PlaylistState playlist, bool fillHoles)
+{
+	// Numbers below playlist.count stay, so the order of those photos is the same next time
+	int maxNumber = -1;
+	size_t numUnnumbered = 0;
+	for (const auto& [path, folder] : folders) {
+		for (const auto* info : folder.images) {
+			maxNumber = std::max(maxNumber, info->idx);
+			numUnnumbered += info->idx < 0 ? 1 : 0;
+		}
+	}
+	std::vector<bool> isUsed(std::max((size_t)(maxNumber + 1), (size_t)playlist.count), false);
+	for (const auto& [path, folder] : folders) {
+		for (const auto* info : folder.images) {
+			if (info->idx >= 0) {
+				isUsed[(size_t)info->idx] = true;
+			}
+		}
+	}
+
+	// New photos go into the holes first, then after the existing numbers
+	std::vector<uint32_t> holes;
+	if (fillHoles) {
+		for (uint32_t number = playlist.count; number-- > 0;) {
+			if (!isUsed[number]) {
+				holes.push_back(number);
+			}
+		}
+	}
+	auto nextNumber = playlist.count;
+	auto newNumber = [&holes, &nextNumber]() {
+		if (holes.empty()) {
+			return nextNumber++;
+		}
+		auto number = holes.back();
+		holes.pop_back();
+		return number;
+	};
+
+	std::vector<uint32_t> newNumbers(isUsed.size(), 0);
+	for (size_t number = 0; number < isUsed.size(); ++number) {
+		if (number < playlist.count) {
+			newNumbers[number] = (uint32_t)number;
+		}
+		else if (isUsed[number]) {
+			newNumbers[number] = newNumber();
+		}
+	}
+	// Those that never got one, numbered while writing
+	std::vector<uint32_t> unnumbered(numUnnumbered);
+	for (auto& number : unnumbered) {
+		number = newNumber();
+	}
+	auto nextUnnumbered = unnumbered.begin();
+
+	playlist.count = nextNumber;
+	if (playlist.count > 0) {
+		playlist.position %= playlist.count;
+	}
+
+	IndexWriter out;
+	out.Write(Magic);
+	out.Write(Version);
+	out.Write(playlist.seed);
+	out.Write(playlist.position);
+	out.Write(playlist.count);
+
+	// Every location of the catalog, the file refers to them by index
+	auto& catalog = ImageInfo::Catalog();
+	auto numLocations = (uint32_t)catalog.LocationCount();
+	out.Write(numLocations);
+	for (uint32_t i = 0; i < numLocations; ++i) {
+		out.Write(catalog.GetLocation(i));
+	}
+
+	out.Write((uint32_t)folders.size());
+
+	for (const auto& [path, folder] : folders) {
+		out.Write(path);
+		out.Write(folder.lastWriteTime);
+		out.Write((uint32_t)folder.subdirectories.size());
+		for (const auto& subdir : folder.subdirectories) {
+			out.Write(subdir);
+		}
+
+		out.Write((uint32_t)folder.images.size());
+		for (const auto* info : folder.images) {
+			out.Write(info->idx >= 0 ? newNumbers[(size_t)info->idx] : *nextUnnumbered++);
+			out.Write(catalog.GetName(info->name));
+			out.Write(info->fileSize);
+			out.Write(info->lastWriteTime);
+			out.Write(info->date);
+			out.Write((int32_t)info->rotation);
+			// A location lookup that is still in flight is retried next session
+			out.Write(info->isCaching || info->location >= numLocations ? PhotoCatalog::UnknownLocation : info->location);
+			out.Write(info->width);
+			out.Write(info->height);
+			out.Write((int32_t)info->decodeError);
+		}
+	}
+
+	// Write next to the old index and swap, so a crash never leaves a half-written file
+	auto tempFile = indexFile + L".tmp";
+	{
+		std::ofstream fout(std::filesystem::path(tempFile), std::ios::binary | std::ios::trunc);
+		if (!fout.write(out.buffer.data(), out.buffer.size())) {
+			std::wcerr << L"Error writing photo index \"" << tempFile << L"\"" << std::endl;
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempFile, indexFile, error);
+	if (error) {
+		std::wcerr << L"Error replacing photo index \"" << indexFile << L"\": " << error.value() << std::endl;
+		return false;
+	}
+	return true;
+}
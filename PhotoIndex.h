@@ -0,0 +1,23 @@
+#pragma once
+
+#include "ImageInfo.h"
+#include <cstdint>
+#include <string>
+
+// On-disk cache of the scanned library: every directory with its last write time, its
+// subdirectories and the images in it, including the metadata (date, rotation, location,
+// dimensions) that was extracted in earlier sessions, and why WIC couldn't decode it if it
+// couldn't, so a broken file isn't tried again until it changes. Dates are stored packed and locations
+// as ids into a table at the start, like ImageInfo keeps them. The playlist state and every
+// photo's number in it are kept too. Numbers don't change, so the order doesn't either; only
+// photos numbered from playlist.count on (new ones) are moved into the holes removed photos
+// left, and only when fillHoles says that the holes are known to be free.
+// The file is versioned; a file with another version is ignored and triggers a cold scan.
+class PhotoIndex {
+public:
+	static const uint32_t Magic = 0x58494350; // "PCIX"
+	static const uint32_t Version = 4;
+
+	static bool Load(const std::wstring& indexFile, ImageFolderMap& folders, PlaylistState& playlist);
+	static bool Save(const std::wstring& indexFile, const ImageFolderMap& folders, PlaylistState playlist, bool fillHoles);
+};
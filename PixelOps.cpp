@@ -0,0 +1,320 @@
+#include "PixelOps.h"
+
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PIXELOPS_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define PIXELOPS_TARGET_SSE2
+#define PIXELOPS_TARGET_AVX2
+#else
+#define PIXELOPS_TARGET_SSE2 __attribute__((target("sse2")))
+#define PIXELOPS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// x / 255 rounded to nearest, exact for 0 <= x <= 255 * 255
+static inline uint32_t Div255(uint32_t x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+void FlattenToBackgroundScalar(uint8_t* pixels, size_t count, uint32_t backgroundColor)
+{
+	const uint32_t bg[3] = { backgroundColor & 0xFF, (backgroundColor >> 8) & 0xFF, (backgroundColor >> 16) & 0xFF };
+
+	for (size_t i = 0; i < count; ++i) {
+		uint8_t* pixel = pixels + i * 4;
+		uint32_t inv = 255 - pixel[3];
+		if (inv == 0) {
+			continue;
+		}
+
+		for (int c = 0; c < 3; ++c) {
+			uint32_t v = pixel[c] + Div255(inv * bg[c]);
+			pixel[c] = (uint8_t)(v > 255 ? 255 : v); // Saturate colors that were not premultiplied
+		}
+		pixel[3] = 255;
+	}
+}
+
+// Destination pixels [fromX, toX) of one row, from the source rows row0 and row1
+static inline void Downsample2xRowScalar(const uint8_t* row0, const uint8_t* row1, uint32_t srcWidth, uint8_t* out, uint32_t fromX, uint32_t toX)
+{
+	for (uint32_t x = fromX; x < toX; ++x) {
+		uint32_t x0 = 2 * x * 4;
+		uint32_t x1 = std::min(2 * x + 1, srcWidth - 1) * 4;
+		for (int c = 0; c < 4; ++c) {
+			out[x * 4 + c] = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+		}
+	}
+}
+
+void Downsample2xScalar(const uint8_t* src, size_t srcStride, uint32_t srcWidth, uint32_t srcHeight,
+	uint8_t* dst, size_t dstStride, uint32_t firstRow, uint32_t rowCount)
+{
+	uint32_t dstWidth = (srcWidth + 1) / 2;
+	for (uint32_t y = firstRow; y < firstRow + rowCount; ++y) {
+		const uint8_t* row0 = src + (size_t)(2 * y) * srcStride;
+		const uint8_t* row1 = src + (size_t)std::min(2 * y + 1, srcHeight - 1) * srcStride;
+		Downsample2xRowScalar(row0, row1, srcWidth, dst + (size_t)y * dstStride, 0, dstWidth);
+	}
+}
+
+#ifdef PIXELOPS_X86
+
+PIXELOPS_TARGET_SSE2
+static inline __m128i Blend16SSE2(__m128i c, __m128i bg)
+{
+	// Broadcast alpha to all four channels of each pixel
+	__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	__m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), a);
+	__m128i x = _mm_add_epi16(_mm_mullo_epi16(inv, bg), _mm_set1_epi16(128));
+	__m128i div = _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+	return _mm_add_epi16(c, div);
+}
+
+PIXELOPS_TARGET_SSE2
+void FlattenToBackgroundSSE2(uint8_t* pixels, size_t count, uint32_t backgroundColor)
+{
+	// The background of the alpha channel is 255, which makes every pixel opaque
+	const __m128i bg = _mm_setr_epi16(
+		(short)(backgroundColor & 0xFF), (short)((backgroundColor >> 8) & 0xFF), (short)((backgroundColor >> 16) & 0xFF), 255,
+		(short)(backgroundColor & 0xFF), (short)((backgroundColor >> 8) & 0xFF), (short)((backgroundColor >> 16) & 0xFF), 255);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi8(-1);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i* p = reinterpret_cast<__m128i*>(pixels + i * 4);
+		__m128i v = _mm_loadu_si128(p);
+
+		// Skip blocks of opaque pixels
+		if ((_mm_movemask_epi8(_mm_cmpeq_epi8(v, ones)) & 0x8888) == 0x8888) {
+			continue;
+		}
+
+		__m128i lo = Blend16SSE2(_mm_unpacklo_epi8(v, zero), bg);
+		__m128i hi = Blend16SSE2(_mm_unpackhi_epi8(v, zero), bg);
+		_mm_storeu_si128(p, _mm_packus_epi16(lo, hi));
+	}
+
+	FlattenToBackgroundScalar(pixels + i * 4, count - i, backgroundColor);
+}
+
+// Sums of four source pixels (two columns of two rows) in 16 bits, rounded and divided by 4
+PIXELOPS_TARGET_SSE2
+static inline __m128i Average2x2SSE2(__m128i top, __m128i bottom)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero)); // Pixels 0, 1
+	__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero)); // Pixels 2, 3
+	__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi)); // 0 + 1, 2 + 3
+	return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+PIXELOPS_TARGET_SSE2
+void Downsample2xSSE2(const uint8_t* src, size_t srcStride, uint32_t srcWidth, uint32_t srcHeight,
+	uint8_t* dst, size_t dstStride, uint32_t firstRow, uint32_t rowCount)
+{
+	uint32_t dstWidth = (srcWidth + 1) / 2;
+	uint32_t pairs = srcWidth / 2; // Destination pixels with two source columns
+	for (uint32_t y = firstRow; y < firstRow + rowCount; ++y) {
+		const uint8_t* row0 = src + (size_t)(2 * y) * srcStride;
+		const uint8_t* row1 = src + (size_t)std::min(2 * y + 1, srcHeight - 1) * srcStride;
+		uint8_t* out = dst + (size_t)y * dstStride;
+
+		uint32_t x = 0;
+		for (; x + 4 <= pairs; x += 4) {
+			const __m128i* p0 = reinterpret_cast<const __m128i*>(row0 + x * 8);
+			const __m128i* p1 = reinterpret_cast<const __m128i*>(row1 + x * 8);
+			__m128i a = Average2x2SSE2(_mm_loadu_si128(p0), _mm_loadu_si128(p1));
+			__m128i b = Average2x2SSE2(_mm_loadu_si128(p0 + 1), _mm_loadu_si128(p1 + 1));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(a, b));
+		}
+
+		Downsample2xRowScalar(row0, row1, srcWidth, out, x, dstWidth);
+	}
+}
+
+PIXELOPS_TARGET_AVX2
+static inline __m256i Blend16AVX2(__m256i c, __m256i bg)
+{
+	__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	__m256i inv = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+	__m256i x = _mm256_add_epi16(_mm256_mullo_epi16(inv, bg), _mm256_set1_epi16(128));
+	__m256i div = _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+	return _mm256_add_epi16(c, div);
+}
+
+PIXELOPS_TARGET_AVX2
+void FlattenToBackgroundAVX2(uint8_t* pixels, size_t count, uint32_t backgroundColor)
+{
+	const short b = (short)(backgroundColor & 0xFF);
+	const short g = (short)((backgroundColor >> 8) & 0xFF);
+	const short r = (short)((backgroundColor >> 16) & 0xFF);
+	const __m256i bg = _mm256_setr_epi16(b, g, r, 255, b, g, r, 255, b, g, r, 255, b, g, r, 255);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ones = _mm256_set1_epi8(-1);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i* p = reinterpret_cast<__m256i*>(pixels + i * 4);
+		__m256i v = _mm256_loadu_si256(p);
+
+		// Skip blocks of opaque pixels
+		if (((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, ones)) & 0x88888888u) == 0x88888888u) {
+			continue;
+		}
+
+		// Unpack and pack both work per 128-bit lane, so the pixel order is preserved
+		__m256i lo = Blend16AVX2(_mm256_unpacklo_epi8(v, zero), bg);
+		__m256i hi = Blend16AVX2(_mm256_unpackhi_epi8(v, zero), bg);
+		_mm256_storeu_si256(p, _mm256_packus_epi16(lo, hi));
+	}
+
+	FlattenToBackgroundSSE2(pixels + i * 4, count - i, backgroundColor);
+}
+
+PIXELOPS_TARGET_AVX2
+static inline __m256i Average2x2AVX2(__m256i top, __m256i bottom)
+{
+	// Like the SSE2 version, per 128-bit lane
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(top, zero), _mm256_unpacklo_epi8(bottom, zero));
+	__m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(top, zero), _mm256_unpackhi_epi8(bottom, zero));
+	__m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+	return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+}
+
+PIXELOPS_TARGET_AVX2
+void Downsample2xAVX2(const uint8_t* src, size_t srcStride, uint32_t srcWidth, uint32_t srcHeight,
+	uint8_t* dst, size_t dstStride, uint32_t firstRow, uint32_t rowCount)
+{
+	uint32_t dstWidth = (srcWidth + 1) / 2;
+	uint32_t pairs = srcWidth / 2;
+	for (uint32_t y = firstRow; y < firstRow + rowCount; ++y) {
+		const uint8_t* row0 = src + (size_t)(2 * y) * srcStride;
+		const uint8_t* row1 = src + (size_t)std::min(2 * y + 1, srcHeight - 1) * srcStride;
+		uint8_t* out = dst + (size_t)y * dstStride;
+
+		uint32_t x = 0;
+		for (; x + 8 <= pairs; x += 8) {
+			const __m256i* p0 = reinterpret_cast<const __m256i*>(row0 + x * 8);
+			const __m256i* p1 = reinterpret_cast<const __m256i*>(row1 + x * 8);
+			__m256i a = Average2x2AVX2(_mm256_loadu_si256(p0), _mm256_loadu_si256(p1));
+			__m256i b = Average2x2AVX2(_mm256_loadu_si256(p0 + 1), _mm256_loadu_si256(p1 + 1));
+			// The pack interleaves the lanes: put the four pairs of pixels back in order
+			__m256i packed = _mm256_packus_epi16(a, b);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x * 4), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+		}
+
+		Downsample2xRowScalar(row0, row1, srcWidth, out, x, dstWidth);
+	}
+}
+
+bool CpuHasSSE2()
+{
+#if defined(_M_X64) || defined(__x86_64__)
+	return true;
+#elif defined(_MSC_VER)
+	int regs[4];
+	__cpuid(regs, 1);
+	return (regs[3] & (1 << 26)) != 0;
+#else
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+bool CpuHasAVX2()
+{
+#if defined(_MSC_VER)
+	int regs[4];
+	__cpuid(regs, 0);
+	if (regs[0] < 7) {
+		return false;
+	}
+
+	// The OS has to save the YMM registers too
+	__cpuid(regs, 1);
+	bool osxsave = (regs[2] & (1 << 27)) != 0;
+	if (!osxsave || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+
+	__cpuidex(regs, 7, 0);
+	return (regs[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#else
+
+void FlattenToBackgroundSSE2(uint8_t* pixels, size_t count, uint32_t backgroundColor)
+{
+	FlattenToBackgroundScalar(pixels, count, backgroundColor);
+}
+
+void FlattenToBackgroundAVX2(uint8_t* pixels, size_t count, uint32_t backgroundColor)
+{
+	FlattenToBackgroundScalar(pixels, count, backgroundColor);
+}
+
+void Downsample2xSSE2(const uint8_t* src, size_t srcStride, uint32_t srcWidth, uint32_t srcHeight,
+	uint8_t* dst, size_t dstStride, uint32_t firstRow, uint32_t rowCount)
+{
+	Downsample2xScalar(src, srcStride, srcWidth, srcHeight, dst, dstStride, firstRow, rowCount);
+}
+
+void Downsample2xAVX2(const uint8_t* src, size_t srcStride, uint32_t srcWidth, uint32_t srcHeight,
+	uint8_t* dst, size_t dstStride, uint32_t firstRow, uint32_t rowCount)
+{
+	Downsample2xScalar(src, srcStride, srcWidth, srcHeight, dst, dstStride, firstRow, rowCount);
+}
+
+bool CpuHasSSE2() { return false; }
+bool CpuHasAVX2() { return false; }
+
+#endif
+
+void FlattenToBackground(uint8_t* pixels, size_t count, uint32_t backgroundColor)
+{
+	static const auto kernel =
+		CpuHasAVX2() ? FlattenToBackgroundAVX2 :
+		CpuHasSSE2() ? FlattenToBackgroundSSE2 :
+		FlattenToBackgroundScalar;
+
+	kernel(pixels, count, backgroundColor);
+}
+
+void Downsample2x(const uint8_t* src, size_t srcStride, uint32_t srcWidth, uint32_t srcHeight,
+	uint8_t* dst, size_t dstStride, uint32_t firstRow, uint32_t rowCount)
+{
+	static const auto kernel =
+		CpuHasAVX2() ? Downsample2xAVX2 :
+		CpuHasSSE2() ? Downsample2xSSE2 :
+		Downsample2xScalar;
+
+	kernel(src, srcStride, srcWidth, srcHeight, dst, dstStride, firstRow, rowCount);
+}
+
+void BuildMipLevels(PixelPlane* levels, size_t count, uint32_t* doneRows)
+{
+	for (size_t l = 1; l < count; ++l) {
+		const auto& source = levels[l - 1];
+		const auto& level = levels[l];
+
+		// Rows whose two source rows are both finished (the last row may only have one)
+		uint32_t ready = doneRows[l - 1] >= source.height ? level.height : doneRows[l - 1] / 2;
+		if (ready > doneRows[l]) {
+			Downsample2x(source.pixels, source.stride, source.width, source.height,
+				level.pixels, level.stride, doneRows[l], ready - doneRows[l]);
+			doneRows[l] = ready;
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Pixel kernels that don't depend on Windows, so they can be built and measured anywhere.
+// Pixels are 32bpp premultiplied BGRA, colors are 0xRRGGBB like in the settings.
+
+// Blend the pixels onto an opaque background color and make them opaque:
+// out = c + (255 - a) * background / 255, rounded to nearest.
+// Picks the AVX2 or SSE2 kernel when the CPU has it; all kernels give identical results.
+void FlattenToBackground(uint8_t* pixels, size_t count, uint32_t backgroundColor);
+
+void FlattenToBackgroundScalar(uint8_t* pixels, size_t count, uint32_t backgroundColor);
+void FlattenToBackgroundSSE2(uint8_t* pixels, size_t count, uint32_t backgroundColor);
+void FlattenToBackgroundAVX2(uint8_t* pixels, size_t count, uint32_t backgroundColor);
+
+// One level of a mip pyramid: every destination pixel is the rounded average of a 2x2
+// block of the source, for destination rows [firstRow, firstRow + rowCount). The destination
+// is (srcWidth + 1) / 2 by (srcHeight + 1) / 2; an odd last column or row is averaged with itself.
+void Downsample2x(const uint8_t* src, size_t srcStride, uint32_t srcWidth, uint32_t srcHeight,
+	uint8_t* dst, size_t dstStride, uint32_t firstRow, uint32_t rowCount);
+
+void Downsample2xScalar(const uint8_t* src, size_t srcStride, uint32_t srcWidth, uint32_t srcHeight,
+	uint8_t* dst, size_t dstStride, uint32_t firstRow, uint32_t rowCount);
+void Downsample2xSSE2(const uint8_t* src, size_t srcStride, uint32_t srcWidth, uint32_t srcHeight,
+	uint8_t* dst, size_t dstStride, uint32_t firstRow, uint32_t rowCount);
+void Downsample2xAVX2(const uint8_t* src, size_t srcStride, uint32_t srcWidth, uint32_t srcHeight,
+	uint8_t* dst, size_t dstStride, uint32_t firstRow, uint32_t rowCount);
+
+struct PixelPlane {
+	uint8_t* pixels = nullptr;
+	size_t stride = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+};
+
+// Fills levels[1] to levels[count - 1] from levels[0] with Downsample2x, as far as the
+// finished rows allow. doneRows[l] counts the finished rows of level l: the caller sets
+// doneRows[0] as it fills the first level, the others start at 0. Called after every strip
+// of the first level, what a level reads was just written and is still in the cache.
+void BuildMipLevels(PixelPlane* levels, size_t count, uint32_t* doneRows);
+
+bool CpuHasSSE2();
+bool CpuHasAVX2();
@@ -0,0 +1,52 @@
+#include "PlaylistOrder.h"
+
+namespace {
+	// The splitmix64 finalizer
+	uint64_t Mix(uint64_t x)
+	{
+		x ^= x >> 30;
+		x *= 0xBF58476D1CE4E5B9ull;
+		x ^= x >> 27;
+		x *= 0x94D049BB133111EBull;
+		x ^= x >> 31;
+		return x;
+	}
+}
+
+uint32_t PlaylistOrder::At(uint32_t position, uint32_t count) const
+{
+	if (count <= 1) {
+		return 0;
+	}
+
+	// Half of the bits of the domain, which is at least 4
+	int halfBits = 1;
+	while ((uint64_t)1 << (2 * halfBits) < count) {
+		++halfBits;
+	}
+
+	uint32_t value = Permute(position, halfBits);
+	while (value >= count) {
+		value = Permute(value, halfBits);
+	}
+	return value;
+}
+
+uint64_t PlaylistOrder::Random(int64_t value) const
+{
+	return Mix(Mix(m_Seed ^ (uint64_t)value));
+}
+
+uint32_t PlaylistOrder::Permute(uint32_t value, int halfBits) const
+{
+	uint32_t mask = (uint32_t)(((uint64_t)1 << halfBits) - 1);
+	uint32_t left = (value >> halfBits) & mask;
+	uint32_t right = value & mask;
+	for (int round = 0; round < Rounds; ++round) {
+		auto f = (uint32_t)Mix(m_Seed + ((uint64_t)round << 32) + right) & mask;
+		auto next = left ^ f;
+		left = right;
+		right = next;
+	}
+	return left << halfBits | right;
+}
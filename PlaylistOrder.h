@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+// A shuffled order of `count` photos that isn't stored anywhere: the photo at a playlist
+// position is computed from the position and a seed, so the whole order is as small as the
+// seed, and a session can pick up where the previous one stopped from (seed, position).
+// The positions go through a Feistel network over the smallest power of four of at least
+// `count`, which is a bijection; results outside [0, count) go through it again until they
+// land inside (cycle walking), which takes fewer than four rounds on average.
+// A photo that is added only takes over the positions whose walk passed its number, so
+// everything else stays where it was, until the count passes the next power of four.
+class PlaylistOrder {
+public:
+	void SetSeed(uint64_t seed) { m_Seed = seed; }
+	uint64_t GetSeed() const { return m_Seed; }
+
+	// The photo at `position` of `count`, both in [0, count)
+	uint32_t At(uint32_t position, uint32_t count) const;
+	// 64 random bits for `value`, the same for the same seed
+	uint64_t Random(int64_t value) const;
+
+private:
+	static constexpr int Rounds = 4;
+
+	uint32_t Permute(uint32_t value, int halfBits) const;
+
+	uint64_t m_Seed = 0;
+};
@@ -0,0 +1,211 @@
+#include "ReverseGeocoder.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+	bool ReadFile(const std::filesystem::path& path, std::string& contents)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			return false;
+		}
+
+		file.seekg(0, std::ios::end);
+		contents.resize((size_t)file.tellg());
+		file.seekg(0, std::ios::beg);
+		file.read(contents.data(), (std::streamsize)contents.size());
+		return (bool)file;
+	}
+
+	// Calls `visit` with the tab separated fields of every line that is not a comment
+	template <typename Visitor>
+	void ForEachLine(std::string_view text, size_t numFields, Visitor visit)
+	{
+		std::vector<std::string_view> fields;
+		while (!text.empty()) {
+			auto end = text.find('\n');
+			auto line = text.substr(0, end);
+			text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+			if (!line.empty() && line.back() == '\r') {
+				line.remove_suffix(1);
+			}
+			if (line.empty() || line[0] == '#') {
+				continue;
+			}
+
+			fields.clear();
+			while (fields.size() < numFields) {
+				auto tab = line.find('\t');
+				fields.push_back(line.substr(0, tab));
+				if (tab == std::string_view::npos) {
+					break;
+				}
+				line = line.substr(tab + 1);
+			}
+			if (fields.size() == numFields) {
+				visit(fields);
+			}
+		}
+	}
+
+	bool ParseDouble(std::string_view text, double& value)
+	{
+		auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+		return result.ec == std::errc() && result.ptr == text.data() + text.size();
+	}
+
+	void ToUnitSphere(double latitude, double longitude, float point[3])
+	{
+		const double toRadians = 3.14159265358979323846 / 180;
+		double lat = latitude * toRadians;
+		double lon = longitude * toRadians;
+		point[0] = (float)(std::cos(lat) * std::cos(lon));
+		point[1] = (float)(std::cos(lat) * std::sin(lon));
+		point[2] = (float)std::sin(lat);
+	}
+
+	// Historical, abandoned and destroyed places, and neighborhoods of a larger place
+	bool IsSkippedFeature(std::string_view code)
+	{
+		return code == "PPLH" || code == "PPLQ" || code == "PPLW" || code == "PPLX" || code == "PPLCH";
+	}
+}
+
+bool ReverseGeocoder::Load(const std::filesystem::path& placesFile)
+{
+	std::string text;
+	if (!ReadFile(placesFile, text)) {
+		return false;
+	}
+
+	// countryInfo.txt: ISO code, ISO3, numeric, FIPS, name, ...
+	std::unordered_map<std::string_view, std::string> countryNames;
+	std::string countryText;
+	if (ReadFile(placesFile.parent_path() / "countryInfo.txt", countryText)) {
+		ForEachLine(countryText, 5, [&countryNames](const std::vector<std::string_view>& fields) {
+			countryNames[fields[0]] = std::string(fields[4]);
+		});
+	}
+
+	m_Places.clear();
+	m_Names.clear();
+	m_Countries.clear();
+	std::unordered_map<std::string_view, uint16_t> countryIndex;
+
+	// geonameid, name, asciiname, alternatenames, latitude, longitude, feature class, feature code, country code, ...
+	ForEachLine(text, 9, [&](const std::vector<std::string_view>& fields) {
+		double latitude, longitude;
+		if (fields[6] != "P" || IsSkippedFeature(fields[7]) ||
+			!ParseDouble(fields[4], latitude) || !ParseDouble(fields[5], longitude)) {
+			return;
+		}
+
+		auto country = countryIndex.find(fields[8]);
+		if (country == countryIndex.end()) {
+			auto name = countryNames.find(fields[8]);
+			m_Countries.push_back(name != countryNames.end() ? name->second : std::string(fields[8]));
+			country = countryIndex.emplace(fields[8], (uint16_t)(m_Countries.size() - 1)).first;
+		}
+
+		Place place;
+		ToUnitSphere(latitude, longitude, place.position);
+		place.name = (uint32_t)m_Names.size();
+		place.country = country->second;
+		m_Places.push_back(place);
+
+		m_Names += fields[1];
+		m_Names += '\0';
+	});
+
+	m_Places.shrink_to_fit();
+	m_Names.shrink_to_fit();
+	Build(0, m_Places.size(), 0);
+	return !m_Places.empty();
+}
+
+size_t ReverseGeocoder::MemoryUsage() const
+{
+	size_t bytes = m_Places.capacity() * sizeof(Place) + m_Names.capacity();
+	for (const auto& country : m_Countries) {
+		bytes += sizeof(country) + country.capacity();
+	}
+	return bytes;
+}
+
+std::string ReverseGeocoder::Describe(double latitude, double longitude) const
+{
+	if (m_Places.empty()) {
+		return {};
+	}
+
+	float point[3];
+	ToUnitSphere(latitude, longitude, point);
+	size_t best = 0;
+	float bestDistance = std::numeric_limits<float>::max();
+	FindNearest(0, m_Places.size(), 0, point, best, bestDistance);
+
+	const auto& place = m_Places[best];
+	std::string location = m_Names.c_str() + place.name;
+	const auto& country = m_Countries[place.country];
+	if (!country.empty()) {
+		location += location.empty() ? "" : ", ";
+		location += country;
+	}
+	return location;
+}
+
+void ReverseGeocoder::Build(size_t begin, size_t end, int axis)
+{
+	if (end - begin <= 1) {
+		return;
+	}
+
+	auto middle = begin + (end - begin) / 2;
+	std::nth_element(m_Places.begin() + begin, m_Places.begin() + middle, m_Places.begin() + end,
+		[axis](const Place& a, const Place& b) { return a.position[axis] < b.position[axis]; });
+
+	int next = (axis + 1) % 3;
+	Build(begin, middle, next);
+	Build(middle + 1, end, next);
+}
+
+void ReverseGeocoder::FindNearest(size_t begin, size_t end, int axis, const float point[3], size_t& best, float& bestDistance) const
+{
+	if (begin >= end) {
+		return;
+	}
+
+	// The straight-line distance through the sphere grows with the distance over its surface
+	auto middle = begin + (end - begin) / 2;
+	const auto& place = m_Places[middle];
+	float dx = place.position[0] - point[0];
+	float dy = place.position[1] - point[1];
+	float dz = place.position[2] - point[2];
+	float distance = dx * dx + dy * dy + dz * dz;
+	if (distance < bestDistance) {
+		bestDistance = distance;
+		best = middle;
+	}
+
+	// Search the side of the split the point is on first, then the other side if it can be closer
+	float split = point[axis] - place.position[axis];
+	int next = (axis + 1) % 3;
+	if (split < 0) {
+		FindNearest(begin, middle, next, point, best, bestDistance);
+		if (split * split < bestDistance) {
+			FindNearest(middle + 1, end, next, point, best, bestDistance);
+		}
+	}
+	else {
+		FindNearest(middle + 1, end, next, point, best, bestDistance);
+		if (split * split < bestDistance) {
+			FindNearest(begin, middle, next, point, best, bestDistance);
+		}
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Offline reverse geocoding: the nearest town to a coordinate, from a GeoNames place list
+// (cities500.txt, cities1000.txt, ... from download.geonames.org/export/dump). Country names
+// come from countryInfo.txt next to it, when it is there.
+// The places are kept in an implicit k-d tree over points on the unit sphere, so there is no
+// trouble at the date line or the poles, and a lookup visits a few dozen places.
+// After Load it is read-only, so lookups from several threads are safe.
+class ReverseGeocoder {
+public:
+	bool Load(const std::filesystem::path& placesFile);
+	bool IsEmpty() const { return m_Places.empty(); }
+	size_t Size() const { return m_Places.size(); }
+	// Bytes used by the places, their names and the countries
+	size_t MemoryUsage() const;
+
+	// "Town, Country" in UTF-8, formatted like the online lookup. Empty when nothing is loaded.
+	std::string Describe(double latitude, double longitude) const;
+
+private:
+	struct Place {
+		float position[3];
+		uint32_t name; // Offset in m_Names
+		uint16_t country; // Index in m_Countries
+	};
+
+	void Build(size_t begin, size_t end, int axis);
+	void FindNearest(size_t begin, size_t end, int axis, const float point[3], size_t& best, float& bestDistance) const;
+
+	// Every range in the tree is split by its middle element, on axis depth % 3
+	std::vector<Place> m_Places;
+	std::string m_Names; // Zero terminated
+	std::vector<std::string> m_Countries;
+};
@@ -5,14 +5,24 @@
 #include "ScreenSaverWindow.h"
 #include "App.h"
 
+#define MAX_FRAME_RATE 240.f // Whatever MaxFPS says
+
 float EaseInOutQuad(float t) { return t < 0.5f ? 2 * t * t : -1 + (4 - 2 * t) * t; }
 
+// The largest zoom Sprite::OnLoad can pick for the current pan-and-scan factor
+static float MaxPanScanZoom()
+{
+	int panScanMod = (int)(1000 * App::instance->settings.PanScanFactor);
+	return panScanMod <= 0 ? 1 : 1.1f + ((panScanMod - 1) / 10000.0f);
+}
+
 void Sprite::Clear()
 {
 	alpha = 1;
 	scale = 1;
 	imageInfo = nullptr;
 	bitmap.Reset();
+	mipBitmaps.clear();
 }
 
 void Sprite::OnLoad()
@@ -47,58 +57,63 @@ void Sprite::Update(float deltaTime)
 	PanScanProgress += deltaTime;
 }
 
-HRESULT ScreenSaverWindow::CreateDeviceResources() {
-	HRESULT hr = S_OK;
+// Touches nothing of the window but its handle, so a render thread can call it without
+// the state lock: DXGI may send messages to the UI thread, which could be waiting for it
+HRESULT ScreenSaverWindow::CreateRenderTarget(ComPtr<ID2D1HwndRenderTarget>& target, ComPtr<ID2D1SolidColorBrush>& brush, UINT32 textColor) const
+{
+	RECT rc;
+	GetClientRect(m_hwnd, &rc);
 
-	if (!m_pRenderTarget) {
-		RECT rc;
-		GetClientRect(m_hwnd, &rc);
+	D2D1_SIZE_U size = D2D1::SizeU(
+		rc.right - rc.left,
+		rc.bottom - rc.top
+	);
 
-		D2D1_SIZE_U size = D2D1::SizeU(
-			rc.right - rc.left,
-			rc.bottom - rc.top
-		);
+	// Create a Direct2D render target
+	HRESULT hr = App::instance->m_pD2DFactory->CreateHwndRenderTarget(
+		D2D1::RenderTargetProperties(),
+		D2D1::HwndRenderTargetProperties(m_hwnd, size),
+		target.GetAddressOf()
+	);
 
-		// Create a Direct2D render target
-		hr = App::instance->m_pD2DFactory->CreateHwndRenderTarget(
-			D2D1::RenderTargetProperties(),
-			D2D1::HwndRenderTargetProperties(m_hwnd, size),
-			m_pRenderTarget.GetAddressOf()
+	if (SUCCEEDED(hr)) {
+		// Create a solid color brush for the buttons
+		hr = target->CreateSolidColorBrush(
+			D2D1::ColorF(textColor),
+			brush.GetAddressOf()
 		);
-
-		if (SUCCEEDED(hr)) {
-			// Create a solid color brush for text
-			hr = m_pRenderTarget->CreateSolidColorBrush(
-				D2D1::ColorF(App::instance->settings.OutlineColor),
-				m_pTextOutlineBrush.GetAddressOf()
-			);
-
-			// Create a solid color brush for text
-			hr = m_pRenderTarget->CreateSolidColorBrush(
-				D2D1::ColorF(App::instance->settings.TextColor),
-				m_pTextFillBrush.GetAddressOf()
-			);
-		}
-		else
-		{
-			std::cout << "Error (" << hr << ") creating Render target for window " << m_hwnd;
-		}
 	}
-
-	if (!m_CurrentSprite->imageInfo)
+	else
 	{
-		m_CurrentSprite->imageInfo = App::instance->m_Library.GotoImage(1, m_AdapterIndex, (int)App::instance->m_Screensavers.size());
-		LoadSprite(m_CurrentSprite);
+		std::cout << "Error (" << hr << ") creating Render target for window " << m_hwnd;
 	}
+	return hr;
+}
 
-	if (!m_CurrentSprite->bitmap.Get())
-	{
-		LoadSprite(m_CurrentSprite);
+HRESULT ScreenSaverWindow::CreateDeviceResources() {
+	HRESULT hr = S_OK;
+
+	if (!m_pRenderTarget) {
+		ComPtr<ID2D1HwndRenderTarget> target;
+		ComPtr<ID2D1SolidColorBrush> brush;
+		hr = CreateRenderTarget(target, brush, App::instance->settings.TextColor);
+		m_pRenderTarget = target;
+		m_pTextFillBrush = brush;
+		m_NeedsRender = true;
 	}
 
-	if (!m_NextSprite->bitmap.Get())
+	if (!m_PendingImage)
 	{
-		LoadSprite(m_NextSprite);
+		auto numScreens = (int)App::instance->m_Screensavers.size();
+		if (!m_CurrentSprite->imageInfo)
+		{
+			StartSwap(false, 0, numScreens);
+		}
+		else if (!m_CurrentSprite->bitmap.Get())
+		{
+			// The render target was recreated, load the current image again
+			StartSwap(false, 0, numScreens);
+		}
 	}
 
 	return hr;
@@ -122,133 +137,45 @@ RECT ScreenSaverWindow::GetMaximizedRect()
 	return m_MaximizedRect;
 }
 
-void ScreenSaverWindow::LoadSprite(Sprite* sprite)
-{
-	if (!sprite->imageInfo)
-	{
-		sprite->bitmap.Reset();
-		return;
-	}
-
-	sprite->imageInfo->CacheInfo(App::instance->settings);
-
-	auto hr = LoadBitmapFromFileWithTransparencyMixedToBlack(sprite);
-	if (SUCCEEDED(hr)) {
-		sprite->OnLoad();
-	}
-}
-
-HRESULT ScreenSaverWindow::LoadBitmapFromFileWithTransparencyMixedToBlack(Sprite* sprite) const
+HRESULT ScreenSaverWindow::UploadSprite(Sprite* sprite, const DecodedImage& image) const
 {
 	if (!m_pRenderTarget)
 	{
 		return -1;
 	}
 
-	ComPtr<IWICBitmapDecoder> pDecoder;
-	ComPtr<IWICBitmapFrameDecode> pFrame;
-	ComPtr<IWICFormatConverter> pConverter;
-	ComPtr<IWICBitmapFlipRotator> pRotator;
-
-	// Create decoder
-	HRESULT hr = App::instance->m_pWICFactory->CreateDecoderFromFilename(
-		sprite->imageInfo->filePath.c_str(),
-		nullptr,
-		GENERIC_READ,
-		WICDecodeMetadataCacheOnDemand,
-		&pDecoder);
-	if (FAILED(hr)) return hr;
-
-	// Get frame
-	hr = pDecoder->GetFrame(0, &pFrame);
-	if (FAILED(hr)) return hr;
-
-	// Convert to 32bppPBGRA
-	hr = App::instance->m_pWICFactory->CreateFormatConverter(&pConverter);
-	if (FAILED(hr)) return hr;
-
-	hr = pConverter->Initialize(
-		pFrame.Get(),
-		GUID_WICPixelFormat32bppPBGRA,
-		WICBitmapDitherTypeNone,
-		nullptr,
-		0.0f,
-		WICBitmapPaletteTypeCustom);
-	if (FAILED(hr)) return hr;
-
-	// Apply rotation
-	WICBitmapTransformOptions transform = WICBitmapTransformRotate0;
-	switch (sprite->imageInfo->rotation) {
-	case 90:  transform = WICBitmapTransformRotate90; break;
-	case 180: transform = WICBitmapTransformRotate180; break;
-	case 270: transform = WICBitmapTransformRotate270; break;
-	default: transform = WICBitmapTransformRotate0; break;
-	}
-
-	ComPtr<IWICBitmapSource> pSource = pConverter;
+	if (FAILED(image.hr)) return image.hr;
 
-	if (transform != WICBitmapTransformRotate0) {
-		hr = App::instance->m_pWICFactory->CreateBitmapFlipRotator(&pRotator);
-		if (FAILED(hr)) return hr;
-
-		hr = pRotator->Initialize(pConverter.Get(), transform);
-		if (FAILED(hr)) return hr;
-
-		pSource = pRotator;
-	}
-
-	// Get final size
-	UINT width, height;
-	hr = pSource->GetSize(&width, &height);
-	if (FAILED(hr)) return hr;
-
-	// Create D2D bitmap
 	D2D1_BITMAP_PROPERTIES props;
 	props.pixelFormat = D2D1_PIXEL_FORMAT(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED);
 	m_pRenderTarget->GetDpi(&props.dpiX, &props.dpiY);
 
-	Microsoft::WRL::ComPtr<ID2D1Bitmap> pBitmap;
-	m_pRenderTarget->CreateBitmap(
-		D2D1::SizeU(width, height),
-		nullptr, 0,
+	// Create a new bitmap from the decoded pixel data
+	ComPtr<ID2D1Bitmap> bitmap;
+	HRESULT hr = m_pRenderTarget->CreateBitmap(
+		D2D1::SizeU(image.width, image.height),
+		image.pixels.data(),
+		image.stride,
 		props,
-		&pBitmap);
-
-	// Get the pixel data from the WIC converter
-	UINT stride = width * 4; // 4 bytes per pixel (BGRA)
-	std::vector<BYTE> pixelData(stride * height);
-
-	hr = pConverter->CopyPixels(nullptr, stride, static_cast<UINT>(pixelData.size()), pixelData.data());
+		bitmap.GetAddressOf());
 	if (FAILED(hr)) return hr;
 
-	auto bgc = App::instance->settings.BackgroundColor;
-	const BYTE bgColor[3] = { (BYTE)bgc, (BYTE)(bgc >> 8), (BYTE)(bgc >> 16) };
-
-	// Modify the pixel data to blend with black
-	for (UINT y = 0; y < height; ++y)
-	{
-		for (UINT x = 0; x < width; ++x)
-		{
-			// Get the pixel at (x, y)
-			BYTE* pixel = &pixelData[(y * stride) + (x * 4)];
-			float a = pixel[3] / 255.0f;
-			float a_inv = 1 - a;
-			pixel[0] = static_cast<BYTE>(a * pixel[0] + a_inv * bgColor[0]);  // Blue
-			pixel[1] = static_cast<BYTE>(a * pixel[1] + a_inv * bgColor[1]);  // Green
-			pixel[2] = static_cast<BYTE>(a * pixel[2] + a_inv * bgColor[2]);  // Red
-			pixel[3] = 255; // Alpha
-		}
+	// The smaller levels, for a window that is smaller than the screen
+	std::vector<ComPtr<ID2D1Bitmap>> mipBitmaps;
+	for (const auto& level : image.mipLevels) {
+		ComPtr<ID2D1Bitmap> mipBitmap;
+		hr = m_pRenderTarget->CreateBitmap(
+			D2D1::SizeU(level.width, level.height),
+			image.pixels.data() + level.offset,
+			level.stride,
+			props,
+			mipBitmap.GetAddressOf());
+		if (FAILED(hr)) break;
+		mipBitmaps.push_back(mipBitmap);
 	}
 
-	// Create a new bitmap from the modified pixel data
-	hr = m_pRenderTarget->CreateBitmap(
-		D2D1::SizeU(width, height),
-		pixelData.data(),
-		stride,
-		props,
-		sprite->bitmap.GetAddressOf());
-	if (FAILED(hr)) return hr;
-
+	sprite->bitmap = bitmap;
+	sprite->mipBitmaps = std::move(mipBitmaps);
 	return S_OK;
 }
 
@@ -256,14 +183,27 @@ HRESULT ScreenSaverWindow::LoadBitmapFromFileWithTransparencyMixedToBlack(Sprite
 void ScreenSaverWindow::DiscardDeviceResources() {
 	m_pRenderTarget.Reset();
 	m_CurrentSprite->bitmap.Reset();
+	m_CurrentSprite->mipBitmaps.clear();
 	m_NextSprite->bitmap.Reset();
+	m_NextSprite->mipBitmaps.clear();
+	m_Captions.Clear();
+	m_NeedsRender = true;
 }
 
-void ScreenSaverWindow::DrawSprite(Sprite* sprite) {
-	if (!sprite || !sprite->imageInfo || !sprite->bitmap) {
-		return;
+// How long a photo pans and zooms: until the same monitor shows the next one
+static float GetPanScanDuration()
+{
+	float totalDislayTime = App::instance->settings.DisplayDuration;
+	if (!App::instance->settings.SyncChange)
+	{
+		totalDislayTime *= App::instance->m_Screensavers.size();
 	}
+	return totalDislayTime;
+}
 
+// Where the sprite is on screen at `progress` (0 to 1) through its pan and zoom
+D2D1_RECT_F ScreenSaverWindow::GetSpriteRect(const Sprite* sprite, float progress) const
+{
 	RECT screenRect;
 	GetClientRect(m_hwnd, &screenRect); // Or use GetSystemMetrics(SM_CXSCREEN) and SM_CYSCREEN for full screen size
 	auto screenWidth = screenRect.right - screenRect.left;
@@ -278,13 +218,6 @@ void ScreenSaverWindow::DrawSprite(Sprite* sprite) {
 		(screenRect.bottom - screenRect.top) / imgHeight
 	);
 
-	float totalDislayTime = App::instance->settings.DisplayDuration;
-	if (!App::instance->settings.SyncChange)
-	{
-		totalDislayTime *= App::instance->m_Screensavers.size();
-	}
-	float progress = std::clamp(sprite->PanScanProgress / totalDislayTime, 0.f, 1.f);
-
 	float zoom = sprite->ZoomStart + (sprite->ZoomEnd - sprite->ZoomStart) * progress;
 	float panX = sprite->PanXStart + (sprite->PanXEnd - sprite->PanXStart) * progress;
 	float panY = sprite->PanYStart + (sprite->PanYEnd - sprite->PanYStart) * progress;
@@ -295,14 +228,97 @@ void ScreenSaverWindow::DrawSprite(Sprite* sprite) {
 	float offsetX = (screenWidth - scaledWidth) * 0.5f + panX * (screenWidth - scaledWidth);
 	float offsetY = (screenRect.bottom - screenRect.top - scaledHeight) * 0.5f + panY * (screenRect.bottom - screenRect.top - scaledHeight);
 
+	return D2D1::RectF(
+		offsetX,
+		offsetY,
+		offsetX + scaledWidth,
+		offsetY + scaledHeight
+	);
+}
+
+// How fast the edges of the sprite move on screen, in pixels per second
+float ScreenSaverWindow::GetSpriteSpeed(const Sprite* sprite) const
+{
+	if (!sprite || !sprite->imageInfo || !sprite->bitmap) {
+		return 0;
+	}
+
+	float duration = GetPanScanDuration();
+	float progress = sprite->PanScanProgress / duration;
+	if (duration <= 0 || progress >= 1) {
+		return 0;
+	}
+
+	// Pan and zoom multiply, so measure the motion around where the sprite is now
+	const float step = 0.01f;
+	auto from = GetSpriteRect(sprite, progress);
+	auto to = GetSpriteRect(sprite, progress + step);
+	float distance = std::max({
+		std::abs(to.left - from.left), std::abs(to.top - from.top),
+		std::abs(to.right - from.right), std::abs(to.bottom - from.bottom) });
+	return distance / (step * duration);
+}
+
+float ScreenSaverWindow::GetFrameRate() const
+{
+	const auto& settings = App::instance->settings;
+
+	// Pan-and-scan: a frame each time the photo has moved half a pixel
+	float speed = std::max(GetSpriteSpeed(m_CurrentSprite), GetSpriteSpeed(m_NextSprite));
+	float rate = speed / 0.5f;
+
+	// Crossfade: a frame per step of an 8-bit alpha, at the steepest point of the ease
+	if (m_FadeTimer > 0) {
+		rate = std::max(rate, 2 * 255 / std::max(settings.FadeDuration, 0.001f));
+	}
+
+	if (rate <= 0) {
+		return 0;
+	}
+	// Not std::clamp, which needs MinFPS <= MaxFPS
+	return std::min(std::max(rate, std::max(settings.MinFPS, 0.1f)), GetMaxFrameRate());
+}
+
+float ScreenSaverWindow::GetMaxFrameRate()
+{
+	return std::clamp(App::instance->settings.MaxFPS, 1.f, MAX_FRAME_RATE);
+}
+
+float ScreenSaverWindow::TimeUntilRender() const
+{
+	if (m_NeedsRender) {
+		return 0;
+	}
+
+	float rate = GetFrameRate();
+	if (rate <= 0) {
+		return std::numeric_limits<float>::infinity();
+	}
+	return std::max(0.f, 1 / rate - m_SinceRender);
+}
+
+void ScreenSaverWindow::DrawSprite(Sprite* sprite) {
+	if (!sprite || !sprite->imageInfo || !sprite->bitmap) {
+		return;
+	}
+
+	float progress = std::clamp(sprite->PanScanProgress / GetPanScanDuration(), 0.f, 1.f);
+	auto rect = GetSpriteRect(sprite, progress);
+
+	// Linear filtering only looks at 2x2 pixels: draw the smallest level that is still at
+	// least as large as the sprite on screen, so it is never shrunk more than 2x
+	ID2D1Bitmap* bitmap = sprite->bitmap.Get();
+	for (const auto& mipBitmap : sprite->mipBitmaps) {
+		auto size = mipBitmap->GetSize();
+		if (size.width < rect.right - rect.left || size.height < rect.bottom - rect.top) {
+			break;
+		}
+		bitmap = mipBitmap.Get();
+	}
+
 	m_pRenderTarget->DrawBitmap(
-		sprite->bitmap.Get(),
-		D2D1::RectF(
-			offsetX,
-			offsetY,
-			offsetX + scaledWidth,
-			offsetY + scaledHeight
-		),
+		bitmap,
+		rect,
 		sprite->alpha,
 		D2D1_BITMAP_INTERPOLATION_MODE_LINEAR
 	);
@@ -313,24 +329,6 @@ void ScreenSaverWindow::DrawSprite(Sprite* sprite) {
 	//}
 }
 
-void ScreenSaverWindow::DrawHackOutline(float x, float y, float xo, float yo)
-{
-	m_pRenderTarget->DrawTextLayout(
-		D2D1::Point2F(x + xo, y + yo),
-		m_pTextLayout.Get(),
-		m_pTextOutlineBrush.Get(),
-		D2D1_DRAW_TEXT_OPTIONS_NO_SNAP
-	);
-}
-
-void SetBrushColor(ID2D1SolidColorBrush* brush, UINT32 color, float alpha)
-{
-	float red = ((color >> 16) & 0xFF) / 255.0f;
-	float green = ((color >> 8) & 0xFF) / 255.0f;
-	float blue = (color & 0xFF) / 255.0f;
-	brush->SetColor(D2D1::ColorF(red, green, blue, alpha));
-}
-
 void ScreenSaverWindow::RenderText(const std::wstring& caption, float alpha, float x, float y, float w, float h)
 {
 	if (w <= 0 || h <= 0 || alpha <= 0)
@@ -338,100 +336,25 @@ void ScreenSaverWindow::RenderText(const std::wstring& caption, float alpha, flo
 		return;
 	}
 
-	// OUTLINE (WIP) ComPtr<IDWriteFontCollection> pFontCollection;
-	// OUTLINE (WIP) ComPtr<IDWriteFont> pFont;
-	// OUTLINE (WIP) ComPtr<IDWriteFontFace> pFontFace;
-	// OUTLINE (WIP) ComPtr<IDWriteFontFamily> pFontFamily;
-	// OUTLINE (WIP) if (SUCCEEDED(App::instance->m_pDWriteFactory->GetSystemFontCollection(&pFontCollection))) {
-	// OUTLINE (WIP) 	if (SUCCEEDED(pFontCollection->GetFontFamily(0, &pFontFamily))) {
-	// OUTLINE (WIP) 		if (SUCCEEDED(pFontFamily->GetFont(0, &pFont))) {
-	// OUTLINE (WIP) 			pFont->CreateFontFace(&pFontFace);
-	// OUTLINE (WIP) 		}
-	// OUTLINE (WIP) 	}
-	// OUTLINE (WIP) }
-	// OUTLINE (WIP) pFont->CreateFontFace(&pFontFace);
-	// OUTLINE (WIP) 
-	// OUTLINE (WIP) // Convert Unicode characters to glyph indices
-	// OUTLINE (WIP) std::vector<UINT32> unicodeCodePoints(caption.length());
-	// OUTLINE (WIP) for (int i = 0; i < caption.length(); ++i) {
-	// OUTLINE (WIP) 	unicodeCodePoints.push_back(caption[i]);
-	// OUTLINE (WIP) }
-	// OUTLINE (WIP) std::vector<UINT16> glyphIndices(unicodeCodePoints.size());
-	// OUTLINE (WIP) pFontFace->GetGlyphIndices(unicodeCodePoints.data(), (UINT32)unicodeCodePoints.size(), glyphIndices.data());
-	// OUTLINE (WIP) FLOAT dpiX, dpiY;
-	// OUTLINE (WIP) m_pRenderTarget->GetDpi(&dpiX, &dpiY);
-	// OUTLINE (WIP) float pixelsPerDip = dpiX / 96.0f; // Convert DPI to pixels per DIP
-	// OUTLINE (WIP) 
-	// OUTLINE (WIP) DWRITE_FONT_METRICS fontMetrics;
-	// OUTLINE (WIP) pFontFace->GetGdiCompatibleMetrics(App::instance->settings.FontSize, pixelsPerDip, nullptr, &fontMetrics);
-	// OUTLINE (WIP) 
-	// OUTLINE (WIP) std::vector<DWRITE_GLYPH_METRICS> glyphMetrics(glyphIndices.size());
-	// OUTLINE (WIP) HRESULT hr = pFontFace->GetGdiCompatibleGlyphMetrics(App::instance->settings.FontSize, pixelsPerDip, nullptr, FALSE, glyphIndices.data(), (UINT32)glyphIndices.size(), glyphMetrics.data());
-	// OUTLINE (WIP) 
-	// OUTLINE (WIP) // Convert advance widths
-	// OUTLINE (WIP) std::vector<FLOAT> glyphAdvances(glyphIndices.size());
-	// OUTLINE (WIP) for (size_t i = 0; i < glyphIndices.size(); ++i) {
-	// OUTLINE (WIP) 	glyphAdvances[i] = static_cast<FLOAT>(glyphMetrics[i].advanceWidth) / fontMetrics.designUnitsPerEm * App::instance->settings.FontSize - App::instance->settings.OutlineWidth;
-	// OUTLINE (WIP) }
-	// OUTLINE (WIP) 
-	// OUTLINE (WIP) float advW = 0;
-	// OUTLINE (WIP) for (float adv : glyphAdvances) { advW += adv; }
-	// OUTLINE (WIP) 
-	// OUTLINE (WIP) // Generate outline from glyph run
-	// OUTLINE (WIP) ComPtr<ID2D1PathGeometry> pPathGeometry;
-	// OUTLINE (WIP) ComPtr<ID2D1GeometrySink> pSink;
-	// OUTLINE (WIP) App::instance->m_pD2DFactory->CreatePathGeometry(&pPathGeometry);
-	// OUTLINE (WIP) pPathGeometry->Open(&pSink);
-	// OUTLINE (WIP) 
-	// OUTLINE (WIP) std::vector<DWRITE_GLYPH_OFFSET> glyphOffsets(glyphIndices.size());
-	// OUTLINE (WIP) pFontFace->GetGlyphRunOutline(App::instance->settings.FontSize, glyphIndices.data(), glyphAdvances.data(), glyphOffsets.data(), (UINT32)glyphIndices.size(), FALSE, FALSE, pSink.Get());
-	// OUTLINE (WIP) 
-	// OUTLINE (WIP) pSink->Close();
-	// OUTLINE (WIP) 
-	// OUTLINE (WIP) RECT screenRect;
-	// OUTLINE (WIP) GetClientRect(m_hwnd, &screenRect);
-	// OUTLINE (WIP) auto screenWidth = screenRect.right - screenRect.left;
-	// OUTLINE (WIP) auto screenHeight = screenRect.bottom - screenRect.top;
-	// OUTLINE (WIP) 
-	// OUTLINE (WIP) D2D1_MATRIX_3X2_F transform = D2D1::Matrix3x2F::Translation(-advW / 2, y + h);
-	// OUTLINE (WIP) ComPtr<ID2D1TransformedGeometry> pTransformedGeometry;
-	// OUTLINE (WIP) App::instance->m_pD2DFactory->CreateTransformedGeometry(pPathGeometry.Get(), &transform, &pTransformedGeometry);
-	// OUTLINE (WIP) m_pRenderTarget->DrawGeometry(pTransformedGeometry.Get(), m_pTextOutlineBrush.Get(), App::instance->settings.OutlineWidth);
-
-	SetBrushColor(m_pTextFillBrush.Get(), App::instance->settings.TextColor, alpha);
-	SetBrushColor(m_pTextOutlineBrush.Get(), App::instance->settings.OutlineColor, alpha);
-
-	App::instance->m_pDWriteFactory->CreateTextLayout(
-		caption.c_str(),
-		(UINT32)caption.length(),
-		App::instance->m_pTextFormat.Get(),
-		w, h,
-		m_pTextLayout.GetAddressOf()
-	);
-
-	// HACK outline
-	{
-		float o = 2;// App::instance->settings.OutlineWidth;
-		float oo = o * 1.1f;
-		DrawHackOutline(x, y, -o, -o);
-		DrawHackOutline(x, y, o, -o);
-		DrawHackOutline(x, y, -o, o);
-		DrawHackOutline(x, y, o, o);
-		DrawHackOutline(x, y, -oo, 0);
-		DrawHackOutline(x, y, oo, 0);
-		DrawHackOutline(x, y, 0, -oo);
-		DrawHackOutline(x, y, 0, oo);
-	}
-
-	m_pRenderTarget->DrawTextLayout(
-		D2D1::Point2F(x, y),
-		m_pTextLayout.Get(),
-		m_pTextFillBrush.Get(),
-		D2D1_DRAW_TEXT_OPTIONS_NO_SNAP
-	);
+	const auto& settings = App::instance->settings;
+	CaptionStyle style{ settings.TextFontName, settings.FontSize, settings.TextColor, settings.OutlineColor, settings.OutlineWidth };
+	HRESULT hr = m_Captions.Draw(m_pRenderTarget.Get(), App::instance->m_pDWriteFactory.Get(), App::instance->m_pTextFormat.Get(),
+		caption, style, alpha, x, y, w, h);
+	if (FAILED(hr)) {
+		std::cout << "Error (" << hr << ") drawing text for window " << m_hwnd << std::endl;
+	}
 }
 
 HRESULT ScreenSaverWindow::OnRender()
+{
+	HRESULT hr = DrawFrame();
+	if (FAILED(hr)) {
+		return hr;
+	}
+	return EndFrame(m_pRenderTarget->EndDraw());
+}
+
+HRESULT ScreenSaverWindow::DrawFrame()
 {
 	HRESULT hr = CreateDeviceResources();
 
@@ -439,6 +362,7 @@ HRESULT ScreenSaverWindow::OnRender()
 		return hr;
 	}
 
+	m_DrawStart = std::chrono::steady_clock::now();
 	m_pRenderTarget->BeginDraw();
 	m_pRenderTarget->SetTransform(D2D1::Matrix3x2F::Identity());
 	m_pRenderTarget->Clear(D2D1::ColorF(D2D1::ColorF::White));
@@ -451,7 +375,13 @@ HRESULT ScreenSaverWindow::OnRender()
 
 	if (m_CurrentSprite && m_CurrentSprite->imageInfo)
 	{
-		auto caption = m_CurrentSprite->imageInfo->GetCaption(App::instance->settings);
+		// The caption only changes with the photo, or when its location comes in (which
+		// asks for a new frame); pan-and-scan frames reuse it
+		if (m_NeedsRender || m_CaptionInfo != m_CurrentSprite->imageInfo) {
+			m_CaptionInfo = m_CurrentSprite->imageInfo;
+			m_Caption = m_CaptionInfo->GetCaption(App::instance->settings);
+		}
+		const auto& caption = m_Caption;
 		if (!caption.empty())
 		{
 			//wchar_t buf[16];
@@ -493,7 +423,15 @@ HRESULT ScreenSaverWindow::OnRender()
 		m_RotateButtonRect = { (LONG)rotRect.left,(LONG)rotRect.top,(LONG)rotRect.right,(LONG)rotRect.bottom };
 	}
 
-	hr = m_pRenderTarget->EndDraw();
+	m_NeedsRender = false;
+	m_SinceRender = 0;
+	return S_OK;
+}
+
+HRESULT ScreenSaverWindow::EndFrame(HRESULT hr)
+{
+	auto drawTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_DrawStart).count();
+	m_FrameStats.Add(drawTime, 1.0 / GetMaxFrameRate());
 
 	if (hr == D2DERR_RECREATE_TARGET) {
 		hr = S_OK;
@@ -509,47 +447,178 @@ void ScreenSaverWindow::OnResize(UINT width, UINT height)
 	if (m_pRenderTarget) {
 		m_pRenderTarget->Resize(D2D1::SizeU(width, height));
 	}
+	m_NeedsRender = true;
 }
 
 void ScreenSaverWindow::StartSwap(bool animate, int offset, int numScreens)
 {
 	m_CurrentImageIdx += offset;
+	m_PendingAnimate = animate;
+	m_PendingStep = offset >= 0 ? 1 : -1;
+	SelectPendingImage(numScreens);
+}
+
+void ScreenSaverWindow::SelectPendingImage(int numScreens)
+{
+	auto& loader = App::instance->m_Loader;
+	if (m_PendingImage)
+	{
+		loader.Cancel(m_PendingImage);
+		m_PendingImage = nullptr;
+	}
+	if (m_RefineImage)
+	{
+		loader.Cancel(m_RefineImage);
+		m_RefineImage = nullptr;
+	}
+
+	// The swap itself happens in ShowPendingImage, once the loader has decoded the image.
+	// Downvoted and broken photos are already left out by the library.
+	auto info = App::instance->m_Library.GotoImage(m_CurrentImageIdx, m_PendingStep, m_AdapterIndex, numScreens);
+	if (info) {
+		m_PendingImage = info;
+		loader.Request(MakeDecodeJob(info));
+	}
 
-	for (int tries = 0; tries < 100; ++tries) {
-		auto info = App::instance->m_Library.GotoImage(m_CurrentImageIdx, m_AdapterIndex, numScreens);
-		if (!info) return;
+	PrefetchUpcoming(numScreens);
+}
 
-		if (App::instance->m_Downvoted.contains(info->filePath)) {
-			continue;
-		}
+DecodeJob ScreenSaverWindow::MakeDecodeJob(ImageInfo* info) const
+{
+	// Decode at the monitor size times the maximum pan-and-scan zoom, never larger
+	float zoom = MaxPanScanZoom();
+	DecodeJob job;
+	job.info = info;
+	job.rotation = info->rotation;
+	job.targetWidth = (UINT)std::ceil(m_MaximizedRect.right * zoom);
+	job.targetHeight = (UINT)std::ceil(m_MaximizedRect.bottom * zoom);
+
+	RECT client = {};
+	if (m_hwnd && GetClientRect(m_hwnd, &client)) {
+		job.viewWidth = (UINT)(client.right - client.left);
+		job.viewHeight = (UINT)(client.bottom - client.top);
+	}
+	return job;
+}
+
+void ScreenSaverWindow::PrefetchUpcoming(int numScreens)
+{
+	std::vector<DecodeJob> upcoming;
+	auto& library = App::instance->m_Library;
+	int depth = App::instance->settings.PrefetchDepth;
+	int imageIndex = m_CurrentImageIdx;
+	for (int i = 1; i <= depth * 2 && (int)upcoming.size() < depth; ++i) {
+		++imageIndex;
+		auto info = library.GotoImage(imageIndex, 1, m_AdapterIndex, numScreens);
+		if (!info) break;
+
+		upcoming.push_back(MakeDecodeJob(info));
+	}
+	App::instance->m_Loader.Prefetch(m_AdapterIndex, upcoming);
+}
+
+void ScreenSaverWindow::ShowPendingImage(int numScreens)
+{
+	if (!m_PendingImage || !m_pRenderTarget)
+	{
+		return;
+	}
 
-		Sprite* sprite = m_CurrentSprite;
-		if (animate)
+	auto& loader = App::instance->m_Loader;
+	auto image = loader.Take(m_PendingImage);
+	bool isPreview = false;
+	if (!image)
+	{
+		// Still decoding: show the embedded preview if there is one, or keep showing the current image
+		image = loader.TakePreview(m_PendingImage);
+		if (!image)
 		{
-			m_FadeTimer = App::instance->settings.FadeDuration;
-			m_NextSprite->alpha = 0;
-			sprite = m_NextSprite;
+			return;
 		}
-		else
+		isPreview = true;
+	}
+
+	auto info = m_PendingImage;
+	m_PendingImage = nullptr;
+
+	if (FAILED(image->hr))
+	{
+		// Leave it out of the playlist for this session; a file WIC can't decode stays out until it changes
+		App::instance->m_Library.Skip(info);
+		m_CurrentImageIdx += m_PendingStep;
+		SelectPendingImage(numScreens);
+		return;
+	}
+
+	Sprite* sprite = m_CurrentSprite;
+	if (m_PendingAnimate)
+	{
+		m_FadeTimer = App::instance->settings.FadeDuration;
+		m_NextSprite->alpha = 0;
+		sprite = m_NextSprite;
+	}
+	else
+	{
+		EndFade();
+		if (sprite->imageInfo && sprite->imageInfo != info)
 		{
-			EndFade();
+			// Replaced without a fade: nobody is waiting for its location anymore
+			App::instance->m_Tasks.Cancel(sprite->imageInfo);
 		}
+	}
 
-		sprite->imageInfo = info;
-		LoadSprite(sprite);
-		if (sprite->bitmap)
+	// Its location comes before those of the photos that are only prefetched
+	App::instance->m_Tasks.Prioritize(info, TaskPool::OnScreen);
+	App::instance->m_Library.MarkShown(m_CurrentImageIdx, m_AdapterIndex, numScreens);
+	sprite->imageInfo = info;
+	m_NeedsRender = true;
+	if (SUCCEEDED(UploadSprite(sprite, *image)))
+	{
+		sprite->OnLoad();
+		if (isPreview)
 		{
-			break;
+			m_RefineImage = info;
 		}
+	}
+	else if (isPreview)
+	{
+		// The request is still there: show the full image when it is done instead
+		sprite->bitmap.Reset();
+		sprite->mipBitmaps.clear();
+		m_RefineImage = info;
+	}
+}
+
+void ScreenSaverWindow::RefineImage()
+{
+	if (!m_RefineImage || !m_pRenderTarget)
+	{
+		return;
+	}
+
+	auto image = App::instance->m_Loader.Take(m_RefineImage);
+	if (!image)
+	{
+		return;
+	}
 
-		if (!m_pRenderTarget)
+	// The preview has the shape of the photo and sprites are drawn at screen size whatever
+	// their resolution, so swapping the bitmap keeps the pan and zoom where they are.
+	// If the full decode failed, the preview just stays. Without a preview (it could not be
+	// uploaded) the sprite starts its pan and zoom now.
+	auto info = m_RefineImage;
+	m_RefineImage = nullptr;
+	for (Sprite* sprite : { m_CurrentSprite, m_NextSprite })
+	{
+		if (sprite->imageInfo == info)
 		{
-			// Exit because bitmap will be null.
-			return;
+			bool hasPreview = sprite->bitmap.Get() != nullptr;
+			if (SUCCEEDED(UploadSprite(sprite, *image)) && !hasPreview)
+			{
+				sprite->OnLoad();
+			}
+			m_NeedsRender = true;
 		}
-
-		offset = offset >= 0 ? 1 : -1;
-		m_CurrentImageIdx += offset;
 	}
 }
 
@@ -557,13 +626,34 @@ void ScreenSaverWindow::EndFade()
 {
 	m_FadeTimer = 0.0f;
 	m_CurrentSprite->alpha = 1;
+	if (m_NextSprite->imageInfo && m_NextSprite->imageInfo != m_CurrentSprite->imageInfo)
+	{
+		App::instance->m_Tasks.Cancel(m_NextSprite->imageInfo);
+	}
 	m_NextSprite->Clear();
+	m_NeedsRender = true;
 }
 
 void ScreenSaverWindow::Update(float deltaTime)
 {
+	auto numScreens = (int)App::instance->m_Screensavers.size();
+	ShowPendingImage(numScreens);
+	RefineImage();
+
+	if (!m_CurrentSprite->imageInfo && !m_PendingImage && m_pRenderTarget)
+	{
+		// The library is still being scanned, show the first photo as soon as there is one
+		StartSwap(false, 0, numScreens);
+	}
+
+	// A paused show still shows what the arrow keys and the buttons asked for, it just doesn't move
+	if (App::instance->m_IsPaused) {
+		return;
+	}
+
 	m_CurrentSprite->Update(deltaTime);
 	m_NextSprite->Update(deltaTime);
+	m_SinceRender += deltaTime;
 
 	if (m_FadeTimer > 0.0f) {
 		m_FadeTimer -= deltaTime;
@@ -575,6 +665,92 @@ void ScreenSaverWindow::Update(float deltaTime)
 	}
 }
 
+void ScreenSaverWindow::StartRenderThread()
+{
+	m_WakeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	m_RenderThread = std::thread(&ScreenSaverWindow::RenderThreadMain, this);
+}
+
+// The wake event stays open, the image loader may still set it
+void ScreenSaverWindow::StopRenderThread()
+{
+	if (m_RenderThread.joinable()) {
+		Wake();
+		m_RenderThread.join();
+	}
+}
+
+void ScreenSaverWindow::Wake()
+{
+	if (m_WakeEvent) {
+		SetEvent(m_WakeEvent);
+	}
+}
+
+// Updates and draws this window only, so a monitor that waits for its vertical blank
+// (in EndDraw) doesn't hold up the others. Everything else happens under the app's
+// state lock, which the UI thread holds while it handles input, so the library, the
+// votes and the photo infos don't change halfway through a frame. A lost render target
+// is made again before taking the lock.
+void ScreenSaverWindow::RenderThreadMain()
+{
+	auto app = App::instance;
+	const auto& settings = app->settings;
+	const auto maxIdleTime = 1.f;
+	auto previousFrameStart = std::chrono::steady_clock::now();
+
+	while (!app->m_StopRendering) {
+		auto frameStart = std::chrono::steady_clock::now();
+		auto deltaTime = std::chrono::duration<float>(frameStart - previousFrameStart).count();
+		previousFrameStart = frameStart;
+
+		bool needsTarget;
+		UINT32 textColor;
+		{
+			std::lock_guard<std::mutex> lock(app->m_StateMutex);
+			needsTarget = !m_pRenderTarget;
+			textColor = settings.TextColor;
+		}
+		ComPtr<ID2D1HwndRenderTarget> newTarget;
+		ComPtr<ID2D1SolidColorBrush> newBrush;
+		if (needsTarget) {
+			CreateRenderTarget(newTarget, newBrush, textColor);
+		}
+
+		ComPtr<ID2D1HwndRenderTarget> target;
+		{
+			std::lock_guard<std::mutex> lock(app->m_StateMutex);
+			if (newTarget && !m_pRenderTarget) {
+				m_pRenderTarget = newTarget;
+				m_pTextFillBrush = newBrush;
+				m_NeedsRender = true;
+			}
+			Update(deltaTime);
+			// Without a target DrawFrame would make one here, under the lock
+			if (m_pRenderTarget && (!settings.OnDemandRendering || TimeUntilRender() <= 0) && SUCCEEDED(DrawFrame())) {
+				target = m_pRenderTarget;
+			}
+		}
+
+		if (target) {
+			HRESULT hr = target->EndDraw();
+			std::lock_guard<std::mutex> lock(app->m_StateMutex);
+			EndFrame(hr);
+		}
+
+		float waitTime = 0;
+		if (settings.OnDemandRendering) {
+			std::lock_guard<std::mutex> lock(app->m_StateMutex);
+			waitTime = app->m_IsPaused ? (m_NeedsRender ? 0 : maxIdleTime) : std::min(TimeUntilRender(), maxIdleTime);
+		}
+		auto frameTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - frameStart).count();
+		waitTime = std::max(waitTime, 1 / GetMaxFrameRate() - frameTime);
+		if (waitTime > 0) {
+			WaitForSingleObject(m_WakeEvent, (DWORD)(waitTime * 1000));
+		}
+	}
+}
+
 static void ShowMyCursor(bool show)
 {
 	if (show)
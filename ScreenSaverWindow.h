@@ -2,17 +2,25 @@
 #define UNICODE
 #endif
 
+#include <algorithm>
+#include <chrono>
 #include <string>
+#include <thread>
+#include <vector>
 #include <d2d1.h>
 #include <wrl/client.h>
+#include "CaptionCache.h"
 
 using Microsoft::WRL::ComPtr;
 class ImageInfo;
+struct DecodedImage;
+struct DecodeJob;
 
 class Sprite
 {
 public:
 	ComPtr<ID2D1Bitmap> bitmap;
+	std::vector<ComPtr<ID2D1Bitmap>> mipBitmaps; // Each half the size of the one before
 	D2D1_SIZE_F originalSize;
 	ImageInfo* imageInfo;
 
@@ -34,6 +42,25 @@ public:
 	void Update(float deltaTime);
 };
 
+// How long drawing and presenting took on one monitor, logged on exit
+struct FrameStats
+{
+	UINT64 frames = 0;
+	UINT64 lateFrames = 0; // Took longer than one and a half frame at MaxFPS
+	double totalSeconds = 0;
+	double worstSeconds = 0;
+
+	void Add(double seconds, double frameBudget)
+	{
+		++frames;
+		totalSeconds += seconds;
+		worstSeconds = std::max(worstSeconds, seconds);
+		if (seconds > frameBudget * 1.5) {
+			++lateFrames;
+		}
+	}
+};
+
 class ScreenSaverWindow
 {
 public:
@@ -45,23 +72,52 @@ public:
 	ComPtr<ID2D1HwndRenderTarget> m_pRenderTarget = nullptr;
 	Sprite* m_CurrentSprite = new Sprite();
 	Sprite* m_NextSprite = new Sprite();
-	ComPtr<ID2D1SolidColorBrush> m_pTextOutlineBrush;
+	ImageInfo* m_PendingImage = nullptr;
+	ImageInfo* m_RefineImage = nullptr; // Shown as its embedded preview, the full image is still decoding
+	bool m_PendingAnimate = false;
+	int m_PendingStep = 1;
 	ComPtr<ID2D1SolidColorBrush> m_pTextFillBrush;
-	ComPtr<IDWriteTextLayout> m_pTextLayout = nullptr;
+	CaptionCache m_Captions;
+	ImageInfo* m_CaptionInfo = nullptr;
+	std::wstring m_Caption;
 
 	float m_FadeTimer = 0;
+	bool m_NeedsRender = true; // Something changed that the last frame doesn't show
+	float m_SinceRender = 0;
+	std::chrono::steady_clock::time_point m_DrawStart;
+	FrameStats m_FrameStats;
+	std::thread m_RenderThread; // Only with RenderThreads
+	HANDLE m_WakeEvent = nullptr;
 
+	HRESULT CreateRenderTarget(ComPtr<ID2D1HwndRenderTarget>& target, ComPtr<ID2D1SolidColorBrush>& brush, UINT32 textColor) const;
 	HRESULT CreateDeviceResources();
-	HRESULT LoadBitmapFromFileWithTransparencyMixedToBlack(Sprite* sprite) const;
+	HRESULT UploadSprite(Sprite* sprite, const DecodedImage& image) const;
 	void DiscardDeviceResources();
-	void LoadSprite(Sprite* sprite);
+	void SelectPendingImage(int numScreens);
+	void ShowPendingImage(int numScreens);
+	void RefineImage();
+	void PrefetchUpcoming(int numScreens);
+	DecodeJob MakeDecodeJob(ImageInfo* info) const;
 	void DrawSprite(Sprite* sprite);
+	D2D1_RECT_F GetSpriteRect(const Sprite* sprite, float progress) const;
+	float GetSpriteSpeed(const Sprite* sprite) const;
+	// Frames per second the motion on screen needs, between MinFPS and MaxFPS, 0 when nothing moves
+	float GetFrameRate() const;
+	static float GetMaxFrameRate();
+	// Seconds until the window looks different from its last frame, 0 when it has to be drawn now
+	float TimeUntilRender() const;
 	HRESULT OnRender();
+	// OnRender in two: everything up to EndDraw, and what to do with its result
+	HRESULT DrawFrame();
+	HRESULT EndFrame(HRESULT hr);
 	void RenderText(const std::wstring& caption, float alpha, float x, float y, float w, float h);
 	void OnResize(UINT width, UINT height);
 	RECT GetMaximizedRect();
 	void Update(float deltaTime);
 	void StartSwap(bool animate, int offset, int numScreens);
 	void EndFade();
-	void DrawHackOutline(float x, float y, float xo, float yo);
+	void StartRenderThread();
+	void StopRenderThread();
+	void Wake();
+	void RenderThreadMain();
 };
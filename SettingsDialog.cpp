@@ -46,6 +46,31 @@ SettingsDialog::SettingsDialog()
 	SyncChange = ReadBool(INI_SETTINGS, L"SyncChange", SyncChange);
 	SingleScreen = ReadBool(INI_SETTINGS, L"SingleScreen", SingleScreen);
 	PanScanFactor = ReadFloat(INI_SETTINGS, L"PanScanFactor", PanScanFactor);
+	PrefetchDepth = ReadInt(INI_SETTINGS, L"PrefetchDepth", PrefetchDepth);
+	PrefetchMemoryMB = ReadInt(INI_SETTINGS, L"PrefetchMemoryMB", PrefetchMemoryMB);
+	DecodeCacheMB = ReadInt(INI_SETTINGS, L"DecodeCacheMB", DecodeCacheMB);
+	PreviewMinFraction = ReadFloat(INI_SETTINGS, L"PreviewMinFraction", PreviewMinFraction);
+	OnDemandRendering = ReadBool(INI_SETTINGS, L"OnDemandRendering", OnDemandRendering);
+	MinFPS = ReadFloat(INI_SETTINGS, L"MinFPS", MinFPS);
+	MaxFPS = ReadFloat(INI_SETTINGS, L"MaxFPS", MaxFPS);
+	// Whatever the ini says, even NaN, MaxFPS ends up in 1 to 240 and MinFPS in 0.1 to MaxFPS
+	if (!(MaxFPS >= 1.f)) {
+		MaxFPS = 1.f;
+	}
+	else if (MaxFPS > 240.f) {
+		MaxFPS = 240.f;
+	}
+	if (!(MinFPS >= 0.1f)) {
+		MinFPS = 0.1f;
+	}
+	if (MinFPS > MaxFPS) {
+		MinFPS = MaxFPS;
+	}
+	RenderThreads = ReadBool(INI_SETTINGS, L"RenderThreads", RenderThreads);
+	PlacesFile = ReadString(INI_SETTINGS, L"PlacesFile", PlacesFile.c_str());
+	GeocodeUrl = ReadString(INI_SETTINGS, L"GeocodeUrl", GeocodeUrl.c_str());
+	ScanThreads = ReadInt(INI_SETTINGS, L"ScanThreads", ScanThreads);
+	LovedEvery = ReadInt(INI_SETTINGS, L"LovedEvery", LovedEvery);
 	ShowDate = ReadBool(INI_SETTINGS, L"ShowDate", ShowDate);
 	ShowLocation = ReadBool(INI_SETTINGS, L"ShowLocation", ShowLocation);
 	ShowFolder = ReadBool(INI_SETTINGS, L"ShowFolder", ShowFolder);
@@ -82,6 +107,18 @@ void SettingsDialog::Show()
 		WriteBool(INI_SETTINGS, L"SyncChange", SyncChange);
 		WriteBool(INI_SETTINGS, L"SingleScreen", SingleScreen);
 		WriteFloat(INI_SETTINGS, L"PanScanFactor", PanScanFactor);
+		WriteInt(INI_SETTINGS, L"PrefetchDepth", PrefetchDepth);
+		WriteInt(INI_SETTINGS, L"PrefetchMemoryMB", PrefetchMemoryMB);
+		WriteInt(INI_SETTINGS, L"DecodeCacheMB", DecodeCacheMB);
+		WriteFloat(INI_SETTINGS, L"PreviewMinFraction", PreviewMinFraction);
+		WriteBool(INI_SETTINGS, L"OnDemandRendering", OnDemandRendering);
+		WriteFloat(INI_SETTINGS, L"MinFPS", MinFPS);
+		WriteFloat(INI_SETTINGS, L"MaxFPS", MaxFPS);
+		WriteBool(INI_SETTINGS, L"RenderThreads", RenderThreads);
+		WriteString(INI_SETTINGS, L"PlacesFile", PlacesFile);
+		WriteString(INI_SETTINGS, L"GeocodeUrl", GeocodeUrl);
+		WriteInt(INI_SETTINGS, L"ScanThreads", ScanThreads);
+		WriteInt(INI_SETTINGS, L"LovedEvery", LovedEvery);
 		WriteBool(INI_SETTINGS, L"ShowFolder", ShowFolder);
 		WriteBool(INI_SETTINGS, L"ShowLocation", ShowLocation);
 		WriteBool(INI_SETTINGS, L"ShowDate", ShowDate);
@@ -601,7 +638,7 @@ std::vector<std::wstring> ReadList(LPCWSTR section, LPCWSTR key) {
 	return SplitList(ReadString(section, key, nullptr));
 }
 
-std::wstring EnsureIniFileExists(bool create) {
+std::wstring GetAppDataFilePath(const std::wstring& fileName, bool create) {
 	// Get AppData directory path
 	wchar_t* cpath = nullptr;
 	HRESULT hr = SHGetKnownFolderPath(FOLDERID_RoamingAppData, 0, nullptr, &cpath);
@@ -626,10 +663,14 @@ std::wstring EnsureIniFileExists(bool create) {
 		}
 	}
 
-	// Append your app's folder to the AppData path
-	wpath += L"\\config.ini";
+	// Append the file name to our app's folder
+	return wpath + L"\\" + fileName;
+}
 
-	if (create)
+std::wstring EnsureIniFileExists(bool create) {
+	auto wpath = GetAppDataFilePath(L"config.ini", create);
+
+	if (create && !wpath.empty())
 	{
 		DWORD attr = GetFileAttributes(wpath.c_str());
 		if (attr == INVALID_FILE_ATTRIBUTES) {
@@ -19,6 +19,18 @@ public:
 	bool SyncChange = false;
 	bool SingleScreen = false;
 	float PanScanFactor = 1;
+	int PrefetchDepth = 2;
+	int PrefetchMemoryMB = 512;
+	int DecodeCacheMB = 256;
+	float PreviewMinFraction = 0.5f;
+	bool OnDemandRendering = true;
+	float MinFPS = 2;
+	float MaxFPS = 60;
+	bool RenderThreads = false;
+	std::wstring GeocodeUrl = L"https://nominatim.openstreetmap.org/reverse";
+	std::wstring PlacesFile; // GeoNames place list for offline locations, cities1000.txt in the app folder when empty
+	int ScanThreads = 8;
+	int LovedEvery = 10; // Every so many photos is one of the loved ones, 0 never
 	DWRITE_FONT_WEIGHT FontWeight = DWRITE_FONT_WEIGHT_BOLD;
 	std::vector<std::wstring> IncludePaths;
 	std::vector<std::wstring> ExcludePaths;
@@ -32,3 +44,6 @@ public:
 private:
 	static INT_PTR CALLBACK SettingsDlgProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam);
 };
+
+// Full path of a file in the %APPDATA%\PhotoCycle folder, optionally creating the folder.
+std::wstring GetAppDataFilePath(const std::wstring& fileName, bool create);
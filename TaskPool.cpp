@@ -0,0 +1,144 @@
+#include "TaskPool.h"
+
+#include <algorithm>
+#include <iostream>
+
+void TaskPool::Start(int numThreads, size_t maxQueued)
+{
+	m_Stopping = false;
+	m_MaxQueued = std::max<size_t>(1, maxQueued);
+	for (int i = 0; i < std::max(1, numThreads); ++i) {
+		m_Workers.emplace_back(&TaskPool::WorkerMain, this);
+	}
+}
+
+void TaskPool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stopping = true;
+		while (!m_Queue.empty()) {
+			DropTask(m_Queue.begin());
+		}
+	}
+	m_WakeUp.notify_all();
+
+	for (auto& worker : m_Workers) {
+		worker.join();
+	}
+	m_Workers.clear();
+}
+
+void TaskPool::Submit(const void* owner, Priority priority, Work work, Result cancelled)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (m_Stopping || m_Workers.empty()) {
+			m_Results.push_back(std::move(cancelled));
+			return;
+		}
+
+		if (m_Queue.size() >= m_MaxQueued) {
+			// Make room by dropping the oldest of the least important tasks
+			auto lowest = std::min_element(m_Queue.begin(), m_Queue.end(),
+				[](const Task& a, const Task& b) { return a.priority < b.priority; });
+			if (lowest->priority > priority) {
+				m_Results.push_back(std::move(cancelled));
+				return;
+			}
+			DropTask(lowest);
+		}
+
+		m_Queue.push_back({ owner, priority, std::move(work), std::move(cancelled) });
+	}
+	m_WakeUp.notify_one();
+}
+
+void TaskPool::Prioritize(const void* owner, Priority priority)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (auto& task : m_Queue) {
+		if (task.owner == owner) {
+			task.priority = priority;
+		}
+	}
+}
+
+void TaskPool::Cancel(const void* owner)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (auto it = m_Queue.begin(); it != m_Queue.end();) {
+		if (it->owner == owner) {
+			m_Results.push_back(std::move(it->cancelled));
+			it = m_Queue.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+size_t TaskPool::QueuedCount()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Queue.size();
+}
+
+size_t TaskPool::DeliverResults()
+{
+	std::vector<Result> results;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		results.swap(m_Results);
+	}
+
+	for (auto& result : results) {
+		if (result) {
+			result();
+		}
+	}
+	return results.size();
+}
+
+void TaskPool::DropTask(std::deque<Task>::iterator task)
+{
+	m_Results.push_back(std::move(task->cancelled));
+	m_Queue.erase(task);
+}
+
+void TaskPool::WorkerMain()
+{
+	while (true) {
+		Task task;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_WakeUp.wait(lock, [this] { return m_Stopping || !m_Queue.empty(); });
+			if (m_Queue.empty()) {
+				break;
+			}
+
+			// The first of the most important tasks
+			auto next = std::max_element(m_Queue.begin(), m_Queue.end(),
+				[](const Task& a, const Task& b) { return a.priority < b.priority; });
+			task = std::move(*next);
+			m_Queue.erase(next);
+		}
+
+		Result result;
+		try {
+			result = task.work();
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Background task failed: " << e.what() << std::endl;
+			result = std::move(task.cancelled);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Results.push_back(std::move(result));
+		}
+		if (m_OnResult) {
+			m_OnResult();
+		}
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A few threads for slow background work, like online location lookups, instead of a
+// thread per photo. Tasks belong to an owner (the photo they are for), which can move them
+// to the front of the queue or cancel them while they are queued.
+// The queue is bounded: when it is full, the queued task with the lowest priority that was
+// queued first is dropped. Work returns a result that is applied on the UI thread by
+// DeliverResults, so owners are only ever changed on that thread; a dropped or cancelled
+// task delivers its `cancelled` callback instead.
+class TaskPool {
+public:
+	enum Priority { Background = 0, OnScreen = 1 };
+
+	using Result = std::function<void()>;
+	using Work = std::function<Result()>;
+
+	~TaskPool() { Stop(); }
+
+	// Called, on a worker thread, when a result is waiting for DeliverResults. Set before Start.
+	void SetOnResult(std::function<void()> onResult) { m_OnResult = std::move(onResult); }
+	void Start(int numThreads, size_t maxQueued);
+	// Waits for running tasks and cancels the queued ones.
+	void Stop();
+
+	void Submit(const void* owner, Priority priority, Work work, Result cancelled);
+	void Prioritize(const void* owner, Priority priority);
+	void Cancel(const void* owner);
+	// How many tasks are waiting for a worker. Never more than maxQueued.
+	size_t QueuedCount();
+
+	// Applies the results of finished tasks and returns how many there were. Call from the UI thread.
+	size_t DeliverResults();
+
+private:
+	struct Task {
+		const void* owner = nullptr;
+		Priority priority = Background;
+		Work work;
+		Result cancelled;
+	};
+
+	void WorkerMain();
+	void DropTask(std::deque<Task>::iterator task);
+
+	std::vector<std::thread> m_Workers;
+	std::mutex m_Mutex;
+	std::condition_variable m_WakeUp;
+	bool m_Stopping = false;
+	size_t m_MaxQueued = 0;
+	std::deque<Task> m_Queue;
+	std::vector<Result> m_Results;
+	std::function<void()> m_OnResult;
+};
@@ -287,6 +287,28 @@ class EXIV2API Image {
     little-endian byte order (II) is used by default.
    */
   void setByteOrder(ByteOrder byteOrder);
+  /*!
+    @brief Restrict the metadata which readMetadata() decodes.
+
+    Only the metadata types in \em metadataIds, a bitmap of MetadataId
+    values, are decoded, the others are left empty. Image formats which
+    support it also skip the segments of other metadata types without
+    reading them and stop reading as soon as all requested metadata is
+    found. Formats which don't support it read everything.
+    The default is to read all metadata.
+
+    Do not call writeMetadata() on an image which was read with a filter,
+    it would remove the metadata that was not read.
+   */
+  void setReadFilter(uint16_t metadataIds);
+  /*!
+    @brief Parse metadata directly from a memory mapped view of the image
+           in readMetadata(), instead of reading it into buffers first.
+
+    Only the metadata which is kept is copied. Image formats which don't
+    support it read as usual. The default is not to map the image.
+   */
+  void setReadMapped(bool flag);
 
   /*!
     @brief Print out the structure of image file.
@@ -338,6 +360,10 @@ class EXIV2API Image {
            encoded. Initially, it is not set (\em invalidByteOrder).
    */
   [[nodiscard]] ByteOrder byteOrder() const;
+  //! Return the bitmap of MetadataId values which readMetadata() decodes.
+  [[nodiscard]] uint16_t readFilter() const;
+  //! Return true if readMetadata() parses from a memory mapped view of the image.
+  [[nodiscard]] bool readMapped() const;
 
   /*! @brief Check if the Image instance is valid. Use after object construction.
     @return true if the Image is in a valid state.
@@ -487,6 +513,8 @@ class EXIV2API Image {
   bool writeXmpFromPacket_{true};  //!< Determines the source when writing XMP
 #endif
   ByteOrder byteOrder_{invalidByteOrder};  //!< Byte order
+  uint16_t readFilter_{mdExif | mdIptc | mdComment | mdXmp | mdIccProfile};  //!< Metadata types to read
+  bool readMapped_{false};                                                    //!< Parse from a mapped view
 
   std::map<int, std::string> tags_;  //!< Map of tags
   bool init_{true};                  //!< Flag marking if map of tags needs to be initialized
@@ -604,23 +604,33 @@ void BmffImage::parseTiff(uint32_t root_tag, uint64_t length, uint64_t start) {
                     ErrorCode::kerCorruptedMetadata);
   Internal::enforce(length <= std::numeric_limits<size_t>::max(), ErrorCode::kerCorruptedMetadata);
 
-  // read and parse exif data
+  // read and parse exif data, in place if the file can be mapped
   const size_t restore = io_->tell();
-  DataBuf exif(static_cast<size_t>(length));
-  io_->seek(static_cast<int64_t>(start), BasicIo::beg);
-  if (exif.size() > 8 && io_->read(exif.data(), exif.size()) == exif.size()) {
+  const auto size = static_cast<size_t>(length);
+  DataBuf buf;
+  const byte* exif = nullptr;
+  if (size > 8 && readMapped()) {
+    exif = io_->mmap() + start;
+  } else if (size > 8) {
+    buf.alloc(size);
+    io_->seek(static_cast<int64_t>(start), BasicIo::beg);
+    if (io_->read(buf.data(), buf.size()) == buf.size())
+      exif = buf.c_data();
+  }
+  if (exif) {
+    const Slice<const byte*> view(exif, 0, size);
     // hunt for "II" or "MM"
     const size_t eof = std::numeric_limits<size_t>::max();  // impossible value for punt
     size_t punt = eof;
-    for (size_t i = 0; i < exif.size() - 9 && punt == eof; ++i) {
-      auto charCurrent = exif.read_uint8(i);
-      auto charNext = exif.read_uint8(i + 1);
+    for (size_t i = 0; i < size - 9 && punt == eof; ++i) {
+      auto charCurrent = view.at(i);
+      auto charNext = view.at(i + 1);
       if (charCurrent == charNext && (charCurrent == 'I' || charCurrent == 'M'))
         punt = i;
     }
     if (punt != eof) {
-      Internal::TiffParserWorker::decode(exifData(), iptcData(), xmpData(), exif.c_data(punt), exif.size() - punt,
-                                         root_tag, Internal::TiffMapping::findDecoder);
+      Internal::TiffParserWorker::decode(exifData(), iptcData(), xmpData(), exif + punt, size - punt, root_tag,
+                                         Internal::TiffMapping::findDecoder);
     }
   }
   io_->seek(restore, BasicIo::beg);
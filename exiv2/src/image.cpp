@@ -649,6 +649,22 @@ ByteOrder Image::byteOrder() const {
   return byteOrder_;
 }
 
+void Image::setReadFilter(uint16_t metadataIds) {
+  readFilter_ = metadataIds;
+}
+
+uint16_t Image::readFilter() const {
+  return readFilter_;
+}
+
+void Image::setReadMapped(bool flag) {
+  readMapped_ = flag;
+}
+
+bool Image::readMapped() const {
+  return readMapped_;
+}
+
 uint32_t Image::pixelWidth() const {
   return pixelWidth_;
 }
@@ -118,6 +118,57 @@ std::pair<std::array<byte, 2>, uint16_t> readSegmentSize(const byte marker, Basi
   }
   return {buf, size};
 }
+
+/// @brief Bounds checked, read-only view of a JPEG segment, including its 2-byte size field.
+///        It points either into a DataBuf or into the memory mapped file.
+class SegmentView {
+ public:
+  SegmentView(const byte* data, size_t size) : data_(data), size_(size) {
+  }
+
+  [[nodiscard]] size_t size() const {
+    return size_;
+  }
+
+  [[nodiscard]] const byte* c_data(size_t offset) const {
+    if (size_ == 0 || offset == size_) {
+      return nullptr;
+    }
+    return &slice(offset, offset + 1).at(0);
+  }
+
+  [[nodiscard]] const char* c_str(size_t offset) const {
+    return reinterpret_cast<const char*>(c_data(offset));
+  }
+
+  [[nodiscard]] int cmpBytes(size_t offset, const void* buf, size_t bufsize) const {
+    return memcmp(&slice(offset, offset + bufsize).at(0), buf, bufsize);
+  }
+
+  [[nodiscard]] uint8_t read_uint8(size_t offset) const {
+    return slice(offset, offset + 1).at(0);
+  }
+
+  [[nodiscard]] uint16_t read_uint16(size_t offset, ByteOrder byteOrder) const {
+    return getUShort(slice(offset, offset + 2), byteOrder);
+  }
+
+  [[nodiscard]] uint32_t read_uint32(size_t offset, ByteOrder byteOrder) const {
+    return getULong(&slice(offset, offset + 4).at(0), byteOrder);
+  }
+
+ private:
+  //! Throws std::out_of_range unless [begin, end) lies within the segment
+  [[nodiscard]] Slice<const byte*> slice(size_t begin, size_t end) const {
+    if (end < begin || end > size_) {
+      throw std::out_of_range("Overflow in Exiv2::SegmentView");
+    }
+    return Slice<const byte*>(data_, 0, size_).subSlice(begin, end);
+  }
+
+  const byte* data_;
+  size_t size_;
+};
 }  // namespace
 
 JpegBase::JpegBase(ImageType type, BasicIo::UniquePtr io, bool create, const byte initData[], size_t dataSize) :
@@ -168,7 +219,24 @@ void JpegBase::readMetadata() {
     throw Error(ErrorCode::kerNotAJpeg);
   }
   clearMetadata();
-  int search = 6;  // Exif, ICC, XMP, Comment, IPTC, SOF
+
+  // Parse segments in place from a memory mapped view if requested, instead of copying
+  // each of them. Only the metadata that is kept gets copied.
+  const byte* mapped = nullptr;
+  const size_t mappedSize = io_->size();
+  if (readMapped() && mappedSize > 0) {
+    mapped = io_->mmap();
+  }
+
+  // Exif, ICC, XMP, Comment, IPTC (as far as requested) and SOF
+  const uint16_t filter = readFilter();
+  const bool readAll = (filter & (mdExif | mdIptc | mdComment | mdXmp | mdIccProfile)) ==
+                       (mdExif | mdIptc | mdComment | mdXmp | mdIccProfile);
+  int search = 1;
+  for (auto metadataId : {mdExif, mdIccProfile, mdXmp, mdComment, mdIptc}) {
+    if (filter & metadataId)
+      ++search;
+  }
   Blob psBlob;
   bool foundCompletePsData = false;
   bool foundExifData = false;
@@ -181,24 +249,56 @@ void JpegBase::readMetadata() {
   while (marker != sos_ && marker != eoi_ && search > 0) {
     const auto [sizebuf, size] = readSegmentSize(marker, *io_);
 
+    // With a read filter, step over segments that can't contain anything requested
+    if (!readAll) {
+      const bool wanted = (marker == app1_ && (((filter & mdExif) && !foundExifData) ||
+                                               ((filter & mdXmp) && !foundXmpData))) ||
+                          (marker == app13_ && (filter & mdIptc) && !foundCompletePsData) ||
+                          (marker == com_ && (filter & mdComment) && comment_.empty()) ||
+                          (marker == app2_ && (filter & mdIccProfile)) || Exiv2::find(jpegProcessMarkerTags, marker);
+      if (!wanted) {
+        if (size > 2) {
+          io_->seekOrThrow(size - 2, BasicIo::cur, ErrorCode::kerFailedToReadImageData);
+        }
+        try {
+          marker = advanceToMarker(ErrorCode::kerFailedToReadImageData);
+        } catch (const Error&) {
+          rc = 5;
+          break;
+        }
+        continue;
+      }
+    }
+
     // Read the rest of the segment.
-    DataBuf buf(size);
-    // check if the segment is not empty
-    if (size > 2) {
-      io_->readOrThrow(buf.data(2), size - 2, ErrorCode::kerFailedToReadImageData);
-      std::copy(sizebuf.begin(), sizebuf.end(), buf.begin());
+    DataBuf buf;
+    const byte* segmentData = nullptr;
+    if (mapped && size > 2) {
+      const size_t start = io_->tell() - 2;
+      enforce(start <= mappedSize && size <= mappedSize - start, ErrorCode::kerFailedToReadImageData);
+      io_->seekOrThrow(size - 2, BasicIo::cur, ErrorCode::kerFailedToReadImageData);
+      segmentData = mapped + start;
+    } else {
+      buf.alloc(size);
+      // check if the segment is not empty
+      if (size > 2) {
+        io_->readOrThrow(buf.data(2), size - 2, ErrorCode::kerFailedToReadImageData);
+        std::copy(sizebuf.begin(), sizebuf.end(), buf.begin());
+      }
+      segmentData = buf.c_data();
     }
+    const SegmentView segment(segmentData, size);
 
     if (auto itSofMarker = Exiv2::find(jpegProcessMarkerTags, marker)) {
       sof_encoding_process_ = itSofMarker->label_;
-      if (size >= 7 && buf.c_data(7)) {
-        num_color_components_ = *buf.c_data(7);
+      if (size >= 7 && segment.c_data(7)) {
+        num_color_components_ = *segment.c_data(7);
       }
     }
 
-    if (!foundExifData && marker == app1_ && size >= 8  // prevent out-of-bounds read in memcmp on next line
-        && buf.cmpBytes(2, exifId_, 6) == 0) {
-      ByteOrder bo = ExifParser::decode(exifData_, buf.c_data(8), size - 8);
+    if (!foundExifData && (filter & mdExif) && marker == app1_ && size >= 8  // prevent out-of-bounds read in memcmp on next line
+        && segment.cmpBytes(2, exifId_, 6) == 0) {
+      ByteOrder bo = ExifParser::decode(exifData_, segment.c_data(8), size - 8);
       setByteOrder(bo);
       if (size > 8 && byteOrder() == invalidByteOrder) {
 #ifndef SUPPRESS_WARNINGS
@@ -208,9 +308,9 @@ void JpegBase::readMetadata() {
       }
       --search;
       foundExifData = true;
-    } else if (!foundXmpData && marker == app1_ && size >= 31  // prevent out-of-bounds read in memcmp on next line
-               && buf.cmpBytes(2, xmpId_, 29) == 0) {
-      xmpPacket_.assign(buf.c_str(31), size - 31);
+    } else if (!foundXmpData && (filter & mdXmp) && marker == app1_ && size >= 31  // prevent out-of-bounds read in memcmp on next line
+               && segment.cmpBytes(2, xmpId_, 29) == 0) {
+      xmpPacket_.assign(segment.c_str(31), size - 31);
       if (!xmpPacket_.empty() && XmpParser::decode(xmpData_, xmpPacket_)) {
 #ifndef SUPPRESS_WARNINGS
         EXV_WARNING << "Failed to decode XMP metadata.\n";
@@ -218,31 +318,31 @@ void JpegBase::readMetadata() {
       }
       --search;
       foundXmpData = true;
-    } else if (!foundCompletePsData && marker == app13_ &&
+    } else if (!foundCompletePsData && (filter & mdIptc) && marker == app13_ &&
                size >= 16  // prevent out-of-bounds read in memcmp on next line
-               && buf.cmpBytes(2, Photoshop::ps3Id_, 14) == 0) {
+               && segment.cmpBytes(2, Photoshop::ps3Id_, 14) == 0) {
 #ifdef EXIV2_DEBUG_MESSAGES
       std::cerr << "Found app13 segment, size = " << size << "\n";
 #endif
-      if (buf.size() > 16) {  // Append to psBlob
-        append(psBlob, buf.c_data(16), size - 16);
+      if (segment.size() > 16) {  // Append to psBlob
+        append(psBlob, segment.c_data(16), size - 16);
       }
       // Check whether psBlob is complete
       if (!psBlob.empty() && Photoshop::valid(psBlob.data(), psBlob.size())) {
         --search;
         foundCompletePsData = true;
       }
-    } else if (marker == com_ && comment_.empty()) {
+    } else if (marker == com_ && (filter & mdComment) && comment_.empty()) {
       // JPEGs can have multiple comments, but for now only read
       // the first one (most jpegs only have one anyway). Comments
       // are simple single byte ISO-8859-1 strings.
-      comment_.assign(buf.c_str(2), size - 2);
+      comment_.assign(segment.c_str(2), size - 2);
       while (!comment_.empty() && comment_.back() == '\0') {
         comment_.pop_back();
       }
       --search;
-    } else if (marker == app2_ && size >= 13  // prevent out-of-bounds read in memcmp on next line
-               && buf.cmpBytes(2, iccId_, 11) == 0) {
+    } else if (marker == app2_ && (filter & mdIccProfile) && size >= 13  // prevent out-of-bounds read in memcmp
+               && segment.cmpBytes(2, iccId_, 11) == 0) {
       if (size < 2 + 14 + 4) {
         rc = 8;
         break;
@@ -252,13 +352,13 @@ void JpegBase::readMetadata() {
         foundIccData = true;
         --search;
       }
-      auto chunk = static_cast<int>(buf.read_uint8(2 + 12));
-      auto chunks = static_cast<int>(buf.read_uint8(2 + 13));
+      auto chunk = static_cast<int>(segment.read_uint8(2 + 12));
+      auto chunks = static_cast<int>(segment.read_uint8(2 + 13));
       // ICC1v43_2010-12.pdf header is 14 bytes
       // header = "ICC_PROFILE\0" (12 bytes)
       // chunk/chunks are a single byte
       // Spec 7.2 Profile bytes 0-3 size
-      uint32_t s = buf.read_uint32(2 + 14, bigEndian);
+      uint32_t s = segment.read_uint32(2 + 14, bigEndian);
 #ifdef EXIV2_DEBUG_MESSAGES
       std::cerr << "Found ICC Profile chunk " << chunk << " of " << chunks << (chunk == 1 ? " size: " : "")
                 << (chunk == 1 ? s : 0) << std::endl;
@@ -274,7 +374,7 @@ void JpegBase::readMetadata() {
       if (!iccProfile_.empty()) {
         std::copy(iccProfile_.begin(), iccProfile_.end(), profile.begin());
       }
-      std::copy_n(buf.c_data(2 + 14), icc_size, profile.data() + iccProfile_.size());
+      std::copy_n(segment.c_data(2 + 14), icc_size, profile.data() + iccProfile_.size());
       setIccProfile(std::move(profile), chunk == chunks);
     } else if (pixelHeight_ == 0 && inRange2(marker, sof0_, sof3_, sof5_, sof15_)) {
       // We hit a SOFn (start-of-frame) marker
@@ -282,8 +382,8 @@ void JpegBase::readMetadata() {
         rc = 7;
         break;
       }
-      pixelHeight_ = buf.read_uint16(3, bigEndian);
-      pixelWidth_ = buf.read_uint16(5, bigEndian);
+      pixelHeight_ = segment.read_uint16(3, bigEndian);
+      pixelWidth_ = segment.read_uint16(5, bigEndian);
       if (pixelHeight_ != 0)
         --search;
     }
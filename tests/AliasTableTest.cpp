@@ -0,0 +1,147 @@
+#include "AliasTable.h"
+#include "Test.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+	// The exact probability of every index, read back from the table through Draw: the first
+	// random value of each column, and a binary search for where its coin turns to the alias
+	std::vector<double> Probabilities(const AliasTable& table)
+	{
+		auto n = table.Size();
+		std::vector<double> probabilities(n);
+		for (size_t column = 0; column < n; ++column) {
+			uint64_t high = ((uint64_t)column << 32) / n;
+			while (((high * n) >> 32) < column) {
+				++high;
+			}
+			auto draw = [&](uint64_t coin) { return table.Draw(high << 32 | coin); };
+
+			uint64_t kept = 0, end = 1ull << 32;
+			while (kept < end) {
+				auto middle = kept + (end - kept) / 2;
+				if (draw(middle) == column) {
+					kept = middle + 1;
+				}
+				else {
+					end = middle;
+				}
+			}
+			probabilities[column] += (double)kept / 4294967296.0 / n;
+			if (kept < (1ull << 32)) {
+				probabilities[draw(kept)] += (double)((1ull << 32) - kept) / 4294967296.0 / n;
+			}
+		}
+		return probabilities;
+	}
+
+	void TestExact(const std::vector<double>& weights)
+	{
+		AliasTable table;
+		table.Build(weights);
+		CHECK(table.Size() == weights.size());
+
+		double total = 0;
+		for (auto weight : weights) {
+			total += std::max(weight, 0.0);
+		}
+		auto probabilities = Probabilities(table);
+		int wrong = 0;
+		for (size_t i = 0; i < weights.size(); ++i) {
+			if (weights[i] <= 0 ? probabilities[i] != 0 : std::abs(probabilities[i] - weights[i] / total) > 1e-9) {
+				if (wrong++ < 5) {
+					std::printf("Index %zu of %zu: weight %g, drawn with %g instead of %g\n", i, weights.size(), weights[i],
+						probabilities[i], std::max(weights[i], 0.0) / total);
+				}
+			}
+		}
+		CHECK(wrong == 0);
+	}
+
+	void TestFrequencies()
+	{
+		// Weights like the loves of a few photos, with some that must never come
+		std::vector<double> weights = { 1, 2, 3, 4, 5, 0, 1, 1, 10, 0.5, -3 };
+		AliasTable table;
+		table.Build(weights);
+		double total = 0;
+		for (auto weight : weights) {
+			total += std::max(weight, 0.0);
+		}
+
+		std::mt19937_64 random(42);
+		const int draws = 1000000;
+		std::vector<int> counts(weights.size());
+		for (int i = 0; i < draws; ++i) {
+			++counts[table.Draw(random())];
+		}
+
+		double chiSquare = 0;
+		for (size_t i = 0; i < weights.size(); ++i) {
+			if (weights[i] <= 0) {
+				CHECK(counts[i] == 0);
+				continue;
+			}
+			double expected = draws * weights[i] / total;
+			chiSquare += (counts[i] - expected) * (counts[i] - expected) / expected;
+		}
+		// 8 degrees of freedom, p = 0.001
+		if (chiSquare >= 26.12) {
+			std::printf("Chi-square %.2f over the draws\n", chiSquare);
+		}
+		CHECK(chiSquare < 26.12);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Test::Init(argc, argv);
+
+	AliasTable table;
+	CHECK(table.IsEmpty());
+	table.Build({});
+	CHECK(table.IsEmpty());
+	table.Build({ 0, -1, 0 });
+	CHECK(table.IsEmpty());
+	table.Build({ 3 });
+	CHECK(table.Size() == 1 && table.Draw(0) == 0 && table.Draw(UINT64_MAX) == 0);
+
+	TestExact({ 1 });
+	TestExact({ 1, 1 });
+	TestExact({ 0, 5 });
+	TestExact({ 1, 2, 3, 4, 5, 0, 1, 1, 10, 0.5, -3 });
+	TestExact({ 1e-6, 1, 1e6 });
+	std::mt19937_64 random(3);
+	std::vector<double> library(5000, 1.0);
+	for (int i = 0; i < 200; ++i) {
+		library[random() % library.size()] = (double)(random() % 6);
+	}
+	TestExact(library);
+	TestFrequencies();
+
+	if (Test::bench) {
+		// A large library with a few loved photos, and the loved photos on their own
+		std::vector<double> weights(1000000, 1.0);
+		for (int i = 0; i < 1000; ++i) {
+			weights[random() % weights.size()] = 1.0 + random() % 5;
+		}
+		std::vector<double> loved(1000);
+		for (auto& weight : loved) {
+			weight = 1.0 + random() % 5;
+		}
+		auto buildSeconds = Test::Time(3, [&] { table.Build(weights); });
+		auto lovedSeconds = Test::Time(3, [&] { table.Build(loved); });
+		table.Build(weights);
+		size_t sum = 0;
+		auto drawSeconds = Test::Time(3, [&] {
+			for (int i = 0; i < 10000000; ++i) {
+				sum += table.Draw(random());
+			}
+		});
+		std::printf("Build: %.1f ms for a million weights, %.1f us for a thousand. Draw: %.1f ns (%zu)\n",
+			buildSeconds * 1000, lovedSeconds * 1e6, drawSeconds / 1e7 * 1e9, sum % 7);
+	}
+	return Test::Finish();
+}
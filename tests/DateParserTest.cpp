@@ -0,0 +1,276 @@
+#include "DateParser.h"
+#include "Test.h"
+
+#include <climits>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace {
+	// The regular expressions the parsers replaced, as the reference they must agree with
+	struct ReferenceResult {
+		bool success = false;
+		std::tm date = {};
+		double confidence = 0;
+		std::string pattern;
+		std::string explanation;
+	};
+
+	ReferenceResult ReferenceExtract(std::wstring name)
+	{
+		auto dot = name.find_last_of(L'.');
+		if (dot != std::wstring::npos) {
+			name = name.substr(0, dot);
+		}
+
+		ReferenceResult result;
+		auto matched = [&result](double confidence, const char* pattern) {
+			result.confidence = confidence;
+			result.pattern = pattern;
+			result.explanation = std::string("Matched ") + pattern + " pattern";
+			return result;
+		};
+		auto setDate = [&result](const std::wsmatch& m, bool hasTime) {
+			result.success = true;
+			result.date.tm_year = std::stoi(m[1]) - 1900;
+			result.date.tm_mon = std::stoi(m[2]) - 1;
+			result.date.tm_mday = std::stoi(m[3]);
+			if (hasTime) {
+				result.date.tm_hour = std::stoi(m[4]);
+				result.date.tm_min = std::stoi(m[5]);
+				result.date.tm_sec = std::stoi(m[6]);
+			}
+		};
+
+		const auto icase = std::regex_constants::icase;
+		std::wsmatch m;
+		if (std::regex_search(name, m, std::wregex(L"(?:^|[^\\d])IMG_(\\d{4})(\\d{2})(\\d{2})_(\\d{2})(\\d{2})(\\d{2})(?:[^\\d]|$)", icase))) {
+			setDate(m, true);
+			return matched(0.9, "iPhone");
+		}
+		if (std::regex_search(name, m, std::wregex(L"(?:^|[^\\d])DSC_(\\d{4})(\\d{2})(\\d{2})_(\\d{2})(\\d{2})(\\d{2})(?:[^\\d]|$)", icase))) {
+			setDate(m, true);
+			return matched(0.9, "Digital Camera (DSC)");
+		}
+		if (std::regex_search(name, m, std::wregex(L"(?:^|[^\\d])IMG-(\\d{4})(\\d{2})(\\d{2})-WA\\d+(?:[^\\d]|$)", icase))) {
+			setDate(m, false);
+			return matched(0.85, "WhatsApp");
+		}
+		if (std::regex_search(name, m, std::wregex(L"(?:^|[^\\d])Screenshot_(\\d{4})(\\d{2})(\\d{2})-(\\d{2})(\\d{2})(\\d{2})(?:[^\\d]|$)", icase))) {
+			setDate(m, true);
+			return matched(0.9, "Android Screenshot");
+		}
+		if (std::regex_search(name, m, std::wregex(L"(?:^|[^\\d])(\\d{4})-(\\d{2})-(\\d{2})_(\\d{2})-(\\d{2})-(\\d{2})(?:[^\\d]|$)"))) {
+			setDate(m, true);
+			return matched(0.95, "ISO Format");
+		}
+		if (std::regex_search(name, m, std::wregex(L"(?:^|[^\\d])(\\d{4})(\\d{2})(\\d{2})(?:[^\\d]|$)"))) {
+			int year = std::stoi(m[1]), month = std::stoi(m[2]), day = std::stoi(m[3]);
+			if (year >= 1990 && year <= 2030 && month >= 1 && month <= 12 && day >= 1 && day <= 31) {
+				setDate(m, false);
+				return matched(0.7, "Embedded Date");
+			}
+		}
+		if (std::regex_search(name, m, std::wregex(L"(?:^|[^\\d])(\\d{10,13})(?:[^\\d]|$)"))) {
+			// This was std::stol, which throws out_of_range above LONG_MAX (2^31 - 1 on Windows)
+			long long timestamp = std::stoll(m[1]);
+			if (timestamp <= LONG_MAX && timestamp > 631152000 && timestamp < 2524608000) {
+				std::time_t time = (std::time_t)timestamp;
+				result.date = *std::gmtime(&time);
+				result.success = true;
+				return matched(0.6, "UNIX Timestamp");
+			}
+		}
+		if (std::regex_search(name, m, std::wregex(L"(?:^|[^\\d])IMG_(\\d{4})(?:[^\\d]|$)", icase))) {
+			result.pattern = "Canon Sequential";
+			result.explanation = "Matched Canon Sequential pattern, but no date information available";
+			return result;
+		}
+		result.explanation = "No recognizable date pattern found in filename";
+		return result;
+	}
+
+	bool ReferenceExifDate(const std::string& value, std::tm& date)
+	{
+		static const std::regex patterns[] = {
+			std::regex("(\\d{4})[:-](\\d{2})[:-](\\d{2})[ T]?(\\d{2}):(\\d{2}):(\\d{2})"),
+			std::regex("(\\d{4})[:-](\\d{2})[:-](\\d{2})[ T]?(\\d{2}):(\\d{2})"),
+			std::regex("(\\d{4})[:-](\\d{2})[:-](\\d{2})"),
+			std::regex("(\\d{4})/(\\d{2})/(\\d{2})"),
+		};
+		std::smatch m;
+		for (const auto& pattern : patterns) {
+			if (std::regex_match(value, m, pattern)) {
+				date = {};
+				date.tm_year = std::stoi(m[1]) - 1900;
+				date.tm_mon = std::stoi(m[2]) - 1;
+				date.tm_mday = std::stoi(m[3]);
+				if (m.size() > 4) date.tm_hour = std::stoi(m[4]);
+				if (m.size() > 5) date.tm_min = std::stoi(m[5]);
+				if (m.size() > 6) date.tm_sec = std::stoi(m[6]);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool SameDate(const std::tm& a, const std::tm& b)
+	{
+		return a.tm_year == b.tm_year && a.tm_mon == b.tm_mon && a.tm_mday == b.tm_mday &&
+			a.tm_hour == b.tm_hour && a.tm_min == b.tm_min && a.tm_sec == b.tm_sec;
+	}
+
+	bool Agrees(const std::wstring& name)
+	{
+		auto expected = ReferenceExtract(name);
+		auto result = ExtractDateFromFilename(name);
+		return result.success == expected.success && result.confidence == expected.confidence &&
+			result.pattern == expected.pattern && result.explanation == expected.explanation &&
+			(!result.success || SameDate(result.date, expected.date));
+	}
+
+	// File names glued together from pieces of the real patterns and things that almost match
+	std::vector<std::wstring> MakeCorpus(std::mt19937& random, size_t size)
+	{
+		const wchar_t* pieces[] = {
+			L"IMG_", L"img_", L"DSC_", L"IMG-", L"-WA", L"WA", L"Screenshot_", L"screenSHOT_", L"_", L"-", L".", L"x", L" ",
+			L"2019", L"20190312", L"123045", L"1999-12-31_23-59-59", L"1650000000", L"1650000000123", L"2200000000",
+			L"0000", L"12", L"7", L"19891231", L"20301231", L"20311301", L"a", L"jpg",
+		};
+		std::vector<std::wstring> corpus;
+		corpus.reserve(size);
+		for (size_t i = 0; i < size; ++i) {
+			std::wstring name;
+			for (auto n = 1 + random() % 6; n > 0; --n) {
+				name += pieces[random() % std::size(pieces)];
+			}
+			if (random() % 4 == 0) {
+				for (auto n = random() % 20; n > 0; --n) {
+					name += (wchar_t)(L'0' + random() % 10);
+				}
+			}
+			corpus.push_back(name);
+		}
+		return corpus;
+	}
+
+	void TestKnownNames()
+	{
+		struct Case {
+			const wchar_t* name;
+			const char* pattern;
+			int year, month, day, hour, minute, second;
+		};
+		const Case cases[] = {
+			{ L"IMG_20190312_123045.jpg", "iPhone", 2019, 3, 12, 12, 30, 45 },
+			{ L"img_20190312_123045_HDR.JPG", "iPhone", 2019, 3, 12, 12, 30, 45 },
+			{ L"DSC_20201224_180000.jpg", "Digital Camera (DSC)", 2020, 12, 24, 18, 0, 0 },
+			{ L"IMG-20180704-WA0012.jpeg", "WhatsApp", 2018, 7, 4, 0, 0, 0 },
+			{ L"Screenshot_20220101-000001.png", "Android Screenshot", 2022, 1, 1, 0, 0, 1 },
+			{ L"1999-12-31_23-59-59.heic", "ISO Format", 1999, 12, 31, 23, 59, 59 },
+			{ L"Holiday 20150815 beach.jpg", "Embedded Date", 2015, 8, 15, 0, 0, 0 },
+			{ L"photo_1650000000.jpg", "UNIX Timestamp", 2022, 4, 15, 5, 20, 0 },
+			{ L"IMG_1234.JPG", "Canon Sequential", 0, 0, 0, 0, 0, 0 },
+			{ L"vacation.jpg", "", 0, 0, 0, 0, 0, 0 },
+			// Out of range for an embedded date, and too many digits for anything
+			{ L"scan 20311301.jpg", "", 0, 0, 0, 0, 0, 0 },
+			{ L"IMG_201903121230451.jpg", "", 0, 0, 0, 0, 0, 0 },
+			// The extension doesn't count
+			{ L"photo.20190312", "", 0, 0, 0, 0, 0, 0 },
+		};
+		for (const auto& c : cases) {
+			auto result = ExtractDateFromFilename(c.name);
+			CHECK(std::string(result.pattern) == c.pattern);
+			CHECK(result.success == (c.year != 0));
+			if (result.success) {
+				CHECK(result.date.tm_year == c.year - 1900);
+				CHECK(result.date.tm_mon == c.month - 1);
+				CHECK(result.date.tm_mday == c.day);
+				CHECK(result.date.tm_hour == c.hour);
+				CHECK(result.date.tm_min == c.minute);
+				CHECK(result.date.tm_sec == c.second);
+			}
+			CHECK(Agrees(c.name));
+		}
+	}
+
+	void TestCorpus(const std::vector<std::wstring>& corpus)
+	{
+		size_t mismatches = 0, dated = 0;
+		for (const auto& name : corpus) {
+			if (!Agrees(name)) {
+				if (mismatches++ < 10) {
+					std::printf("Differs from the regular expressions: \"%ls\"\n", name.c_str());
+				}
+			}
+			dated += ExtractDateFromFilename(name).success ? 1 : 0;
+		}
+		std::printf("%zu generated names, %zu with a date, %zu different from the regular expressions\n", corpus.size(), dated, mismatches);
+		CHECK(mismatches == 0);
+	}
+
+	void TestExifDates(std::mt19937& random, size_t size)
+	{
+		const char* known[] = {
+			"2023:05:01 12:34:56", "2023-05-01T12:34:56", "2023:05:0112:34:56", "2023:05:01 12:34",
+			"2023:05:01", "2023/05/01", "2023/05/01 12:34:56", "2023:05:01 12:34:5", "", "    :  :     :  :  ",
+		};
+		const char* pieces[] = { "2023", ":", "-", "/", "05", "01", " ", "T", "12", ":", "34", "56", "x", "7" };
+
+		size_t mismatches = 0;
+		for (size_t i = 0; i < size; ++i) {
+			std::string value;
+			if (i < std::size(known)) {
+				value = known[i];
+			}
+			else {
+				for (auto n = 1 + random() % 12; n > 0; --n) {
+					value += pieces[random() % std::size(pieces)];
+				}
+			}
+			std::tm expected = {}, date = {};
+			bool isExpected = ReferenceExifDate(value, expected);
+			bool isParsed = ParseExifDate(value, date);
+			if (isParsed != isExpected || (isParsed && !SameDate(date, expected))) {
+				if (mismatches++ < 10) {
+					std::printf("EXIF date differs from the regular expressions: \"%s\"\n", value.c_str());
+				}
+			}
+		}
+		CHECK(mismatches == 0);
+	}
+
+	void BenchNames(const std::vector<std::wstring>& corpus)
+	{
+		long dated = 0;
+		auto seconds = Test::Time(3, [&] {
+			for (const auto& name : corpus) {
+				dated += ExtractDateFromFilename(name).success ? 1 : 0;
+			}
+		});
+		size_t sample = corpus.size() / 20;
+		auto referenceSeconds = Test::Time(1, [&] {
+			for (size_t i = 0; i < sample; ++i) {
+				dated += ReferenceExtract(corpus[i]).success ? 1 : 0;
+			}
+		});
+		std::printf("ExtractDateFromFilename %.2f million names/s, regular expressions %.3f million names/s (%ld)\n",
+			corpus.size() / seconds / 1e6, sample / referenceSeconds / 1e6, dated);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Test::Init(argc, argv);
+	std::mt19937 random(42);
+
+	TestKnownNames();
+	auto corpus = MakeCorpus(random, Test::bench ? 400000 : 20000);
+	TestCorpus(corpus);
+	TestExifDates(random, Test::bench ? 300000 : 20000);
+	if (Test::bench) {
+		BenchNames(corpus);
+	}
+	return Test::Finish();
+}
@@ -0,0 +1,179 @@
+#include "DecodedImageCache.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	struct Photo {
+		int number = 0;
+	};
+	using Cache = DecodedImageCache<Photo>;
+
+	DecodedImageKey KeyOf(int number, uint32_t width = 1920, uint32_t height = 1080)
+	{
+		return { L"C:\\Photos\\IMG_" + std::to_wstring(number) + L".jpg", 1000, width, height, 0 };
+	}
+
+	// Shows a photo the way the loader does: from the cache, or decoded and added
+	bool Show(Cache& cache, int number, size_t bytes)
+	{
+		auto photo = cache.Find(KeyOf(number));
+		if (photo) {
+			CHECK(photo->number == number);
+			return true;
+		}
+		photo = std::make_shared<Photo>();
+		photo->number = number;
+		cache.Insert(KeyOf(number), photo, bytes);
+		return false;
+	}
+
+	void TestNavigation()
+	{
+		// Room for three photos of 10 bytes
+		Cache cache;
+		cache.SetBudget(30);
+		for (int number : { 1, 2, 3 }) {
+			CHECK(!Show(cache, number, 10));
+		}
+		// Back twice, and forward again
+		for (int number : { 2, 1, 2, 3 }) {
+			CHECK(Show(cache, number, 10));
+		}
+		auto stats = cache.GetStats();
+		CHECK(stats.hits == 4 && stats.misses == 3 && stats.evictions == 0);
+		CHECK(stats.entries == 3 && stats.bytes == 30);
+
+		// A new photo pushes out the one that was on screen longest ago
+		CHECK(!Show(cache, 4, 10));
+		CHECK(cache.Find(KeyOf(1), false) == nullptr);
+		CHECK(Show(cache, 2, 10));
+		stats = cache.GetStats();
+		CHECK(stats.hits == 5 && stats.misses == 4 && stats.evictions == 1);
+		CHECK(stats.entries == 3 && stats.bytes == 30);
+
+		// Another size, or another version of the file, is another decode
+		CHECK(cache.Find(KeyOf(2, 1280, 720)) == nullptr);
+		auto changed = KeyOf(2);
+		changed.lastWriteTime = 2000;
+		CHECK(cache.Find(changed) == nullptr);
+		CHECK(cache.GetStats().misses == 6);
+
+		// A large photo takes the room of two
+		CHECK(!Show(cache, 5, 20));
+		stats = cache.GetStats();
+		CHECK(stats.evictions == 3 && stats.entries == 2 && stats.bytes == 30);
+		CHECK(cache.Find(KeyOf(2), false) != nullptr && cache.Find(KeyOf(5), false) != nullptr);
+
+		// One that doesn't fit at all isn't kept, and doesn't push anything out
+		CHECK(!Show(cache, 6, 31));
+		CHECK(cache.Find(KeyOf(6), false) == nullptr);
+		CHECK(cache.GetStats().entries == 2);
+
+		// Inserting a photo again replaces it, with its new size
+		auto again = std::make_shared<Photo>();
+		again->number = 5;
+		cache.Insert(KeyOf(5), again, 5);
+		stats = cache.GetStats();
+		CHECK(stats.entries == 2 && stats.bytes == 15 && cache.Find(KeyOf(5), false) == again);
+
+		// A smaller budget drops the least recently used first
+		cache.SetBudget(5);
+		stats = cache.GetStats();
+		CHECK(stats.entries == 1 && stats.bytes == 5 && cache.Find(KeyOf(5), false) == again);
+		cache.SetBudget(0);
+		CHECK(cache.GetStats().entries == 0 && cache.GetStats().bytes == 0);
+	}
+
+	// A slideshow that mostly moves forward and now and then goes back a few photos,
+	// against a list of what was shown, most recent first
+	void TestReplay(uint64_t seed, int steps, size_t budget)
+	{
+		std::mt19937_64 random(seed);
+		Cache cache;
+		cache.SetBudget(budget);
+		auto bytesOf = [](int number) { return (size_t)(8 + number * 37 % 25); };
+
+		struct Shown {
+			int number;
+			size_t bytes;
+		};
+		std::vector<Shown> reference;
+		size_t referenceBytes = 0;
+		uint64_t hits = 0, misses = 0, evictions = 0;
+		int wrong = 0, position = 0;
+		for (int step = 0; step < steps; ++step) {
+			position = random() % 5 == 0 ? std::max(0, position - 1 - (int)(random() % 4)) : position + 1;
+			auto bytes = bytesOf(position);
+
+			auto found = std::find_if(reference.begin(), reference.end(), [&](const Shown& s) { return s.number == position; });
+			bool expected = found != reference.end();
+			if (expected) {
+				++hits;
+				std::rotate(reference.begin(), found, found + 1);
+			}
+			else {
+				++misses;
+				if (bytes <= budget) {
+					reference.insert(reference.begin(), { position, bytes });
+					referenceBytes += bytes;
+					while (referenceBytes > budget) {
+						referenceBytes -= reference.back().bytes;
+						reference.pop_back();
+						++evictions;
+					}
+				}
+			}
+
+			wrong += Show(cache, position, bytes) != expected;
+			auto stats = cache.GetStats();
+			wrong += stats.bytes > budget || stats.bytes != referenceBytes || stats.entries != reference.size();
+		}
+
+		auto stats = cache.GetStats();
+		if (wrong > 0 || stats.hits != hits || stats.misses != misses || stats.evictions != evictions) {
+			std::printf("Budget %zu: %d wrong steps, %llu/%llu hits, %llu/%llu misses, %llu/%llu evictions\n", budget, wrong,
+				(unsigned long long)stats.hits, (unsigned long long)hits, (unsigned long long)stats.misses, (unsigned long long)misses,
+				(unsigned long long)stats.evictions, (unsigned long long)evictions);
+		}
+		CHECK(wrong == 0);
+		CHECK(stats.hits == hits && stats.misses == misses && stats.evictions == evictions);
+		CHECK(hits > 0 && evictions > 0);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Test::Init(argc, argv);
+
+	TestNavigation();
+	TestReplay(1, 5000, 100);
+	TestReplay(2, 5000, 33);
+	TestReplay(3, 5000, 1000);
+
+	if (Test::bench) {
+		// Photos of about 8 MB, a cache of 512 MB, a long evening of forward and back
+		Cache cache;
+		cache.SetBudget(512 * 1024 * 1024);
+		std::mt19937_64 random(4);
+		std::vector<int> positions;
+		int position = 0;
+		for (int step = 0; step < 1000000; ++step) {
+			position = random() % 5 == 0 ? std::max(0, position - 1 - (int)(random() % 4)) : position + 1;
+			positions.push_back(position);
+		}
+		size_t hits = 0;
+		auto seconds = Test::Time(3, [&] {
+			for (int number : positions) {
+				hits += Show(cache, number, 8 * 1024 * 1024);
+			}
+		});
+		auto stats = cache.GetStats();
+		std::printf("%.0f ns per photo shown, %zu entries, %llu evictions (%zu)\n", seconds / positions.size() * 1e9,
+			stats.entries, (unsigned long long)stats.evictions, hits);
+	}
+	return Test::Finish();
+}
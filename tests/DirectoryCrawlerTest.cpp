@@ -0,0 +1,187 @@
+#include "DirectoryCrawler.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace {
+	// What a crawl saw: how often each directory was visited, and on which workers
+	struct Visits {
+		std::mutex mutex;
+		std::map<std::wstring, int> counts;
+		std::set<int> workers;
+		int badWorkers = 0;
+
+		void Add(const std::wstring& directory, int worker, int numThreads)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			++counts[directory];
+			workers.insert(worker);
+			badWorkers += worker < 0 || worker >= std::max(1, numThreads);
+		}
+
+		bool AllOnce() const
+		{
+			return std::all_of(counts.begin(), counts.end(), [](const auto& count) { return count.second == 1; });
+		}
+	};
+
+	// A tree that only exists in names: "<root>/<i>/<j>/..." has `fanout` children down to `depth`
+	size_t CrawlNames(const std::vector<std::wstring>& roots, int numThreads, int fanout, int depth,
+		std::chrono::microseconds latency, Visits& visits)
+	{
+		DirectoryCrawler::Crawl(roots, numThreads, [&](const std::wstring& directory, int worker, std::vector<std::wstring>& subdirectories) {
+			visits.Add(directory, worker, numThreads);
+			if (latency.count() > 0) {
+				std::this_thread::sleep_for(latency);
+			}
+			if (std::count(directory.begin(), directory.end(), L'/') < depth) {
+				for (int i = 0; i < fanout; ++i) {
+					subdirectories.push_back(directory + L"/" + std::to_wstring(i));
+				}
+			}
+		});
+		size_t expected = 0, level = 1;
+		for (int d = 0; d <= depth; ++d) {
+			expected += level;
+			level *= fanout;
+		}
+		return expected * roots.size();
+	}
+
+	void TestNames()
+	{
+		for (int numThreads : { 0, 1, 2, 3, 8 }) {
+			Visits visits;
+			auto expected = CrawlNames({ L"a", L"b", L"c" }, numThreads, 4, 4, {}, visits);
+			CHECK(visits.counts.size() == expected);
+			CHECK(visits.AllOnce());
+			CHECK(visits.badWorkers == 0);
+		}
+
+		// Nothing to do
+		Visits none;
+		CrawlNames({}, 4, 4, 4, {}, none);
+		CHECK(none.counts.empty());
+
+		// A single chain: only one directory can be listed at a time, so all but one worker
+		// wait for most of the crawl, and have to be woken when it is over
+		Visits chain;
+		auto expected = CrawlNames({ L"c" }, 8, 1, 30, std::chrono::microseconds(500), chain);
+		CHECK(chain.counts.size() == expected && chain.AllOnce());
+
+		// Slow listings, like a network share, spread over all the workers
+		Visits slow;
+		expected = CrawlNames({ L"s" }, 4, 3, 4, std::chrono::microseconds(200), slow);
+		CHECK(slow.counts.size() == expected && slow.AllOnce());
+		CHECK(slow.workers.size() > 1);
+	}
+
+	// `fanout` folders of `files` photos in every folder, `depth` levels down
+	void MakeTree(const std::filesystem::path& directory, int fanout, int depth, int files)
+	{
+		std::filesystem::create_directories(directory);
+		for (int i = 0; i < files; ++i) {
+			std::ofstream(directory / ("IMG_" + std::to_string(i) + ".jpg"));
+		}
+		if (depth > 0) {
+			for (int i = 0; i < fanout; ++i) {
+				MakeTree(directory / ("Folder " + std::to_string(i)), fanout, depth - 1, files);
+			}
+		}
+	}
+
+	// Lists the directories the way the scan does, and counts the files
+	size_t CrawlDisk(const std::filesystem::path& root, int numThreads, Visits* visits)
+	{
+		std::atomic<size_t> files = 0;
+		DirectoryCrawler::Crawl({ root.wstring() }, numThreads, [&](const std::wstring& directory, int worker, std::vector<std::wstring>& subdirectories) {
+			if (visits) {
+				visits->Add(directory, worker, numThreads);
+			}
+			for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+				if (entry.is_directory()) {
+					subdirectories.push_back(entry.path().wstring());
+				}
+				else {
+					++files;
+				}
+			}
+		});
+		return files;
+	}
+
+	std::filesystem::path Directory()
+	{
+		return std::filesystem::temp_directory_path() / "PhotoCycleDirectoryCrawlerTest";
+	}
+
+	void TestDisk()
+	{
+		auto root = Directory() / "small";
+		MakeTree(root, 3, 3, 2);
+		std::set<std::wstring> expected = { root.wstring() };
+		for (const auto& entry : std::filesystem::recursive_directory_iterator(root)) {
+			if (entry.is_directory()) {
+				expected.insert(entry.path().wstring());
+			}
+		}
+
+		for (int numThreads : { 1, 4 }) {
+			Visits visits;
+			CHECK(CrawlDisk(root, numThreads, &visits) == expected.size() * 2);
+			CHECK(visits.AllOnce());
+			std::set<std::wstring> visited;
+			for (const auto& [directory, count] : visits.counts) {
+				visited.insert(directory);
+			}
+			CHECK(visited == expected);
+		}
+	}
+
+	void Bench()
+	{
+		auto root = Directory() / "large";
+		MakeTree(root, 8, 4, 10);
+		for (int numThreads : { 1, 2, 4, 8 }) {
+			size_t files = 0;
+			auto seconds = Test::Time(3, [&] { files = CrawlDisk(root, numThreads, nullptr); });
+			std::printf("%d threads: %zu files in %.1f ms\n", numThreads, files, seconds * 1000);
+		}
+
+		// A network share, where a listing is mostly waiting. The processor time shows what
+		// the idle workers cost while there is little to share out.
+		for (int numThreads : { 1, 8, 32 }) {
+			Visits visits;
+			size_t expected = 0;
+			auto start = std::clock();
+			auto seconds = Test::Time(1, [&] { expected = CrawlNames({ L"\\\\nas" }, numThreads, 6, 4, std::chrono::microseconds(500), visits); });
+			auto cpuSeconds = (double)(std::clock() - start) / CLOCKS_PER_SEC;
+			CHECK(visits.counts.size() == expected);
+			std::printf("%d threads: %zu listings of 0.5 ms in %.0f ms, %.0f ms of processor time\n", numThreads, expected,
+				seconds * 1000, cpuSeconds * 1000);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Test::Init(argc, argv);
+
+	std::filesystem::remove_all(Directory());
+	TestNames();
+	TestDisk();
+	if (Test::bench) {
+		Bench();
+	}
+	std::filesystem::remove_all(Directory());
+	return Test::Finish();
+}
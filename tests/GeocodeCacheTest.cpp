@@ -0,0 +1,174 @@
+#include "GeocodeCache.h"
+#include "Test.h"
+
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	std::filesystem::path Directory()
+	{
+		auto directory = std::filesystem::temp_directory_path() / "PhotoCycleGeocodeCacheTest";
+		std::filesystem::create_directories(directory);
+		return directory;
+	}
+
+	// The name a fake service gives a cell, so every thread can tell what it should get
+	std::string NameOf(double latitude, double longitude)
+	{
+		return "Cell " + std::to_string((int)std::floor(latitude / GeocodeCache::CellSize)) + " " +
+			std::to_string((int)std::floor(longitude / GeocodeCache::CellSize));
+	}
+
+	void TestConcurrentLookups()
+	{
+		// Several threads ask for the same few cells at once, from points all over each cell,
+		// while the slow service is still working on the first request
+		GeocodeCache cache;
+		const int cells = 4, threadsPerCell = 6;
+		std::atomic<int> fetches[cells] = {};
+		std::atomic<int> wrong = 0;
+		std::atomic<bool> start = false;
+
+		std::vector<std::thread> threads;
+		for (int t = 0; t < cells * threadsPerCell; ++t) {
+			threads.emplace_back([&, t] {
+				int cell = t % cells;
+				double latitude = 52.0 + cell * GeocodeCache::CellSize + (t / cells + 0.5) * GeocodeCache::CellSize / (threadsPerCell + 1);
+				double longitude = -4.0025;
+				while (!start) {
+					std::this_thread::yield();
+				}
+				auto location = cache.Lookup(latitude, longitude, [&](double lat, double lon) {
+					++fetches[cell];
+					std::this_thread::sleep_for(std::chrono::milliseconds(50));
+					return NameOf(lat, lon);
+				});
+				wrong += location != NameOf(latitude, longitude);
+			});
+		}
+		start = true;
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		CHECK(wrong == 0);
+		for (int cell = 0; cell < cells; ++cell) {
+			if (fetches[cell] != 1) {
+				std::printf("Cell %d was fetched %d times\n", cell, fetches[cell].load());
+			}
+			CHECK(fetches[cell] == 1);
+		}
+	}
+
+	void TestFailures()
+	{
+		GeocodeCache cache;
+		int fetches = 0;
+		auto fail = [&](double, double) { ++fetches; return std::string(); };
+		auto fetchThrows = [&](double, double) -> std::string { ++fetches; throw std::runtime_error("offline"); };
+		auto newline = [&](double, double) { ++fetches; return std::string("Two\nlines"); };
+		auto succeed = [&](double lat, double lon) { ++fetches; return NameOf(lat, lon); };
+
+		// Nothing that failed is remembered, so the next lookup asks again
+		CHECK(cache.Lookup(10, 20, fail).empty());
+		CHECK(cache.Lookup(10, 20, fetchThrows).empty());
+		CHECK(cache.Lookup(10, 20, newline).empty());
+		CHECK(fetches == 3);
+		CHECK(cache.Lookup(10, 20, succeed) == NameOf(10, 20));
+		CHECK(fetches == 4);
+		CHECK(cache.Lookup(10, 20, fail) == NameOf(10, 20));
+		CHECK(fetches == 4);
+
+		// A failure isn't written either
+		auto path = Directory() / "failures.txt";
+		GeocodeCache failed;
+		CHECK(failed.Lookup(1, 2, fail).empty());
+		CHECK(failed.Save(path));
+		CHECK(!std::filesystem::exists(path));
+	}
+
+	void TestSaveLoad()
+	{
+		// Both signs on both axes, since the cells are stored as signed numbers
+		const double points[][2] = { { 52.37, 4.89 }, { -33.87, 151.21 }, { 40.71, -74.01 }, { -22.91, -43.17 }, { 0.001, -0.001 } };
+		auto path = Directory() / "geocode.txt";
+		std::filesystem::remove(path);
+
+		GeocodeCache cache;
+		for (const auto& point : points) {
+			cache.Lookup(point[0], point[1], [](double lat, double lon) { return NameOf(lat, lon) + ", \xC3\xA9t\xC3\xA9"; });
+		}
+		CHECK(cache.Save(path));
+
+		int fetches = 0;
+		auto fail = [&](double, double) { ++fetches; return std::string(); };
+		GeocodeCache loaded;
+		CHECK(loaded.Load(path));
+		for (const auto& point : points) {
+			CHECK(loaded.Lookup(point[0], point[1], fail) == NameOf(point[0], point[1]) + ", \xC3\xA9t\xC3\xA9");
+		}
+		CHECK(fetches == 0);
+		// The neighbouring cell wasn't cached
+		CHECK(loaded.Lookup(52.37 + GeocodeCache::CellSize, 4.89, fail).empty());
+		CHECK(fetches == 1);
+
+		// Nothing was added since Load, so nothing is written
+		auto unchanged = Directory() / "unchanged.txt";
+		CHECK(loaded.Save(unchanged));
+		CHECK(!std::filesystem::exists(unchanged));
+
+		// Damaged lines and Windows line ends don't stop the rest from loading
+		{
+			std::ofstream file(path, std::ios::binary | std::ios::app);
+			file << "garbage\n" << "x\ty\tNowhere\n" << "-1\t-2\tCorner\r\n";
+		}
+		GeocodeCache damaged;
+		CHECK(damaged.Load(path));
+		CHECK(damaged.Lookup(-0.5 * GeocodeCache::CellSize, -1.5 * GeocodeCache::CellSize, fail) == "Corner");
+		CHECK(damaged.Lookup(points[0][0], points[0][1], fail) == NameOf(points[0][0], points[0][1]) + ", \xC3\xA9t\xC3\xA9");
+		CHECK(fetches == 1);
+
+		CHECK(!GeocodeCache().Load(Directory() / "missing.txt"));
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Test::Init(argc, argv);
+
+	TestConcurrentLookups();
+	TestFailures();
+	TestSaveLoad();
+
+	if (Test::bench) {
+		// The photos of a large library, taken in a few thousand places
+		GeocodeCache cache;
+		std::vector<std::pair<double, double>> points;
+		for (int i = 0; i < 1000000; ++i) {
+			points.push_back({ 50.0 + (int)(i * 7919ll % 3000) * GeocodeCache::CellSize, 5.0 + (i % 13) * 0.0001 });
+		}
+		for (const auto& [lat, lon] : points) {
+			cache.Lookup(lat, lon, NameOf);
+		}
+		size_t length = 0;
+		auto seconds = Test::Time(3, [&] {
+			for (const auto& [lat, lon] : points) {
+				length += cache.Lookup(lat, lon, NameOf).size();
+			}
+		});
+		auto path = Directory() / "bench.txt";
+		auto saveSeconds = Test::Time(1, [&] { cache.Save(path); });
+		GeocodeCache loaded;
+		auto loadSeconds = Test::Time(1, [&] { loaded.Load(path); });
+		std::printf("Cached lookup: %.0f ns. Save: %.1f ms, load: %.1f ms (%zu)\n", seconds / points.size() * 1e9,
+			saveSeconds * 1000, loadSeconds * 1000, length);
+	}
+
+	std::filesystem::remove_all(std::filesystem::temp_directory_path() / "PhotoCycleGeocodeCacheTest");
+	return Test::Finish();
+}
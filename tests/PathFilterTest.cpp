@@ -0,0 +1,274 @@
+#include "PathFilter.h"
+#include "Test.h"
+
+#include <cwctype>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	std::vector<std::wstring> Components(std::wstring_view path)
+	{
+		std::vector<std::wstring> components;
+		size_t start = 0;
+		while (start <= path.size()) {
+			auto end = path.find_first_of(L"\\/", start);
+			if (end == std::wstring_view::npos) {
+				end = path.size();
+			}
+			std::wstring part(path.substr(start, end - start));
+			if (part.empty() && end == path.size() && start > 0) {
+				break;
+			}
+			for (auto& c : part) {
+				c = (wchar_t)std::towlower(c);
+			}
+			components.push_back(part);
+			start = end + 1;
+		}
+		return components;
+	}
+
+	bool ReferenceGlob(const wchar_t* glob, const wchar_t* name)
+	{
+		if (*glob == L'*') {
+			return ReferenceGlob(glob + 1, name) || (*name && ReferenceGlob(glob, name + 1));
+		}
+		if (!*glob) {
+			return !*name;
+		}
+		return *name && (*glob == L'?' || *glob == *name) && ReferenceGlob(glob + 1, name + 1);
+	}
+
+	bool ReferenceMatch(const std::vector<std::wstring>& pattern, size_t p, const std::vector<std::wstring>& path, size_t at, size_t count)
+	{
+		if (p == pattern.size()) {
+			return at == count;
+		}
+		if (pattern[p] == L"**") {
+			return ReferenceMatch(pattern, p + 1, path, at, count) || (at < count && ReferenceMatch(pattern, p, path, at + 1, count));
+		}
+		return at < count && ReferenceGlob(pattern[p].c_str(), path[at].c_str()) && ReferenceMatch(pattern, p + 1, path, at + 1, count);
+	}
+
+	// The patterns one by one against the path and every folder above it
+	struct ReferenceFilter {
+		std::vector<std::vector<std::wstring>> patterns;
+
+		explicit ReferenceFilter(const std::vector<std::wstring>& list)
+		{
+			for (const auto& pattern : list) {
+				if (pattern.empty()) {
+					continue;
+				}
+				auto components = Components(pattern);
+				if (!PathFilter::IsAbsolute(pattern)) {
+					components.insert(components.begin(), L"**");
+				}
+				patterns.push_back(components);
+			}
+		}
+
+		bool IsExcluded(std::wstring_view path) const
+		{
+			auto components = Components(path);
+			for (size_t count = 1; count <= components.size(); ++count) {
+				for (const auto& pattern : patterns) {
+					if (ReferenceMatch(pattern, 0, components, 0, count)) {
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+	};
+
+	void TestPatterns()
+	{
+		PathFilter filter;
+		CHECK(filter.IsEmpty());
+		CHECK(!filter.IsExcluded(L"C:\\Photos"));
+
+		filter.SetPatterns({ L"c:\\photos\\receipts", L"*\\Screenshots", L"D:/Backup/**/thumbs", L"c:\\photos\\IMG_00??.jpg", L"*.tmp", L"" });
+		CHECK(!filter.IsEmpty());
+
+		// Absolute patterns, whatever the case and the slashes
+		CHECK(filter.IsExcluded(L"C:\\Photos\\Receipts"));
+		CHECK(filter.IsExcluded(L"c:/photos/Receipts/"));
+		CHECK(filter.IsExcluded(L"C:\\Photos\\Receipts\\2020\\a.jpg"));
+		CHECK(!filter.IsExcluded(L"C:\\Photos\\Receipts2"));
+		CHECK(!filter.IsExcluded(L"C:\\Photos"));
+		CHECK(!filter.IsExcluded(L"E:\\photos\\receipts"));
+
+		// Relative ones at any depth
+		CHECK(filter.IsExcluded(L"E:\\x\\y\\screenshots\\a.png"));
+		CHECK(filter.IsExcluded(L"\\\\nas\\share\\SCREENSHOTS"));
+		CHECK(filter.IsExcluded(L"c:\\photos\\x\\foo.TMP"));
+		CHECK(!filter.IsExcluded(L"c:\\photos\\x\\foo.tmp2"));
+
+		// "**" is any number of folders, none included
+		CHECK(filter.IsExcluded(L"D:\\backup\\thumbs"));
+		CHECK(filter.IsExcluded(L"D:\\backup\\a\\b\\Thumbs\\c.jpg"));
+		CHECK(!filter.IsExcluded(L"D:\\other\\thumbs"));
+
+		// '?' is exactly one character
+		CHECK(filter.IsExcluded(L"c:\\photos\\img_0012.jpg"));
+		CHECK(!filter.IsExcluded(L"c:\\photos\\img_00123.jpg"));
+		CHECK(!filter.IsExcluded(L"c:\\photos\\img_001.jpg"));
+
+		// A step from a folder's Position gives what the whole path does
+		auto position = filter.Walk(L"E:\\x");
+		CHECK(!position.excluded);
+		CHECK(filter.IsExcluded(position, L"Screenshots"));
+		CHECK(!filter.IsExcluded(position, L"y"));
+		CHECK(filter.Enter(position, L"Screenshots").excluded);
+		auto backup = filter.Walk(L"D:\\Backup");
+		CHECK(filter.IsExcluded(filter.Enter(backup, L"a"), L"thumbs"));
+
+		// Network shares
+		PathFilter share;
+		share.SetPatterns({ L"\\\\nas\\share\\private" });
+		CHECK(share.IsExcluded(L"\\\\NAS\\share\\Private\\x.jpg"));
+		CHECK(!share.IsExcluded(L"\\\\nas\\share\\public"));
+		CHECK(!share.IsExcluded(L"C:\\nas\\share\\private"));
+
+		// A trailing "**" excludes the folder itself as well
+		PathFilter trailing;
+		trailing.SetPatterns({ L"C:\\Photos\\Old\\**" });
+		CHECK(trailing.IsExcluded(L"C:\\Photos\\Old"));
+		CHECK(trailing.IsExcluded(trailing.Walk(L"C:\\Photos"), L"old"));
+		CHECK(!trailing.IsExcluded(L"C:\\Photos\\Older"));
+
+		CHECK(PathFilter::IsAbsolute(L"C:\\Photos") && PathFilter::IsAbsolute(L"//nas/share"));
+		CHECK(!PathFilter::IsAbsolute(L"Photos") && !PathFilter::IsAbsolute(L"\\Photos"));
+		CHECK(PathFilter::HasWildcards(L"IMG_??.jpg") && !PathFilter::HasWildcards(L"IMG_01.jpg"));
+	}
+
+	// Random patterns and paths out of a few components, so they match often
+	void TestAgainstReference()
+	{
+		std::mt19937 random(7);
+		const wchar_t* names[] = { L"Photos", L"a", L"b", L"ab", L"IMG_01.jpg", L"img_1.JPG" };
+		const wchar_t* globs[] = { L"*", L"a*", L"?b", L"*.jpg", L"img_??.jpg", L"*b*", L"**" };
+		const wchar_t* roots[] = { L"", L"C:", L"c:", L"\\\\nas" };
+		auto pick = [&random](const auto& list) { return list[random() % std::size(list)]; };
+		auto slash = [&random]() { return random() % 2 ? L'\\' : L'/'; };
+
+		int wrong = 0;
+		for (int round = 0; round < 300; ++round) {
+			std::vector<std::wstring> patterns;
+			for (int i = 0, count = 1 + random() % 4; i < count; ++i) {
+				std::wstring pattern = pick(roots);
+				for (int c = 0, length = 1 + random() % 3; c < length; ++c) {
+					if (!pattern.empty()) {
+						pattern += slash();
+					}
+					pattern += random() % 3 == 0 ? pick(globs) : pick(names);
+				}
+				patterns.push_back(pattern);
+			}
+			PathFilter filter;
+			filter.SetPatterns(patterns);
+			ReferenceFilter reference(patterns);
+
+			for (int i = 0; i < 50; ++i) {
+				std::wstring path = pick(roots);
+				path = path.empty() ? L"D:" : path;
+				for (int c = 0, length = random() % 5; c < length; ++c) {
+					std::wstring name = pick(names);
+					for (auto& ch : name) {
+						ch = random() % 2 ? (wchar_t)std::towupper(ch) : ch;
+					}
+					path += slash() + name;
+				}
+				if (filter.IsExcluded(path) != reference.IsExcluded(path)) {
+					if (wrong++ < 5) {
+						std::printf("\"%ls\" excluded: %d, by the patterns one by one: %d\n", path.c_str(), filter.IsExcluded(path), reference.IsExcluded(path));
+					}
+				}
+				auto folder = path.find_last_of(L"\\/");
+				if (folder != std::wstring::npos && folder > 2) {
+					auto position = filter.Walk(std::wstring_view(path).substr(0, folder));
+					auto name = std::wstring_view(path).substr(folder + 1);
+					wrong += filter.IsExcluded(position, name) != filter.IsExcluded(path);
+					wrong += filter.Enter(position, name).excluded != filter.IsExcluded(path);
+				}
+			}
+		}
+		CHECK(wrong == 0);
+	}
+
+	void BenchRules()
+	{
+		// 2000 folders of 50 photos, checked against 1000 rules the way the scan does
+		std::vector<std::wstring> rules;
+		for (int i = 0; i < 900; ++i) {
+			rules.push_back(L"C:\\Users\\someone\\Pictures\\" + std::to_wstring(2000 + i % 25) + L"\\Event " + std::to_wstring(i * 7));
+		}
+		for (int i = 0; i < 80; ++i) {
+			rules.push_back(L"*\\skip" + std::to_wstring(i) + L"*");
+		}
+		for (int i = 0; i < 20; ++i) {
+			rules.push_back(L"C:\\Users\\someone\\Pictures\\**\\private" + std::to_wstring(i));
+		}
+		PathFilter filter;
+		filter.SetPatterns(rules);
+		ReferenceFilter reference(rules);
+
+		std::vector<std::wstring> folders, names, paths;
+		for (int d = 0; d < 2000; ++d) {
+			folders.push_back(L"C:\\Users\\someone\\Pictures\\" + std::to_wstring(2000 + d % 25) + L"\\Event " + std::to_wstring(d));
+		}
+		for (int e = 0; e < 50; ++e) {
+			names.push_back(L"IMG_" + std::to_wstring(e) + L".jpg");
+		}
+		for (const auto& folder : folders) {
+			for (const auto& name : names) {
+				paths.push_back(folder + L"\\" + name);
+			}
+		}
+
+		size_t byFolder = 0, byPath = 0, byReference = 0, sampled = 0;
+		auto folderSeconds = Test::Time(5, [&] {
+			byFolder = 0;
+			for (const auto& folder : folders) {
+				auto position = filter.Walk(folder);
+				for (const auto& name : names) {
+					byFolder += filter.IsExcluded(position, name);
+				}
+			}
+		});
+		auto pathSeconds = Test::Time(5, [&] {
+			byPath = 0;
+			for (const auto& path : paths) {
+				byPath += filter.IsExcluded(path);
+			}
+		});
+		// Every rule against every folder of every path is slow enough for a sample
+		auto referenceSeconds = Test::Time(1, [&] {
+			byReference = 0;
+			for (size_t i = 0; i < paths.size(); i += 100) {
+				byReference += reference.IsExcluded(paths[i]);
+			}
+		}) * 100;
+		for (size_t i = 0; i < paths.size(); i += 100) {
+			sampled += filter.IsExcluded(paths[i]);
+		}
+		CHECK(byFolder == byPath);
+		CHECK(byReference == sampled);
+		std::printf("%zu entries, %zu rules: %.1f ms by folder, %.1f ms by full path, %.0f ms rule by rule (%zu excluded)\n",
+			paths.size(), rules.size(), folderSeconds * 1000, pathSeconds * 1000, referenceSeconds * 1000, byPath);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Test::Init(argc, argv);
+
+	TestPatterns();
+	TestAgainstReference();
+	if (Test::bench) {
+		BenchRules();
+	}
+	return Test::Finish();
+}
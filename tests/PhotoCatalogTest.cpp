@@ -0,0 +1,178 @@
+#include "PhotoCatalog.h"
+#include "Test.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	// A library laid out like most are: a folder per event, under a folder per year
+	std::wstring EventFolder(int folder)
+	{
+		int year = 2005 + folder % 20;
+		return L"C:\\Users\\someone\\Pictures\\" + std::to_wstring(year) + L"\\" + std::to_wstring(year) + L"-" +
+			std::to_wstring(1 + folder % 12) + L" Holiday " + std::to_wstring(folder);
+	}
+
+	std::wstring PhotoName(int photo)
+	{
+		auto number = std::to_wstring(photo);
+		return L"IMG_" + std::wstring(8 - std::min<size_t>(8, number.size()), L'0') + number + L".jpg";
+	}
+
+	void TestFolders()
+	{
+		PhotoCatalog catalog;
+		auto folder = catalog.AddFolder(L"C:\\Pictures\\2019\\Rome");
+		CHECK(catalog.GetFolderPath(folder) == L"C:\\Pictures\\2019\\Rome");
+		CHECK(catalog.GetFolderName(folder) == L"Rome");
+		CHECK(catalog.FolderCount() == 4);
+
+		// Either slash, and a trailing one, give the same folder
+		CHECK(catalog.AddFolder(L"C:/Pictures/2019/Rome") == folder);
+		CHECK(catalog.AddFolder(L"C:\\Pictures\\2019\\Rome\\") == folder);
+		CHECK(catalog.FolderCount() == 4);
+
+		// A shared prefix is stored once
+		auto sibling = catalog.AddFolder(L"C:\\Pictures\\2019\\Paris");
+		CHECK(sibling != folder);
+		CHECK(catalog.FolderCount() == 5);
+		auto parent = catalog.AddFolder(L"C:\\Pictures\\2019");
+		CHECK(catalog.GetFolderPath(parent) == L"C:\\Pictures\\2019");
+		CHECK(catalog.FolderCount() == 5);
+
+		// Names are compared exactly, like the folder names on screen
+		CHECK(catalog.AddFolder(L"C:\\Pictures\\2019\\rome") != folder);
+
+		// Network shares keep their leading slashes
+		auto share = catalog.AddFolder(L"\\\\server\\photos\\2020");
+		CHECK(catalog.GetFolderPath(share) == L"\\\\server\\photos\\2020");
+		CHECK(catalog.GetFolderName(share) == L"2020");
+
+		CHECK(catalog.GetFolderPath(PhotoCatalog::NoFolder).empty());
+		CHECK(catalog.GetFolderName(PhotoCatalog::NoFolder).empty());
+	}
+
+	void TestNamesAndPaths()
+	{
+		PhotoCatalog catalog;
+		auto folder = catalog.AddFolder(L"D:\\Photos\\Trip");
+		auto name = catalog.AddName(L"IMG_0001.jpg");
+		auto unicode = catalog.AddName(L"Zo\u00EB \u65E5\u672C.heic");
+		CHECK(catalog.GetName(name) == L"IMG_0001.jpg");
+		CHECK(catalog.GetName(unicode) == L"Zo\u00EB \u65E5\u672C.heic");
+		CHECK(catalog.GetPath(folder, name) == L"D:\\Photos\\Trip\\IMG_0001.jpg");
+		CHECK(catalog.GetPath(catalog.AddFolder(L"D:/Photos/Trip/"), unicode) == L"D:\\Photos\\Trip\\Zo\u00EB \u65E5\u672C.heic");
+
+		// The root of a drive is stored as just the drive
+		auto root = catalog.AddFolder(L"E:\\");
+		CHECK(catalog.GetPath(root, name) == L"E:\\IMG_0001.jpg");
+		CHECK(catalog.GetPath(PhotoCatalog::NoFolder, name) == L"IMG_0001.jpg");
+	}
+
+	void TestLocations()
+	{
+		PhotoCatalog catalog;
+		CHECK(catalog.AddLocation("") == PhotoCatalog::NoLocation);
+		CHECK(catalog.GetLocation(PhotoCatalog::UnknownLocation).empty());
+		CHECK(catalog.GetLocation(PhotoCatalog::NoLocation).empty());
+
+		auto rome = catalog.AddLocation("Rome, Italy");
+		CHECK(rome != PhotoCatalog::UnknownLocation && rome != PhotoCatalog::NoLocation);
+		CHECK(catalog.AddLocation("Rome, Italy") == rome);
+		CHECK(catalog.AddLocation("Z\xC3\xBCrich, Switzerland") != rome);
+		CHECK(catalog.GetLocation(rome) == "Rome, Italy");
+		CHECK(catalog.GetLocation(catalog.AddLocation("Z\xC3\xBCrich, Switzerland")) == "Z\xC3\xBCrich, Switzerland");
+		CHECK(catalog.LocationCount() == 4);
+		CHECK(catalog.GetLocation(1000).empty());
+	}
+
+	void TestThreads()
+	{
+		// The scan threads add while the render thread reads
+		PhotoCatalog catalog;
+		std::vector<std::thread> threads;
+		std::vector<std::vector<std::pair<uint32_t, uint32_t>>> added(4);
+		for (int t = 0; t < 4; ++t) {
+			threads.emplace_back([&, t] {
+				for (int i = 0; i < 2000; ++i) {
+					int photo = t * 2000 + i;
+					added[t].push_back({ catalog.AddFolder(EventFolder(photo / 50)), catalog.AddName(PhotoName(photo)) });
+					catalog.AddLocation("Town " + std::to_string(photo % 30));
+					if (i > 0) {
+						auto [folder, name] = added[t][i / 2];
+						catalog.GetPath(folder, name);
+					}
+				}
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		int wrong = 0;
+		for (int t = 0; t < 4; ++t) {
+			for (int i = 0; i < 2000; ++i) {
+				int photo = t * 2000 + i;
+				auto [folder, name] = added[t][i];
+				wrong += catalog.GetPath(folder, name) != EventFolder(photo / 50) + L"\\" + PhotoName(photo);
+			}
+		}
+		CHECK(wrong == 0);
+		CHECK(catalog.LocationCount() == 2 + 30);
+	}
+
+	// Bytes of the catalog per photo, and of the full paths it replaces
+	void MeasureMemory(int photos, bool print)
+	{
+		PhotoCatalog catalog;
+		std::vector<std::pair<uint32_t, uint32_t>> ids;
+		size_t pathBytes = 0;
+		for (int photo = 0; photo < photos; ++photo) {
+			auto folder = EventFolder(photo / 50);
+			auto name = PhotoName(photo);
+			ids.push_back({ catalog.AddFolder(folder), catalog.AddName(name) });
+			pathBytes += sizeof(std::wstring) + (folder.size() + 1 + name.size() + 1) * sizeof(wchar_t);
+			if (photo % 3 == 0) {
+				catalog.AddLocation("Town " + std::to_string(photo % 300) + ", Country " + std::to_string(photo % 20));
+			}
+		}
+		CHECK(catalog.GetPath(ids.back().first, ids.back().second) == EventFolder((photos - 1) / 50) + L"\\" + PhotoName(photos - 1));
+
+		// The folder prefixes are shared, what's left is mostly the names
+		auto bytes = catalog.MemoryUsage();
+		CHECK(bytes < pathBytes / 2);
+		if (print) {
+			std::printf("%d photos in %zu folders: catalog %.1f bytes per photo, full paths %.1f bytes per photo\n",
+				photos, catalog.FolderCount(), (double)bytes / photos, (double)pathBytes / photos);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Test::Init(argc, argv);
+
+	TestFolders();
+	TestNamesAndPaths();
+	TestLocations();
+	TestThreads();
+	MeasureMemory(20000, Test::bench);
+	if (Test::bench) {
+		MeasureMemory(500000, true);
+
+		PhotoCatalog catalog;
+		std::vector<std::pair<uint32_t, uint32_t>> ids;
+		for (int photo = 0; photo < 500000; ++photo) {
+			ids.push_back({ catalog.AddFolder(EventFolder(photo / 50)), catalog.AddName(PhotoName(photo)) });
+		}
+		size_t length = 0;
+		auto seconds = Test::Time(3, [&] {
+			for (const auto& [folder, name] : ids) {
+				length += catalog.GetPath(folder, name).size();
+			}
+		});
+		std::printf("GetPath: %.0f ns per path (%zu)\n", seconds / ids.size() * 1e9, length);
+	}
+	return Test::Finish();
+}
@@ -0,0 +1,393 @@
+#include "PhotoIndex.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	std::filesystem::path Directory()
+	{
+		auto directory = std::filesystem::temp_directory_path() / "PhotoCycleIndexTest";
+		std::filesystem::create_directories(directory);
+		return directory;
+	}
+
+	std::wstring IndexFile(const wchar_t* name)
+	{
+		return (Directory() / name).wstring();
+	}
+
+	ImageInfo* AddPhoto(ImageFolderMap& folders, const std::wstring& folderPath, const std::wstring& name, int number)
+	{
+		auto& catalog = ImageInfo::Catalog();
+		auto* info = ImageInfo::Create();
+		info->idx = number;
+		info->folder = catalog.AddFolder(folderPath);
+		info->name = catalog.AddName(name);
+		folders[folderPath].images.push_back(info);
+		return info;
+	}
+
+	void Clear(ImageFolderMap& folders)
+	{
+		for (auto& [path, folder] : folders) {
+			for (auto* info : folder.images) {
+				ImageInfo::Destroy(info);
+			}
+		}
+		folders.clear();
+	}
+
+	std::string ReadFile(const std::wstring& file)
+	{
+		std::ifstream fin(std::filesystem::path(file), std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(fin), {});
+	}
+
+	void WriteFile(const std::wstring& file, const std::string& data)
+	{
+		std::ofstream(std::filesystem::path(file), std::ios::binary | std::ios::trunc).write(data.data(), data.size());
+	}
+
+	// Every photo's number by path
+	std::map<std::wstring, int> Numbers(const ImageFolderMap& folders)
+	{
+		std::map<std::wstring, int> numbers;
+		for (const auto& [path, folder] : folders) {
+			for (const auto* info : folder.images) {
+				numbers[info->GetFilePath()] = info->idx;
+			}
+		}
+		return numbers;
+	}
+
+	// Ten photos in two folders, numbered 0 to 9, with everything the index keeps filled in
+	ImageFolderMap MakeLibrary(PlaylistState& playlist)
+	{
+		ImageFolderMap folders;
+		auto& catalog = ImageInfo::Catalog();
+		auto amsterdam = catalog.AddLocation("Amsterdam, Netherlands");
+		auto gent = catalog.AddLocation("Gent, Belgi\xC3\xAB");
+		for (int number = 0; number < 10; ++number) {
+			auto folder = number < 6 ? L"C:\\Photos\\2023" : L"C:\\Photos\\2024 Gent";
+			auto* info = AddPhoto(folders, folder, L"IMG_" + std::to_wstring(number) + L".jpg", number);
+			info->fileSize = 1000000 + number;
+			info->lastWriteTime = 133000000000000000ull + number;
+			info->date = number % 3 == 0 ? ImageInfo::NoDate : (uint32_t)(2023 << 16 | 7 << 8 | (number + 1));
+			info->rotation = number % 4 == 0 ? -1 : number % 4 * 90;
+			info->location = number % 3 == 0 ? PhotoCatalog::NoLocation : number < 6 ? amsterdam : gent;
+			info->width = 4000 + number;
+			info->height = 3000 + number;
+		}
+		folders[L"C:\\Photos\\2023"].lastWriteTime = 11;
+		folders[L"C:\\Photos\\2023"].subdirectories = { L"C:\\Photos\\2023\\Raw", L"C:\\Photos\\2023\\\x00E9t\x00E9" };
+		folders[L"C:\\Photos\\2024 Gent"].lastWriteTime = 12;
+		folders[L"C:\\Photos\\2023\\Raw"];
+		folders[L"C:\\Photos\\2023\\\x00E9t\x00E9"];
+
+		playlist.seed = 0x1234567890ABCDEFull;
+		playlist.position = 7;
+		playlist.count = 10;
+		return folders;
+	}
+
+	void TestRoundTrip()
+	{
+		PlaylistState playlist;
+		auto folders = MakeLibrary(playlist);
+		auto file = IndexFile(L"roundtrip.idx");
+		CHECK(PhotoIndex::Save(file, folders, playlist, false));
+		CHECK(!std::filesystem::exists(file + L".tmp"));
+
+		ImageFolderMap loaded;
+		PlaylistState loadedPlaylist;
+		CHECK(PhotoIndex::Load(file, loaded, loadedPlaylist));
+		CHECK(loadedPlaylist.seed == playlist.seed && loadedPlaylist.position == playlist.position && loadedPlaylist.count == playlist.count);
+		CHECK(loaded.size() == folders.size());
+		CHECK(Numbers(loaded) == Numbers(folders));
+
+		auto& catalog = ImageInfo::Catalog();
+		int wrong = 0;
+		for (const auto& [path, folder] : folders) {
+			const auto& other = loaded[path];
+			wrong += other.lastWriteTime != folder.lastWriteTime || other.subdirectories != folder.subdirectories;
+			wrong += other.images.size() != folder.images.size();
+			for (size_t i = 0; i < std::min(folder.images.size(), other.images.size()); ++i) {
+				const auto* a = folder.images[i];
+				const auto* b = other.images[i];
+				wrong += a->GetFilePath() != b->GetFilePath() || a->fileSize != b->fileSize || a->lastWriteTime != b->lastWriteTime;
+				wrong += a->date != b->date || a->rotation != b->rotation || a->width != b->width || a->height != b->height;
+				wrong += catalog.GetLocation(a->location) != catalog.GetLocation(b->location);
+				wrong += (a->location == PhotoCatalog::NoLocation) != (b->location == PhotoCatalog::NoLocation);
+			}
+		}
+		CHECK(wrong == 0);
+
+		// Saving what was loaded keeps it all
+		auto again = IndexFile(L"again.idx");
+		CHECK(PhotoIndex::Save(again, loaded, loadedPlaylist, false));
+		ImageFolderMap reloaded;
+		CHECK(PhotoIndex::Load(again, reloaded, loadedPlaylist));
+		CHECK(Numbers(reloaded) == Numbers(folders));
+		CHECK(loadedPlaylist.position == playlist.position && loadedPlaylist.count == playlist.count);
+		Clear(reloaded);
+
+		// A location lookup that is still running is looked up again next time
+		folders[L"C:\\Photos\\2023"].images[1]->isCaching = true;
+		CHECK(PhotoIndex::Save(file, folders, playlist, false));
+		Clear(loaded);
+		CHECK(PhotoIndex::Load(file, loaded, loadedPlaylist));
+		CHECK(loaded[L"C:\\Photos\\2023"].images[1]->location == PhotoCatalog::UnknownLocation);
+		CHECK(loaded[L"C:\\Photos\\2023"].images[2]->location != PhotoCatalog::UnknownLocation);
+
+		Clear(folders);
+		Clear(loaded);
+	}
+
+	void TestNumbers()
+	{
+		PlaylistState playlist;
+		auto folders = MakeLibrary(playlist);
+		auto file = IndexFile(L"numbers.idx");
+
+		// Photos 3 and 8 are gone. A new one was found during the scan and got number 10,
+		// and one more wasn't numbered yet when the index was saved.
+		auto& images2023 = folders[L"C:\\Photos\\2023"].images;
+		auto& images2024 = folders[L"C:\\Photos\\2024 Gent"].images;
+		ImageInfo::Destroy(images2023[3]);
+		images2023.erase(images2023.begin() + 3);
+		ImageInfo::Destroy(images2024[2]);
+		images2024.erase(images2024.begin() + 2);
+		AddPhoto(folders, L"C:\\Photos\\2024 Gent", L"New.jpg", 10);
+		AddPhoto(folders, L"C:\\Photos\\2023", L"Unnumbered.jpg", -1);
+		playlist.position = 9;
+
+		// Without fillHoles, the scan may not be done, so the holes may still be found: the
+		// new photos go after them, and every other number stays
+		auto before = Numbers(folders);
+		CHECK(PhotoIndex::Save(file, folders, playlist, false));
+		ImageFolderMap loaded;
+		PlaylistState loadedPlaylist;
+		CHECK(PhotoIndex::Load(file, loaded, loadedPlaylist));
+		auto numbers = Numbers(loaded);
+		CHECK(loadedPlaylist.count == 12);
+		CHECK(loadedPlaylist.position == 9);
+		CHECK(numbers[L"C:\\Photos\\2024 Gent\\New.jpg"] == 10);
+		CHECK(numbers[L"C:\\Photos\\2023\\Unnumbered.jpg"] == 11);
+		int moved = 0;
+		for (const auto& [path, number] : before) {
+			moved += number >= 0 && numbers[path] != number;
+		}
+		CHECK(moved == 0);
+
+		// Saved again the numbers stay, the holes too
+		auto file2 = IndexFile(L"numbers2.idx");
+		CHECK(PhotoIndex::Save(file2, loaded, loadedPlaylist, false));
+		ImageFolderMap reloaded;
+		CHECK(PhotoIndex::Load(file2, reloaded, loadedPlaylist));
+		CHECK(Numbers(reloaded) == numbers);
+		CHECK(loadedPlaylist.count == 12);
+		Clear(reloaded);
+
+		// With fillHoles the new photos take the holes, lowest first, and nothing else moves
+		CHECK(PhotoIndex::Save(file, folders, playlist, true));
+		Clear(loaded);
+		CHECK(PhotoIndex::Load(file, loaded, loadedPlaylist));
+		numbers = Numbers(loaded);
+		CHECK(loadedPlaylist.count == 10);
+		CHECK(loadedPlaylist.position == 9);
+		CHECK(numbers[L"C:\\Photos\\2024 Gent\\New.jpg"] == 3);
+		CHECK(numbers[L"C:\\Photos\\2023\\Unnumbered.jpg"] == 8);
+		moved = 0;
+		for (const auto& [path, number] : before) {
+			moved += number >= 0 && number < 10 && numbers[path] != number;
+		}
+		CHECK(moved == 0);
+
+		// With no count, as after a cold scan, the photos are numbered in the order of the
+		// numbers they had, and those without one after them
+		Clear(loaded);
+		folders[L"C:\\Photos\\2023"].images[0]->idx = 500;
+		playlist.count = 0;
+		playlist.position = 3;
+		CHECK(PhotoIndex::Save(file, folders, playlist, true));
+		CHECK(PhotoIndex::Load(file, loaded, loadedPlaylist));
+		CHECK(loadedPlaylist.count == 10 && loadedPlaylist.position == 3);
+		CHECK(loaded[L"C:\\Photos\\2023"].images[0]->idx == 8);
+		CHECK(Numbers(loaded)[L"C:\\Photos\\2023\\Unnumbered.jpg"] == 9);
+
+		Clear(folders);
+		Clear(loaded);
+	}
+
+	// Loads `data` as an index file
+	bool LoadData(const std::string& data, ImageFolderMap& folders, PlaylistState& playlist)
+	{
+		auto file = IndexFile(L"damaged.idx");
+		WriteFile(file, data);
+		return PhotoIndex::Load(file, folders, playlist);
+	}
+
+	// Photos WIC couldn't decode stay out of the playlist across sessions, until the file changes
+	void TestDecodeErrors()
+	{
+		const int32_t badHeader = (int32_t)0x88982F61; // WINCODEC_ERR_BADHEADER
+		const int32_t unknownFormat = (int32_t)0x88982F50; // WINCODEC_ERR_COMPONENTNOTFOUND
+		PlaylistState playlist;
+		auto folders = MakeLibrary(playlist);
+		auto& images = folders[L"C:\\Photos\\2023"].images;
+		images[1]->decodeError = badHeader;
+		images[2]->decodeError = unknownFormat;
+		images[3]->decodeError = badHeader;
+		auto file = IndexFile(L"errors.idx");
+		CHECK(PhotoIndex::Save(file, folders, playlist, false));
+		Clear(folders);
+
+		ImageFolderMap loaded;
+		CHECK(PhotoIndex::Load(file, loaded, playlist));
+		std::vector<int> skipped;
+		for (const auto& [path, folder] : loaded) {
+			for (const auto* info : folder.images) {
+				if (info->IsUndecodable()) {
+					skipped.push_back(info->idx);
+				}
+			}
+		}
+		std::sort(skipped.begin(), skipped.end());
+		CHECK((skipped == std::vector<int>{ 1, 2, 3 }));
+		auto& loadedImages = loaded[L"C:\\Photos\\2023"].images;
+		CHECK(loadedImages[1]->decodeError == badHeader && loadedImages[2]->decodeError == unknownFormat);
+
+		// Photo 1 is as it was, photo 2 was edited and photo 3 replaced by a file of another size
+		auto* same = loadedImages[1];
+		auto* edited = loadedImages[2];
+		auto* resized = loadedImages[3];
+		same->ValidateCachedInfo(same->fileSize, same->lastWriteTime);
+		edited->ValidateCachedInfo(edited->fileSize, edited->lastWriteTime + 1);
+		resized->ValidateCachedInfo(resized->fileSize + 1, resized->lastWriteTime);
+		CHECK(same->IsUndecodable() && same->decodeError == badHeader);
+		CHECK(!edited->IsUndecodable() && edited->decodeError == 0);
+		CHECK(!resized->IsUndecodable() && resized->decodeError == 0);
+		// Along with the rest of what was known about the old file
+		CHECK(edited->rotation == -1 && edited->date == ImageInfo::UnknownDate && edited->width == 0);
+		CHECK(resized->fileSize == 1000000 + 3 + 1);
+
+		// And it stays that way in the index
+		CHECK(PhotoIndex::Save(file, loaded, playlist, false));
+		Clear(loaded);
+		CHECK(PhotoIndex::Load(file, loaded, playlist));
+		auto& reloaded = loaded[L"C:\\Photos\\2023"].images;
+		CHECK(reloaded[1]->IsUndecodable() && !reloaded[2]->IsUndecodable() && !reloaded[3]->IsUndecodable());
+		CHECK(!reloaded[0]->IsUndecodable() && reloaded[0]->decodeError == 0);
+		Clear(loaded);
+	}
+
+	void TestDamaged()
+	{
+		PlaylistState playlist;
+		auto folders = MakeLibrary(playlist);
+		auto file = IndexFile(L"good.idx");
+		CHECK(PhotoIndex::Save(file, folders, playlist, false));
+		Clear(folders);
+		auto good = ReadFile(file);
+
+		// What was there before a failed Load stays
+		ImageFolderMap kept;
+		PlaylistState keptPlaylist;
+		keptPlaylist.seed = 77;
+		AddPhoto(kept, L"D:\\Kept", L"a.jpg", 0);
+
+		// Cut off anywhere
+		int loaded = 0;
+		for (size_t size = 0; size < good.size(); ++size) {
+			loaded += LoadData(good.substr(0, size), kept, keptPlaylist);
+		}
+		CHECK(loaded == 0);
+		CHECK(kept.size() == 1 && keptPlaylist.seed == 77);
+		CHECK(!PhotoIndex::Load(IndexFile(L"missing.idx"), kept, keptPlaylist));
+
+		// Another magic or version
+		auto patch = [&good](size_t offset, uint32_t value) {
+			auto data = good;
+			std::memcpy(data.data() + offset, &value, sizeof(value));
+			return data;
+		};
+		CHECK(!LoadData(patch(0, 0x12345678), kept, keptPlaylist));
+		CHECK(!LoadData(patch(4, PhotoIndex::Version - 1), kept, keptPlaylist));
+		CHECK(!LoadData(patch(4, PhotoIndex::Version + 1), kept, keptPlaylist));
+
+		// Lengths and counts far past the end of the file: the location table comes after the
+		// magic, the version, the seed, the position and the count, and its first string after that
+		const size_t locationCount = 4 + 4 + 8 + 4 + 4;
+		CHECK(!LoadData(patch(locationCount, 0xFFFFFFFF), kept, keptPlaylist));
+		CHECK(!LoadData(patch(locationCount + 4, 0xFFFFFFFF), kept, keptPlaylist));
+		CHECK(!LoadData(patch(locationCount + 4, 0x7FFFFFFF), kept, keptPlaylist));
+		CHECK(kept.size() == 1 && keptPlaylist.seed == 77);
+
+		// Any four bytes overwritten with a large number is either rejected or loads something
+		// of the right shape, without reading past the end
+		std::mt19937 random(5);
+		int accepted = 0;
+		for (size_t offset = 0; offset + 4 <= good.size(); ++offset) {
+			ImageFolderMap damaged;
+			PlaylistState damagedPlaylist;
+			if (LoadData(patch(offset, 0xFFFFFF00 | (uint32_t)(random() & 0xFF)), damaged, damagedPlaylist)) {
+				++accepted;
+				for (const auto& [path, folder] : damaged) {
+					for (const auto* info : folder.images) {
+						CHECK(info->idx < 0 || (uint32_t)info->idx < damagedPlaylist.count);
+					}
+				}
+			}
+			Clear(damaged);
+		}
+		// The fields of the photos themselves can hold anything
+		CHECK(accepted > 0);
+
+		Clear(kept);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Test::Init(argc, argv);
+
+	TestRoundTrip();
+	TestNumbers();
+	TestDecodeErrors();
+	TestDamaged();
+
+	if (Test::bench) {
+		// A library of 200000 photos in 4000 folders
+		ImageFolderMap folders;
+		PlaylistState playlist;
+		for (int number = 0; number < 200000; ++number) {
+			auto folder = L"C:\\Users\\someone\\Pictures\\" + std::to_wstring(2000 + number / 8000) + L"\\Event " + std::to_wstring(number / 50);
+			auto* info = AddPhoto(folders, folder, L"IMG_" + std::to_wstring(number % 50) + L".jpg", number);
+			info->fileSize = 5000000 + number;
+			info->date = (uint32_t)(2020 << 16 | 1 << 8 | 1);
+		}
+		playlist.count = 200000;
+		auto file = IndexFile(L"large.idx");
+		auto saveSeconds = Test::Time(3, [&] { PhotoIndex::Save(file, folders, playlist, true); });
+		ImageFolderMap loaded;
+		auto loadSeconds = Test::Time(3, [&] {
+			Clear(loaded);
+			PhotoIndex::Load(file, loaded, playlist);
+		});
+		std::printf("%d photos: saved in %.1f ms, loaded in %.1f ms, %zu KB\n", (int)playlist.count, saveSeconds * 1000,
+			loadSeconds * 1000, (size_t)std::filesystem::file_size(file) / 1024);
+		Clear(folders);
+		Clear(loaded);
+	}
+
+	std::filesystem::remove_all(std::filesystem::temp_directory_path() / "PhotoCycleIndexTest");
+	return Test::Finish();
+}
@@ -0,0 +1,279 @@
+#include "PixelOps.h"
+#include "Test.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+	using Flatten = void (*)(uint8_t* pixels, size_t count, uint32_t backgroundColor);
+	using Downsample = void (*)(const uint8_t* src, size_t srcStride, uint32_t srcWidth, uint32_t srcHeight,
+		uint8_t* dst, size_t dstStride, uint32_t firstRow, uint32_t rowCount);
+
+	struct Kernel {
+		const char* name;
+		Flatten flatten;
+		Downsample downsample;
+		bool isSupported;
+	};
+
+	std::vector<Kernel> Kernels()
+	{
+		return {
+			{ "scalar", FlattenToBackgroundScalar, Downsample2xScalar, true },
+			{ "SSE2", FlattenToBackgroundSSE2, Downsample2xSSE2, CpuHasSSE2() },
+			{ "AVX2", FlattenToBackgroundAVX2, Downsample2xAVX2, CpuHasAVX2() },
+		};
+	}
+
+	// A pyramid of `count` levels over width x height, each level in its own buffer
+	struct Pyramid {
+		std::vector<std::vector<uint8_t>> buffers;
+		std::vector<PixelPlane> levels;
+
+		Pyramid(uint32_t width, uint32_t height, size_t count)
+		{
+			for (size_t l = 0; l < count; ++l) {
+				buffers.emplace_back((size_t)width * 4 * height);
+				levels.push_back({ buffers.back().data(), width * 4u, width, height });
+				width = (width + 1) / 2;
+				height = (height + 1) / 2;
+			}
+		}
+	};
+
+	// Premultiplied pixels, with a good share of fully transparent and fully opaque ones
+	std::vector<uint8_t> RandomPixels(std::mt19937& random, size_t count, bool premultiplied)
+	{
+		std::vector<uint8_t> pixels(count * 4);
+		for (size_t i = 0; i < count; ++i) {
+			auto kind = random() % 4;
+			uint8_t alpha = kind == 0 ? 0 : kind == 1 ? 255 : (uint8_t)random();
+			pixels[i * 4 + 3] = alpha;
+			for (int c = 0; c < 3; ++c) {
+				pixels[i * 4 + c] = premultiplied ? (uint8_t)(random() % (alpha + 1u)) : (uint8_t)random();
+			}
+		}
+		return pixels;
+	}
+
+	void TestScalarRounding()
+	{
+		// Every color and alpha against every background value, computed in floating point
+		std::vector<uint8_t> pixels;
+		for (uint32_t alpha = 0; alpha < 256; ++alpha) {
+			for (uint32_t c = 0; c <= alpha; ++c) {
+				pixels.insert(pixels.end(), { (uint8_t)c, (uint8_t)c, (uint8_t)c, (uint8_t)alpha });
+			}
+		}
+		for (uint32_t background = 0; background < 256; ++background) {
+			auto flattened = pixels;
+			FlattenToBackgroundScalar(flattened.data(), flattened.size() / 4, background | background << 8 | background << 16);
+			for (size_t i = 0; i < pixels.size(); i += 4) {
+				auto c = pixels[i];
+				auto alpha = pixels[i + 3];
+				auto expected = c + std::lround((255 - alpha) * background / 255.0);
+				if (flattened[i] != expected || flattened[i + 3] != 255) {
+					CHECK(flattened[i] == expected);
+					CHECK(flattened[i + 3] == 255);
+					return;
+				}
+			}
+		}
+	}
+
+	void TestKernelsAgree()
+	{
+		std::mt19937 random(1);
+		auto kernels = Kernels();
+		for (int round = 0; round < 500; ++round) {
+			// Short counts as well, so every tail length of the vector loops comes by
+			size_t count = round < 64 ? (size_t)round : 1 + random() % 2000;
+			auto pixels = RandomPixels(random, count, round % 5 != 0);
+			uint32_t background = random() & 0xFFFFFF;
+
+			auto expected = pixels;
+			FlattenToBackgroundScalar(expected.data(), count, background);
+			for (const auto& kernel : kernels) {
+				if (!kernel.isSupported) {
+					continue;
+				}
+				auto flattened = pixels;
+				kernel.flatten(flattened.data(), count, background);
+				if (flattened != expected) {
+					std::printf("%s differs from scalar for %zu pixels\n", kernel.name, count);
+					CHECK(flattened == expected);
+					return;
+				}
+			}
+
+			auto dispatched = pixels;
+			FlattenToBackground(dispatched.data(), count, background);
+			CHECK(dispatched == expected);
+		}
+	}
+
+	void TestDownsampleScalar()
+	{
+		// Against the definition, for an odd size so the last column and row are averaged with themselves
+		std::mt19937 random(3);
+		uint32_t width = 5, height = 3;
+		std::vector<uint8_t> src(width * 4 * height);
+		for (auto& value : src) {
+			value = (uint8_t)random();
+		}
+		std::vector<uint8_t> dst(3 * 4 * 2);
+		Downsample2xScalar(src.data(), width * 4, width, height, dst.data(), 3 * 4, 0, 2);
+		for (uint32_t y = 0; y < 2; ++y) {
+			for (uint32_t x = 0; x < 3; ++x) {
+				for (uint32_t c = 0; c < 4; ++c) {
+					auto at = [&](uint32_t sx, uint32_t sy) {
+						return src[(std::min(sy, height - 1) * width + std::min(sx, width - 1)) * 4 + c];
+					};
+					uint32_t sum = at(2 * x, 2 * y) + at(2 * x + 1, 2 * y) + at(2 * x, 2 * y + 1) + at(2 * x + 1, 2 * y + 1);
+					CHECK(dst[(y * 3 + x) * 4 + c] == (sum + 2) / 4);
+				}
+			}
+		}
+	}
+
+	void TestDownsampleKernelsAgree()
+	{
+		std::mt19937 random(4);
+		auto kernels = Kernels();
+		for (int round = 0; round < 500; ++round) {
+			// Narrow widths as well, so every tail length of the vector loops comes by, and padded strides
+			uint32_t width = round < 80 ? 1 + round : 1 + random() % 300;
+			uint32_t height = 1 + random() % 9;
+			size_t srcStride = width * 4 + (random() % 3) * 4;
+			uint32_t dstWidth = (width + 1) / 2, dstHeight = (height + 1) / 2;
+			size_t dstStride = dstWidth * 4 + (random() % 3) * 4;
+			std::vector<uint8_t> src(srcStride * height);
+			for (auto& value : src) {
+				value = (uint8_t)random();
+			}
+			// Some of the rows only, which must leave the others and the padding alone
+			uint32_t firstRow = random() % dstHeight;
+			uint32_t rowCount = 1 + random() % (dstHeight - firstRow);
+
+			std::vector<uint8_t> expected(dstStride * dstHeight, 0xCD);
+			Downsample2xScalar(src.data(), srcStride, width, height, expected.data(), dstStride, firstRow, rowCount);
+			for (const auto& kernel : kernels) {
+				if (!kernel.isSupported) {
+					continue;
+				}
+				std::vector<uint8_t> dst(expected.size(), 0xCD);
+				kernel.downsample(src.data(), srcStride, width, height, dst.data(), dstStride, firstRow, rowCount);
+				if (dst != expected) {
+					std::printf("%s differs from scalar for %u x %u, rows %u to %u\n", kernel.name, width, height, firstRow, firstRow + rowCount);
+					CHECK(dst == expected);
+					return;
+				}
+			}
+
+			std::vector<uint8_t> dispatched(expected.size(), 0xCD);
+			Downsample2x(src.data(), srcStride, width, height, dispatched.data(), dstStride, firstRow, rowCount);
+			CHECK(dispatched == expected);
+		}
+	}
+
+	void TestMipLevelsInStrips()
+	{
+		// Built strip by strip as the decoder would, the pyramid must be the one built level by level
+		std::mt19937 random(5);
+		for (int round = 0; round < 50; ++round) {
+			uint32_t width = 1 + random() % 500, height = 1 + random() % 500;
+			uint32_t strip = 1 + random() % 64;
+			Pyramid pyramid(width, height, 4);
+			for (auto& value : pyramid.buffers[0]) {
+				value = (uint8_t)random();
+			}
+			auto expected = pyramid.buffers;
+			const auto& levels = pyramid.levels;
+			for (size_t l = 1; l < levels.size(); ++l) {
+				Downsample2xScalar(expected[l - 1].data(), levels[l - 1].stride, levels[l - 1].width, levels[l - 1].height,
+					expected[l].data(), levels[l].stride, 0, levels[l].height);
+			}
+
+			std::vector<uint32_t> doneRows(levels.size());
+			for (uint32_t row = 0; row < height; row += strip) {
+				doneRows[0] = std::min(height, row + strip);
+				BuildMipLevels(pyramid.levels.data(), pyramid.levels.size(), doneRows.data());
+			}
+			for (size_t l = 1; l < levels.size(); ++l) {
+				CHECK(doneRows[l] == levels[l].height);
+			}
+			if (pyramid.buffers != expected) {
+				std::printf("Mip levels of %u x %u in strips of %u differ\n", width, height, strip);
+				CHECK(pyramid.buffers == expected);
+				return;
+			}
+		}
+	}
+
+	void BenchFlatten()
+	{
+		// A 4K screen at the largest pan-and-scan zoom
+		std::mt19937 random(2);
+		size_t count = 4608 * 2592;
+		auto pixels = RandomPixels(random, count, true);
+		for (const auto& kernel : Kernels()) {
+			if (!kernel.isSupported) {
+				continue;
+			}
+			auto work = pixels;
+			auto seconds = Test::Time(10, [&] {
+				work = pixels;
+				kernel.flatten(work.data(), count, 0x204060);
+			});
+			std::printf("FlattenToBackground %-6s %7.1f megapixels/s (copy included)\n", kernel.name, count / seconds / 1e6);
+		}
+	}
+
+	void BenchDownsample()
+	{
+		std::mt19937 random(6);
+		uint32_t width = 4608, height = 2592;
+		Pyramid pyramid(width, height, 4);
+		for (auto& value : pyramid.buffers[0]) {
+			value = (uint8_t)random();
+		}
+		const auto& levels = pyramid.levels;
+		for (const auto& kernel : Kernels()) {
+			if (!kernel.isSupported) {
+				continue;
+			}
+			auto seconds = Test::Time(10, [&] {
+				kernel.downsample(levels[0].pixels, levels[0].stride, width, height, levels[1].pixels, levels[1].stride, 0, levels[1].height);
+			});
+			std::printf("Downsample2x        %-6s %7.1f source megapixels/s\n", kernel.name, (double)width * height / seconds / 1e6);
+		}
+
+		// Three levels in strips of 64 rows, the way the decoder builds them
+		auto seconds = Test::Time(10, [&] {
+			std::vector<uint32_t> doneRows(levels.size());
+			for (uint32_t row = 0; row < height; row += 64) {
+				doneRows[0] = std::min(height, row + 64);
+				BuildMipLevels(pyramid.levels.data(), pyramid.levels.size(), doneRows.data());
+			}
+		});
+		std::printf("BuildMipLevels (3 levels, strips)  %7.1f source megapixels/s\n", (double)width * height / seconds / 1e6);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Test::Init(argc, argv);
+	std::printf("SSE2: %s, AVX2: %s\n", CpuHasSSE2() ? "yes" : "no", CpuHasAVX2() ? "yes" : "no");
+
+	TestScalarRounding();
+	TestKernelsAgree();
+	TestDownsampleScalar();
+	TestDownsampleKernelsAgree();
+	TestMipLevelsInStrips();
+	if (Test::bench) {
+		BenchFlatten();
+		BenchDownsample();
+	}
+	return Test::Finish();
+}
@@ -0,0 +1,104 @@
+#include "PlaylistOrder.h"
+#include "Test.h"
+
+#include <vector>
+
+namespace {
+	void TestBijection()
+	{
+		// Every photo exactly once, around the powers of four as well
+		PlaylistOrder order;
+		for (uint64_t seed : { 0ull, 1ull, 0x1234567890ABCDEFull }) {
+			order.SetSeed(seed);
+			for (uint32_t count : { 1u, 2u, 3u, 4u, 5u, 15u, 16u, 17u, 100u, 1023u, 1024u, 1025u, 65537u, 1000000u }) {
+				std::vector<bool> seen(count);
+				bool isBijection = true;
+				for (uint32_t position = 0; position < count; ++position) {
+					auto photo = order.At(position, count);
+					isBijection = isBijection && photo < count && !seen[photo];
+					if (photo < count) {
+						seen[photo] = true;
+					}
+				}
+				if (!isBijection) {
+					std::printf("Seed %llx, %u photos: not every photo once\n", (unsigned long long)seed, count);
+				}
+				CHECK(isBijection);
+			}
+		}
+	}
+
+	void TestGrowth()
+	{
+		// A photo that is added takes over one position at most, until the next power of four
+		PlaylistOrder order;
+		order.SetSeed(42);
+		int wrong = 0;
+		for (uint32_t count = 1000; count < 1100; ++count) {
+			if (count == 1024) {
+				// 1025 is a different network, over 4096
+				continue;
+			}
+			int changed = 0;
+			for (uint32_t position = 0; position < count; ++position) {
+				auto before = order.At(position, count);
+				auto after = order.At(position, count + 1);
+				if (before != after) {
+					++changed;
+					wrong += after != count;
+				}
+			}
+			wrong += changed > 1;
+		}
+		CHECK(wrong == 0);
+
+		// Most of a large library stays where it was when a thousand photos are added
+		int changed = 0;
+		for (uint32_t position = 0; position < 100000; ++position) {
+			changed += order.At(position, 1000000) != order.At(position, 1001000);
+		}
+		CHECK(changed <= 1000);
+	}
+
+	void TestSeeds()
+	{
+		PlaylistOrder a, b;
+		a.SetSeed(7);
+		b.SetSeed(7);
+		CHECK(a.GetSeed() == 7);
+		int same = 0, sameRandom = 0;
+		for (uint32_t position = 0; position < 1000; ++position) {
+			CHECK(a.At(position, 1000) == b.At(position, 1000));
+			CHECK(a.Random(position) == b.Random(position));
+		}
+		b.SetSeed(8);
+		for (uint32_t position = 0; position < 1000; ++position) {
+			same += a.At(position, 1000) == b.At(position, 1000);
+			sameRandom += a.Random(position) == b.Random(position);
+		}
+		// Another seed is another order, with about one in a thousand in the same place
+		CHECK(same < 20);
+		CHECK(sameRandom == 0);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Test::Init(argc, argv);
+
+	TestBijection();
+	TestGrowth();
+	TestSeeds();
+	if (Test::bench) {
+		PlaylistOrder order;
+		order.SetSeed(0x1234567890ABCDEFull);
+		uint64_t sum = 0;
+		auto seconds = Test::Time(5, [&] {
+			for (uint32_t position = 0; position < 1000000; ++position) {
+				sum += order.At(position, 1000000);
+			}
+		});
+		std::printf("At: %.1f ns per position of a million (%llu)\n", seconds / 1e6 * 1e9, (unsigned long long)sum);
+	}
+	return Test::Finish();
+}
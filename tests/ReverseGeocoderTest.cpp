@@ -0,0 +1,159 @@
+#include "ReverseGeocoder.h"
+#include "Test.h"
+
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	struct Place {
+		double latitude;
+		double longitude;
+		std::string country;
+	};
+
+	const double Pi = 3.14159265358979323846;
+
+	// Squared straight-line distance between two points on the unit sphere
+	double ChordDistance(double latitude1, double longitude1, double latitude2, double longitude2)
+	{
+		auto toPoint = [](double latitude, double longitude, double point[3]) {
+			double lat = latitude * Pi / 180, lon = longitude * Pi / 180;
+			point[0] = std::cos(lat) * std::cos(lon);
+			point[1] = std::cos(lat) * std::sin(lon);
+			point[2] = std::sin(lat);
+		};
+		double a[3], b[3];
+		toPoint(latitude1, longitude1, a);
+		toPoint(latitude2, longitude2, b);
+		return (a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) + (a[2] - b[2]) * (a[2] - b[2]);
+	}
+
+	// Town<n> in cities.txt in a fresh directory, with a countryInfo.txt that knows NL and BE.
+	// Every other line is a place that has to be skipped.
+	std::filesystem::path WritePlaces(const std::vector<Place>& places)
+	{
+		auto directory = std::filesystem::temp_directory_path() / "PhotoCycleReverseGeocoderTest";
+		std::filesystem::create_directories(directory);
+
+		std::ofstream countries(directory / "countryInfo.txt", std::ios::binary);
+		countries << "#ISO\tISO3\tISO-Numeric\tfips\tCountry\tCapital\n";
+		countries << "NL\tNLD\t528\tNL\tNetherlands\tAmsterdam\n";
+		countries << "BE\tBEL\t056\tBE\tBelgium\tBrussels\n";
+
+		auto path = directory / "cities.txt";
+		std::ofstream file(path, std::ios::binary);
+		file.precision(8);
+		for (size_t i = 0; i < places.size(); ++i) {
+			const auto& place = places[i];
+			file << i << "\tTown" << i << "\tTown" << i << "\t\t" << place.latitude << "\t" << place.longitude
+				<< "\tP\tPPL\t" << place.country << "\t\t\t\t\t\t1000\t\t10\tEurope/Amsterdam\t2024-01-01\r\n";
+			// Right on top of it, so it would win if it weren't skipped
+			const char* skipped = i % 2 == 0 ? "P\tPPLX" : "S\tHTL";
+			file << i << "\tSkipped" << i << "\tSkipped\t\t" << place.latitude << "\t" << place.longitude
+				<< "\t" << skipped << "\t" << place.country << "\t\t\t\t\t\t0\t\t10\tEurope/Amsterdam\t2024-01-01\n";
+		}
+		return path;
+	}
+
+	std::vector<Place> RandomPlaces(std::mt19937& random, size_t count)
+	{
+		// Uniform over the sphere
+		std::uniform_real_distribution<double> z(-1, 1), longitude(-180, 180);
+		const char* countries[] = { "NL", "BE", "XX" };
+		std::vector<Place> places;
+		for (size_t i = 0; i < count; ++i) {
+			places.push_back({ std::asin(z(random)) * 180 / Pi, longitude(random), countries[i % 3] });
+		}
+		return places;
+	}
+
+	// The place Describe names must be as close as the nearest one, found by trying them all
+	void TestNearest(std::mt19937& random, const std::vector<Place>& places, const ReverseGeocoder& geocoder, int lookups)
+	{
+		std::uniform_real_distribution<double> z(-1, 1), longitude(-180, 180);
+		int wrong = 0;
+		for (int i = 0; i < lookups; ++i) {
+			double lat = std::asin(z(random)) * 180 / Pi;
+			double lon = longitude(random);
+			if (i < 4) {
+				// Across the date line and at the poles
+				lat = i < 2 ? 89.999 * (i == 0 ? 1 : -1) : lat;
+				lon = i >= 2 ? 179.999 * (i == 2 ? 1 : -1) : lon;
+			}
+
+			double best = 1e9;
+			for (const auto& place : places) {
+				best = std::min(best, ChordDistance(lat, lon, place.latitude, place.longitude));
+			}
+
+			auto description = geocoder.Describe(lat, lon);
+			size_t index = 0;
+			bool isTown = description.rfind("Town", 0) == 0;
+			if (isTown) {
+				index = std::stoul(description.substr(4));
+			}
+			// The tree works in floats, so a near tie may go either way
+			if (!isTown || index >= places.size() ||
+				ChordDistance(lat, lon, places[index].latitude, places[index].longitude) > best + 1e-6) {
+				if (wrong++ < 5) {
+					std::printf("%.5f, %.5f: \"%s\" is not the nearest place\n", lat, lon, description.c_str());
+				}
+			}
+		}
+		CHECK(wrong == 0);
+	}
+
+	void TestCountries(const std::vector<Place>& places, const ReverseGeocoder& geocoder)
+	{
+		// Country names come from countryInfo.txt, unknown codes are shown as they are
+		for (size_t i = 0; i < 3; ++i) {
+			auto expected = "Town" + std::to_string(i) + ", " + (i == 0 ? "Netherlands" : i == 1 ? "Belgium" : "XX");
+			CHECK(geocoder.Describe(places[i].latitude, places[i].longitude) == expected);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Test::Init(argc, argv);
+	std::mt19937 random(3);
+
+	ReverseGeocoder empty;
+	CHECK(empty.IsEmpty());
+	CHECK(empty.Describe(52, 5).empty());
+	CHECK(!empty.Load(std::filesystem::temp_directory_path() / "PhotoCycleReverseGeocoderTest" / "missing.txt"));
+
+	auto places = RandomPlaces(random, 5000);
+	ReverseGeocoder geocoder;
+	CHECK(geocoder.Load(WritePlaces(places)));
+	CHECK(geocoder.Size() == places.size());
+	TestCountries(places, geocoder);
+	TestNearest(random, places, geocoder, 2000);
+
+	if (Test::bench) {
+		// About the size of cities1000.txt
+		auto many = RandomPlaces(random, 150000);
+		auto path = WritePlaces(many);
+		ReverseGeocoder large;
+		auto loadSeconds = Test::Time(1, [&] { large.Load(path); });
+		std::vector<std::pair<double, double>> points;
+		std::uniform_real_distribution<double> z(-1, 1), longitude(-180, 180);
+		for (int i = 0; i < 100000; ++i) {
+			points.push_back({ std::asin(z(random)) * 180 / Pi, longitude(random) });
+		}
+		size_t length = 0;
+		auto lookupSeconds = Test::Time(3, [&] {
+			for (const auto& [lat, lon] : points) {
+				length += large.Describe(lat, lon).size();
+			}
+		});
+		std::printf("%zu places: loaded in %.0f ms, %zu KB, %.2f us per lookup (%zu)\n", large.Size(), loadSeconds * 1000,
+			large.MemoryUsage() / 1024, lookupSeconds / points.size() * 1e6, length);
+	}
+
+	std::filesystem::remove_all(std::filesystem::temp_directory_path() / "PhotoCycleReverseGeocoderTest");
+	return Test::Finish();
+}
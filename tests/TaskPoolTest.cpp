@@ -0,0 +1,212 @@
+#include "TaskPool.h"
+#include "Test.h"
+
+#include <atomic>
+#include <future>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+	void WaitFor(const std::atomic<bool>& flag)
+	{
+		while (!flag) {
+			std::this_thread::yield();
+		}
+	}
+
+	void TestQueueOrder()
+	{
+		// One worker, kept busy, so the queue can be filled and reordered at leisure
+		TaskPool pool;
+		pool.Start(1, 3);
+		std::promise<void> gate;
+		auto released = gate.get_future().share();
+		std::atomic<bool> blocked = false;
+		std::string ran, cancelled;
+		char owners[8] = {};
+
+		auto submit = [&](char name, TaskPool::Priority priority) {
+			pool.Submit(&owners[name - 'A'], priority,
+				[&, name]() -> TaskPool::Result { return [&, name] { ran += name; }; },
+				[&, name] { cancelled += name; });
+		};
+		pool.Submit(nullptr, TaskPool::Background, [&]() -> TaskPool::Result {
+			blocked = true;
+			released.wait();
+			return [&] { ran += '-'; };
+		}, nullptr);
+		WaitFor(blocked);
+
+		// Full: the oldest background task makes room
+		submit('A', TaskPool::Background);
+		submit('B', TaskPool::Background);
+		submit('C', TaskPool::Background);
+		submit('D', TaskPool::Background);
+		CHECK(pool.QueuedCount() == 3);
+		pool.DeliverResults();
+		CHECK(cancelled == "A");
+
+		// A task on screen pushes out background ones, and a moved one stays
+		pool.Prioritize(&owners['D' - 'A'], TaskPool::OnScreen);
+		submit('E', TaskPool::OnScreen);
+		submit('F', TaskPool::Background);
+		pool.DeliverResults();
+		CHECK(cancelled == "ABC");
+		CHECK(pool.QueuedCount() == 3);
+
+		// With only tasks on screen left, a background task doesn't get in
+		submit('G', TaskPool::OnScreen);
+		submit('H', TaskPool::Background);
+		pool.Cancel(&owners['E' - 'A']);
+		pool.DeliverResults();
+		CHECK(cancelled == "ABCFHE");
+		CHECK(pool.QueuedCount() == 2);
+
+		gate.set_value();
+		while (pool.QueuedCount() > 0) {
+			std::this_thread::yield();
+		}
+		pool.Stop();
+		pool.DeliverResults();
+		CHECK(ran == "-DG");
+		CHECK(cancelled == "ABCFHE");
+
+		// Nothing runs after Stop
+		submit('A', TaskPool::OnScreen);
+		pool.DeliverResults();
+		CHECK(cancelled == "ABCFHEA");
+		CHECK(ran == "-DG");
+	}
+
+	// Submit, Prioritize and Cancel from several threads while the workers run and the results
+	// are delivered. Every task has to end exactly once, in a result or in a cancellation.
+	void TestHammer(int numThreads, size_t maxQueued, int tasksPerThread)
+	{
+		const int submitters = 6, numOwners = 64;
+		TaskPool pool;
+		std::atomic<int> waiting = 0;
+		pool.SetOnResult([&] { ++waiting; });
+		pool.Start(numThreads, maxQueued);
+
+		const int numTasks = submitters * tasksPerThread;
+		std::vector<int> results(numTasks), cancellations(numTasks);
+		std::mutex workersMutex;
+		std::set<std::thread::id> workers;
+		std::atomic<int> running = 0, maxRunning = 0;
+		char owners[numOwners] = {};
+
+		std::atomic<bool> submitted = false, stopped = false;
+		std::atomic<size_t> maxQueuedSeen = 0;
+		std::thread monitor([&] {
+			while (!stopped) {
+				maxQueuedSeen = std::max(maxQueuedSeen.load(), pool.QueuedCount());
+				std::this_thread::yield();
+			}
+		});
+		// The UI thread
+		std::thread deliverer([&] {
+			while (!stopped) {
+				if (pool.DeliverResults() == 0) {
+					std::this_thread::yield();
+				}
+			}
+		});
+
+		std::vector<std::thread> threads;
+		for (int t = 0; t < submitters; ++t) {
+			threads.emplace_back([&, t] {
+				std::mt19937 random(t);
+				for (int i = 0; i < tasksPerThread; ++i) {
+					int id = t * tasksPerThread + i;
+					auto priority = random() % 3 == 0 ? TaskPool::OnScreen : TaskPool::Background;
+					pool.Submit(&owners[random() % numOwners], priority, [&, id]() -> TaskPool::Result {
+						{
+							std::lock_guard<std::mutex> lock(workersMutex);
+							workers.insert(std::this_thread::get_id());
+						}
+						int now = ++running;
+						int seen = maxRunning;
+						while (now > seen && !maxRunning.compare_exchange_weak(seen, now)) {
+						}
+						if (id % 7 == 0) {
+							std::this_thread::sleep_for(std::chrono::microseconds(20));
+						}
+						--running;
+						if (id % 50 == 0) {
+							throw std::runtime_error("expected");
+						}
+						return [&, id] { ++results[id]; };
+					}, [&, id] { ++cancellations[id]; });
+					if (i % 8 == 0) {
+						std::this_thread::yield();
+					}
+				}
+			});
+		}
+		for (int t = 0; t < 2; ++t) {
+			threads.emplace_back([&, t] {
+				std::mt19937 random(100 + t);
+				while (!submitted) {
+					auto owner = &owners[random() % numOwners];
+					switch (random() % 8) {
+					case 0: pool.Cancel(owner); break;
+					case 1: case 2: case 3: pool.Prioritize(owner, TaskPool::OnScreen); break;
+					default: pool.Prioritize(owner, TaskPool::Background); break;
+					}
+					std::this_thread::yield();
+				}
+			});
+		}
+
+		for (int t = 0; t < submitters; ++t) {
+			threads[t].join();
+		}
+		submitted = true;
+		for (size_t t = submitters; t < threads.size(); ++t) {
+			threads[t].join();
+		}
+		pool.Stop();
+		stopped = true;
+		monitor.join();
+		deliverer.join();
+		pool.DeliverResults();
+
+		int wrong = 0, numResults = 0;
+		for (int id = 0; id < numTasks; ++id) {
+			if (results[id] + cancellations[id] != 1) {
+				if (wrong++ < 5) {
+					std::printf("Task %d: %d results, %d cancellations\n", id, results[id], cancellations[id]);
+				}
+			}
+			numResults += results[id];
+		}
+		CHECK(wrong == 0);
+		CHECK(numResults > 0);
+		CHECK(maxQueuedSeen <= maxQueued);
+		CHECK(workers.size() <= (size_t)numThreads);
+		CHECK(maxRunning <= numThreads);
+		CHECK(pool.QueuedCount() == 0);
+		CHECK(waiting >= numResults);
+		if (Test::bench) {
+			std::printf("%d workers, %zu queued at most: %d tasks, %d ran on %zu threads, %d at once, %zu queued at most\n",
+				numThreads, maxQueued, numTasks, numResults, workers.size(), maxRunning.load(), maxQueuedSeen.load());
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Test::Init(argc, argv);
+
+	TestQueueOrder();
+	TestHammer(4, 16, 2000);
+	TestHammer(1, 1, 500);
+	if (Test::bench) {
+		double seconds = Test::Time(1, [] { TestHammer(8, 1000, 100000); });
+		std::printf("%.0f ns per task\n", seconds / 600000 * 1e9);
+	}
+	return Test::Finish();
+}
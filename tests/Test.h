@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+// Just enough of a harness for the tests of the parts that don't depend on Windows.
+// CHECK counts failures instead of stopping, and a test returns nonzero if there were any.
+// Timings are only measured with --bench, so the tests themselves stay quick.
+namespace Test {
+	inline int failures = 0;
+	inline bool bench = false;
+
+	inline void Init(int argc, char** argv)
+	{
+		for (int i = 1; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--bench") == 0) {
+				bench = true;
+			}
+		}
+	}
+
+	inline int Finish()
+	{
+		if (failures > 0) {
+			std::printf("%d check(s) failed\n", failures);
+			return 1;
+		}
+		std::printf("All checks passed\n");
+		return 0;
+	}
+
+	// Seconds per call of `run`, the best of `repeats`
+	template<typename Run>
+	double Time(int repeats, Run run)
+	{
+		double best = std::numeric_limits<double>::infinity();
+		for (int i = 0; i < repeats; ++i) {
+			auto start = std::chrono::steady_clock::now();
+			run();
+			best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		}
+		return best;
+	}
+}
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			++Test::failures; \
+		} \
+	} while (false)